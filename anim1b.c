@@ -0,0 +1,316 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <FreeImage.h>
+#include "anim1b.h"
+#include "options.h"
+#include "output.h"
+#include "transpose.h"
+#include "dither.h"
+#include "resize.h"
+#include "convert.h"
+#include "stream.h"
+
+struct anim1b_context {
+    struct Options Options;
+    struct Output Output;
+
+    /* Working buffers, reused for every frame */
+    struct Frame Frame;
+    FIBITMAP* Input;
+
+    /* One of the RawFormat_* values */
+    int PixelFormat;
+    int Width;
+    int Height;
+
+    char* Filename;
+    bool Open;
+    bool Errors;
+};
+
+static pthread_once_t TransposeOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * Returns the FreeImage dither for ANIM1B_DITHER_*, or -1 if there isn't one.
+ */
+static int GetDitherAlgorithm( int Dither ) {
+    switch ( Dither ) {
+        case ANIM1B_DITHER_FS: return FID_FS;
+        case ANIM1B_DITHER_BAYER4x4: return FID_BAYER4x4;
+        case ANIM1B_DITHER_BAYER8x8: return FID_BAYER8x8;
+        case ANIM1B_DITHER_BAYER16x16: return FID_BAYER16x16;
+        case ANIM1B_DITHER_CLUSTER6x6: return FID_CLUSTER6x6;
+        case ANIM1B_DITHER_CLUSTER8x8: return FID_CLUSTER8x8;
+        case ANIM1B_DITHER_CLUSTER16x16: return FID_CLUSTER16x16;
+        case ANIM1B_DITHER_ATKINSON: return Dither_Atkinson;
+        case ANIM1B_DITHER_SIERRA: return Dither_Sierra;
+        case ANIM1B_DITHER_SIERRA_LITE: return Dither_SierraLite;
+        case ANIM1B_DITHER_JJN: return Dither_JarvisJudiceNinke;
+        case ANIM1B_DITHER_STUCKI: return Dither_Stucki;
+        default: break;
+    };
+
+    return -1;
+}
+
+/*
+ * Copies the public options into (Options), returns false if any of them are out of range.
+ */
+static bool SetOptions( struct Options* Options, const struct anim1b_options* Public ) {
+    Options_SetDefaults( Options );
+
+    CheckExpr( Public->format < ANIM1B_FORMAT_1306_HORIZONTAL || Public->format > ANIM1B_FORMAT_1306_DIRTY, return false );
+    CheckExpr( Public->container < ANIM1B_CONTAINER_RAW || Public->container > ANIM1B_CONTAINER_GIF, return false );
+    CheckExpr( Public->threshold < 0 || Public->threshold > 255, return false );
+    CheckExpr( Public->hysteresis < 0 || Public->hysteresis > 255, return false );
+    CheckExpr( Public->rotate != 0 && Public->rotate != 90 && Public->rotate != 180 && Public->rotate != 270, return false );
+    CheckExpr( Public->dedup == true && Public->container == ANIM1B_CONTAINER_RAW, return false );
+    CheckExpr( Public->dedup == true && Public->container == ANIM1B_CONTAINER_ANM && Public->write_header == false, return false );
+
+    if ( Public->dither != ANIM1B_DITHER_NONE ) {
+        CheckExpr( GetDitherAlgorithm( Public->dither ) == -1, return false );
+
+        Options->DitherFlag = true;
+        Options->DitherAlgorithm = ( FREE_IMAGE_DITHER ) GetDitherAlgorithm( Public->dither );
+    }
+
+    Options->OutputFormat = Public->format;
+    Options->Container = Public->container;
+    Options->ThresholdValue = Public->threshold;
+    Options->InvertFlag = Public->invert;
+    Options->CompressFlag = Public->compress;
+    Options->WriteHeader = Public->write_header;
+    Options->DedupFlag = Public->dedup;
+    Options->Delay = Public->delay;
+    Options->SelfCheckFlag = Public->selfcheck;
+    Options->TemporalFlag = Public->temporal;
+    Options->Hysteresis = Public->hysteresis;
+    Options->Rotation = Public->rotate / 90;
+    Options->MirrorFlag = Public->mirror;
+
+    return true;
+}
+
+/*
+ * Fills (options) with the same defaults anim1b uses.
+ */
+void anim1b_default_options( struct anim1b_options* options ) {
+    NullCheck( options, return );
+
+    memset( options, 0, sizeof( struct anim1b_options ) );
+
+    options->format = ANIM1B_FORMAT_1306_HORIZONTAL;
+    options->container = ANIM1B_CONTAINER_RAW;
+    options->dither = ANIM1B_DITHER_NONE;
+    options->threshold = 128;
+    options->write_header = true;
+    options->delay = DEFAULT_IMAGE_DELAY;
+    options->hysteresis = DEFAULT_HYSTERESIS;
+}
+
+/*
+ * Creates a context for converting (width) x (height) frames of (pixel_format) with (options),
+ * which are copied. Width and height must be divisible by 8.
+ * Returns NULL if the options are invalid or there is not enough memory.
+ */
+anim1b_context* anim1b_create( const struct anim1b_options* options, int width, int height, int pixel_format ) {
+    anim1b_context* Context = NULL;
+
+    NullCheck( options, return NULL );
+    CheckExpr( width <= 0 || height <= 0 || width % 8 != 0 || height % 8 != 0, return NULL );
+    CheckExpr( pixel_format != ANIM1B_PIXELS_GRAY8 && pixel_format != ANIM1B_PIXELS_RGB24, return NULL );
+
+    pthread_once( &TransposeOnce, Transpose_Init );
+
+    NullCheck( ( Context = ( anim1b_context* ) calloc( 1, sizeof( anim1b_context ) ) ), return NULL );
+
+    if ( SetOptions( &Context->Options, options ) == false ) {
+        free( Context );
+        return NULL;
+    }
+
+    Context->PixelFormat = ( pixel_format == ANIM1B_PIXELS_GRAY8 ) ? RawFormat_Gray8 : RawFormat_RGB24;
+    Context->Width = width;
+    Context->Height = height;
+
+    if ( ( Context->Input = Stream_AllocateBitmap( Context->PixelFormat, width, height ) ) == NULL ) {
+        free( Context );
+        return NULL;
+    }
+
+    return Context;
+}
+
+/*
+ * Finishes any output still open and frees (context), along with memory output.
+ */
+void anim1b_destroy( anim1b_context* context ) {
+    if ( context == NULL ) {
+        return;
+    }
+
+    Output_Free( &context->Output );
+    Convert_FreeFrame( &context->Frame );
+
+    if ( context->Input != NULL ) {
+        FreeImage_Unload( context->Input );
+    }
+
+    if ( context->Filename != NULL ) {
+        free( context->Filename );
+    }
+
+    free( context );
+}
+
+/*
+ * Starts writing to (Filename), or to memory if that is NULL.
+ */
+static bool OpenOutput( anim1b_context* Context, const char* Filename ) {
+    NullCheck( Context, return false );
+    CheckExpr( Context->Open == true, return false );
+
+    /* Whatever was written last time goes */
+    Output_Free( &Context->Output );
+
+    if ( Context->Filename != NULL ) {
+        free( Context->Filename );
+        Context->Filename = NULL;
+    }
+
+    if ( Filename != NULL ) {
+        NullCheck( ( Context->Filename = strdup( Filename ) ), return false );
+    }
+
+    /* A new animation doesn't carry anything over from the last one */
+    Dither_ResetHistory( &Context->Frame.Plan );
+
+    Output_Init( &Context->Output, &Context->Options, Context->Filename );
+    Output_SetSize( &Context->Output, Context->Width, Context->Height );
+
+    /* The caller chose where the output goes, there is nobody to ask */
+    Context->Output.Overwrite = Overwrite_Always;
+
+    if ( Output_Open( &Context->Output ) == false ) {
+        return false;
+    }
+
+    Context->Open = true;
+    Context->Errors = false;
+
+    return true;
+}
+
+/*
+ * Starts writing to (filename), replacing it if it already exists.
+ */
+bool anim1b_open_file( anim1b_context* context, const char* filename ) {
+    NullCheck( filename, return false );
+    return OpenOutput( context, filename );
+}
+
+/*
+ * Starts writing to memory, collect the result with anim1b_get_output after anim1b_finish.
+ */
+bool anim1b_open_memory( anim1b_context* context ) {
+    NullCheck( context, return false );
+
+    return OpenOutput( context, NULL );
+}
+
+/*
+ * Converts and writes one frame of (pixels), with (stride) bytes from one row to the next.
+ * Returns false if the frame could not be converted or written.
+ */
+bool anim1b_push_frame( anim1b_context* context, const void* pixels, size_t stride ) {
+    NullCheck( context, return false );
+    return anim1b_push_frame_delay( context, pixels, stride, context->Options.Delay );
+}
+
+/*
+ * Same as anim1b_push_frame, but the frame is shown for (delay) milliseconds instead of anim1b_options.delay.
+ */
+bool anim1b_push_frame_delay( anim1b_context* context, const void* pixels, size_t stride, uint32_t delay ) {
+    struct Frame* Frame = NULL;
+    FIBITMAP* Input = NULL;
+    bool Result = false;
+
+    NullCheck( context, return false );
+    NullCheck( pixels, return false );
+    CheckExpr( context->Open == false, return false );
+    CheckExpr( stride < Stream_GetFrameSize( context->PixelFormat, context->Width, 1 ), return false );
+
+    Frame = &context->Frame;
+
+    /* Conversion may change the input in place, so it is copied every time */
+    Stream_CopyFrame( context->PixelFormat, ( const uint8_t* ) pixels, stride, context->Input );
+
+    Frame->Width = context->Width;
+    Frame->Height = context->Height;
+    Frame->Output = NULL;
+
+    /* Colour frames go down to a byte per pixel before anything else looks at them, as in anim1b */
+    if ( ( Input = Convert_Greyscale( &context->Options, context->Input, Frame ) ) == NULL ) {
+        Frame->Status = Frame_NoMemory;
+    } else {
+        Convert_Frame( &context->Options, Input, Frame );
+    }
+
+    if ( Frame->Status == Frame_Ok ) {
+        if ( context->Options.Container == Container_GIF ) {
+            Result = Output_WriteFrame( &context->Output, ( void* ) Frame->Bitmap, delay );
+        } else {
+            Result = Output_WriteFrame( &context->Output, Frame->Output, delay );
+        }
+    }
+
+    Convert_ReleaseFrame( Frame );
+
+    if ( Result == false ) {
+        context->Errors = true;
+    }
+
+    return Result;
+}
+
+/*
+ * Returns the number of frames written to the current output.
+ */
+int anim1b_get_frame_count( const anim1b_context* context ) {
+    NullCheck( context, return 0 );
+    return context->Output.FramesWritten;
+}
+
+/*
+ * Writes the header and closes the output.
+ * Returns false if any frame failed along the way.
+ */
+bool anim1b_finish( anim1b_context* context ) {
+    NullCheck( context, return false );
+    CheckExpr( context->Open == false, return false );
+
+    Output_Close( &context->Output );
+    context->Open = false;
+
+    return ( context->Errors == true ) ? false : true;
+}
+
+/*
+ * Returns the output written to memory once anim1b_finish has been called, and its size in (size).
+ * The buffer belongs to (context) and stays valid until the next output is opened or it is destroyed.
+ */
+const uint8_t* anim1b_get_output( const anim1b_context* context, size_t* size ) {
+    NullCheck( context, return NULL );
+    return Output_GetMemory( &context->Output, size );
+}
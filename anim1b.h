@@ -0,0 +1,143 @@
+#ifndef _ANIM1B_H_
+#define _ANIM1B_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * libanim1b:
+ * The anim1b converter without the command line. Each context holds its own options,
+ * buffers and output, so any number of them can be used at once from different threads
+ * as long as a single context is only used from one thread at a time.
+ *
+ * When FreeImage is linked statically FreeImage_Initialise must be called before
+ * the first context is created.
+ *
+ *     struct anim1b_options Options;
+ *     anim1b_context* Context = NULL;
+ *
+ *     anim1b_default_options( &Options );
+ *     Options.container = ANIM1B_CONTAINER_ANM;
+ *
+ *     Context = anim1b_create( &Options, 128, 64, ANIM1B_PIXELS_GRAY8 );
+ *     anim1b_open_memory( Context );
+ *
+ *     for each frame: anim1b_push_frame( Context, Pixels, 128 );
+ *
+ *     anim1b_finish( Context );
+ *     Data = anim1b_get_output( Context, &Size );
+ *     ...
+ *     anim1b_destroy( Context );
+ */
+
+typedef struct anim1b_context anim1b_context;
+
+/* Layout of the pixels passed to anim1b_push_frame, rows are top-down */
+enum {
+    /* One byte per pixel, 0 is black */
+    ANIM1B_PIXELS_GRAY8 = 1,
+
+    /* Three bytes per pixel in R, G, B order */
+    ANIM1B_PIXELS_RGB24
+};
+
+/* Same as anim1b --format */
+enum {
+    ANIM1B_FORMAT_1306_HORIZONTAL = 0,
+    ANIM1B_FORMAT_1306_VERTICAL,
+    ANIM1B_FORMAT_LINEAR,
+    ANIM1B_FORMAT_1306_DIRTY
+};
+
+/* What the frames are wrapped in, anim1b picks this from the output file extension */
+enum {
+    ANIM1B_CONTAINER_RAW = 0,
+    ANIM1B_CONTAINER_ANM,
+    ANIM1B_CONTAINER_GIF
+};
+
+/* Same as anim1b --dither */
+enum {
+    /* Threshold at anim1b_options.threshold instead */
+    ANIM1B_DITHER_NONE = -1,
+
+    ANIM1B_DITHER_FS = 0,
+    ANIM1B_DITHER_BAYER4x4,
+    ANIM1B_DITHER_BAYER8x8,
+    ANIM1B_DITHER_BAYER16x16,
+    ANIM1B_DITHER_CLUSTER6x6,
+    ANIM1B_DITHER_CLUSTER8x8,
+    ANIM1B_DITHER_CLUSTER16x16,
+
+    /* Serpentine error diffusion */
+    ANIM1B_DITHER_ATKINSON,
+    ANIM1B_DITHER_SIERRA,
+    ANIM1B_DITHER_SIERRA_LITE,
+    ANIM1B_DITHER_JJN,
+    ANIM1B_DITHER_STUCKI
+};
+
+struct anim1b_options {
+    /* ANIM1B_FORMAT_* */
+    int format;
+
+    /* ANIM1B_CONTAINER_* */
+    int container;
+
+    /* ANIM1B_DITHER_*, and the 0-255 threshold used with ANIM1B_DITHER_NONE */
+    int dither;
+    int threshold;
+
+    bool invert;
+
+    /* ANM only: compress frames, and write the header */
+    bool compress;
+    bool write_header;
+
+    /* Same as anim1b --dedup: store repeated frames once, ANM needs the header for it */
+    bool dedup;
+
+    /* Delay in milliseconds between frames, unless given to anim1b_push_frame_delay */
+    uint32_t delay;
+
+    /* Check every frame against the reference conversion, slow */
+    bool selfcheck;
+
+    /* Same as anim1b --temporal: keep pixels from the previous frame until their
+     * grey level moves more than (hysteresis) 0-255 away.
+     */
+    bool temporal;
+    int hysteresis;
+
+    /* Same as anim1b --rotate and --mirror: turn frames clockwise by 0, 90, 180 or 270 degrees,
+     * then mirror them left to right. Frames turned on their side come out height x width.
+     */
+    int rotate;
+    bool mirror;
+};
+
+void anim1b_default_options( struct anim1b_options* options );
+
+anim1b_context* anim1b_create( const struct anim1b_options* options, int width, int height, int pixel_format );
+void anim1b_destroy( anim1b_context* context );
+
+bool anim1b_open_file( anim1b_context* context, const char* filename );
+bool anim1b_open_memory( anim1b_context* context );
+
+bool anim1b_push_frame( anim1b_context* context, const void* pixels, size_t stride );
+bool anim1b_push_frame_delay( anim1b_context* context, const void* pixels, size_t stride, uint32_t delay );
+int anim1b_get_frame_count( const anim1b_context* context );
+
+bool anim1b_finish( anim1b_context* context );
+const uint8_t* anim1b_get_output( const anim1b_context* context, size_t* size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
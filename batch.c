@@ -0,0 +1,326 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <FreeImage.h>
+#include "cmdline.h"
+#include "options.h"
+#include "output.h"
+#include "stream.h"
+#include "jobs.h"
+#include "process.h"
+#include "batch.h"
+
+/*
+ * Batch mode:
+ * Every line of the manifest is a whole anim1b command line, minus the program name.
+ * Lines are parsed one at a time in order, then converted in parallel with each
+ * job getting its own output state and a single thread. Results are reported in
+ * manifest order.
+ */
+struct BatchJob {
+    struct ProcessJob Job;
+
+    /* Own copies of the names in Job, the command line parser frees its own after each line */
+    char* OutputFilename;
+    char** InputFilenames;
+    char* TimingFilename;
+    char* CacheDirectory;
+
+    int LineNumber;
+    bool Valid;
+};
+
+struct BatchState {
+    FILE* Manifest;
+    const char* Name;
+
+    char* Line;
+    size_t LineSize;
+    int LineNumber;
+
+    struct BatchJob* Jobs;
+    struct BatchResult* Result;
+};
+
+/*
+ * Splits (Line) into whitespace separated arguments in place, after (Argv)[ 0 ] which the caller sets.
+ * Single or double quotes group arguments with spaces in them and a backslash escapes the next character.
+ * Returns the number of arguments, including Argv[ 0 ].
+ */
+static int SplitLine( char* Line, char** Argv, int MaxArgs ) {
+    char* Read = Line;
+    char* Write = Line;
+    char Quote = 0;
+    int Argc = 1;
+
+    while ( *Read != 0 && Argc < MaxArgs ) {
+        while ( isspace( ( unsigned char ) *Read ) ) {
+            Read++;
+        }
+
+        if ( *Read == 0 ) {
+            break;
+        }
+
+        Argv[ Argc++ ] = Write;
+
+        while ( *Read != 0 && ( Quote != 0 || isspace( ( unsigned char ) *Read ) == 0 ) ) {
+            if ( *Read == '\\' && Read[ 1 ] != 0 ) {
+                *Write++ = Read[ 1 ];
+                Read+= 2;
+            } else if ( Quote == 0 && ( *Read == '"' || *Read == '\'' ) ) {
+                Quote = *Read++;
+            } else if ( *Read == Quote ) {
+                Quote = 0;
+                Read++;
+            } else {
+                *Write++ = *Read++;
+            }
+        }
+
+        /* Writing never gets ahead of reading so the terminator can't clobber anything unread */
+        if ( *Read != 0 ) {
+            Read++;
+        }
+
+        *Write++ = 0;
+    }
+
+    return Argc;
+}
+
+/*
+ * Returns true if (Line) has nothing to run.
+ */
+static bool IsBlankLine( const char* Line ) {
+    while ( isspace( ( unsigned char ) *Line ) ) {
+        Line++;
+    }
+
+    return ( *Line == 0 || *Line == '#' ) ? true : false;
+}
+
+static void FreeJob( struct BatchJob* Job ) {
+    int i = 0;
+
+    if ( Job->InputFilenames != NULL ) {
+        for ( i = 0; i < Job->Job.InputCount; i++ ) {
+            free( Job->InputFilenames[ i ] );
+        }
+
+        free( Job->InputFilenames );
+    }
+
+    if ( Job->OutputFilename != NULL ) {
+        free( Job->OutputFilename );
+    }
+
+    if ( Job->TimingFilename != NULL ) {
+        free( Job->TimingFilename );
+    }
+
+    if ( Job->CacheDirectory != NULL ) {
+        free( Job->CacheDirectory );
+    }
+
+    memset( Job, 0, sizeof( struct BatchJob ) );
+}
+
+/*
+ * Copies the options the line was parsed into out of the command line parser.
+ */
+static bool CopyJob( struct BatchJob* Job ) {
+    const char** InputFilenames = CmdLine_GetInputFilenames( );
+    int InputCount = CmdLine_GetInputCount( );
+    int i = 0;
+
+    CmdLine_GetOptions( &Job->Job.Options );
+
+    NullCheck( ( Job->OutputFilename = strdup( CmdLine_GetOutputFilename( ) ) ), return false );
+    NullCheck( ( Job->InputFilenames = ( char** ) calloc( InputCount, sizeof( char* ) ) ), return false );
+
+    for ( i = 0; i < InputCount; i++ ) {
+        NullCheck( ( Job->InputFilenames[ i ] = strdup( InputFilenames[ i ] ) ), return false );
+        Job->Job.InputCount++;
+    }
+
+    if ( CmdLine_GetTimingFilename( ) != NULL ) {
+        NullCheck( ( Job->TimingFilename = strdup( CmdLine_GetTimingFilename( ) ) ), return false );
+    }
+
+    if ( CmdLine_GetCacheDirectory( ) != NULL ) {
+        NullCheck( ( Job->CacheDirectory = strdup( CmdLine_GetCacheDirectory( ) ) ), return false );
+    }
+
+    Job->Job.OutputFilename = Job->OutputFilename;
+    Job->Job.InputFilenames = ( const char** ) Job->InputFilenames;
+    Job->Job.TimingFilename = Job->TimingFilename;
+    Job->Job.CacheDirectory = Job->CacheDirectory;
+    Job->Job.RawFormat = RawFormat_None;
+
+    /* Nobody to ask, the manifest is the instruction to write these */
+    Job->Job.Overwrite = Overwrite_Always;
+
+    return true;
+}
+
+/*
+ * Parses the next line that has anything on it into (Slot).
+ * Returns false at the end of the manifest.
+ */
+static bool ReadJob( void* Context, int Index, int Slot ) {
+    struct BatchState* State = ( struct BatchState* ) Context;
+    struct BatchJob* Job = &State->Jobs[ Slot ];
+    char ArgvName[ 512 ];
+    char** Argv = NULL;
+    int Argc = 0;
+
+    ( void ) Index;
+
+    while ( getline( &State->Line, &State->LineSize, State->Manifest ) != -1 ) {
+        State->LineNumber++;
+
+        if ( IsBlankLine( State->Line ) == true ) {
+            continue;
+        }
+
+        memset( Job, 0, sizeof( struct BatchJob ) );
+        Job->LineNumber = State->LineNumber;
+
+        /* Every argument takes at least two characters, except the last */
+        NullCheck( ( Argv = ( char** ) calloc( strlen( State->Line ) / 2 + 3, sizeof( char* ) ) ), return true );
+
+        snprintf( ArgvName, sizeof( ArgvName ), "%s:%d", State->Name, State->LineNumber );
+        Argv[ 0 ] = ArgvName;
+
+        Argc = SplitLine( State->Line, Argv, strlen( State->Line ) / 2 + 2 );
+
+        if ( CmdLine_ParseJob( Argc, Argv ) == 0 ) {
+            Job->Valid = CopyJob( Job );
+        }
+
+        CmdLine_Free( );
+        free( Argv );
+
+        return true;
+    }
+
+    return false;
+}
+
+static void RunJob( void* Context, int Index, int Slot ) {
+    struct BatchState* State = ( struct BatchState* ) Context;
+    struct BatchJob* Job = &State->Jobs[ Slot ];
+
+    ( void ) Index;
+
+    if ( Job->Valid == true ) {
+        Process_Run( &Job->Job, 1 );
+    }
+}
+
+/*
+ * Returns the size of (Filename) in bytes, 0 if it does not exist.
+ */
+static uint64_t GetFileSize( const char* Filename ) {
+    struct stat Info;
+
+    if ( Filename == NULL || stat( Filename, &Info ) != 0 ) {
+        return 0;
+    }
+
+    return ( uint64_t ) Info.st_size;
+}
+
+static bool ReportJob( void* Context, int Index, int Slot ) {
+    struct BatchState* State = ( struct BatchState* ) Context;
+    struct BatchJob* Job = &State->Jobs[ Slot ];
+
+    ( void ) Index;
+
+    State->Result->JobCount++;
+
+    if ( Job->Valid == false ) {
+        printf( "%s:%d: Skipped, invalid options.\n", State->Name, Job->LineNumber );
+        State->Result->FailedCount++;
+    } else {
+        if ( Job->Job.FrameCount > Job->Job.InputCount ) {
+            printf( "%s: Processed %d of %d frames from %d input images.\n", Job->OutputFilename, Job->Job.FramesWritten, Job->Job.FrameCount, Job->Job.InputCount );
+        } else {
+            printf( "%s: Processed %d of %d input images.\n", Job->OutputFilename, Job->Job.FramesWritten, Job->Job.InputCount );
+        }
+
+        if ( Job->Job.CacheDirectory != NULL ) {
+            printf( "%s: Reused %d frames from the cache.\n", Job->OutputFilename, Job->Job.FramesCached );
+        }
+
+        fflush( stdout );
+
+        if ( Job->Job.Errors == true ) {
+            fprintf( stderr, "%s: There were errors during the conversion.\n", Job->OutputFilename );
+            State->Result->FailedCount++;
+        }
+
+        State->Result->FramesWritten+= Job->Job.FramesWritten;
+        State->Result->BytesWritten+= GetFileSize( Job->OutputFilename );
+    }
+
+    fflush( stdout );
+    FreeJob( Job );
+
+    return true;
+}
+
+/*
+ * Runs every job in (Manifest), or stdin if it is NULL or "-", with up to (Threads) jobs at a time.
+ * Jobs that fail are reported and skipped.
+ */
+void Batch_Run( const char* Manifest, int Threads, struct BatchResult* Result ) {
+    struct BatchState State;
+
+    NullCheck( Result, return );
+
+    memset( &State, 0, sizeof( struct BatchState ) );
+    memset( Result, 0, sizeof( struct BatchResult ) );
+
+    State.Result = Result;
+
+    if ( Manifest == NULL || strcmp( Manifest, "-" ) == 0 ) {
+        State.Manifest = stdin;
+        State.Name = "stdin";
+    } else {
+        State.Manifest = fopen( Manifest, "r" );
+        State.Name = Manifest;
+    }
+
+    if ( State.Manifest == NULL ) {
+        fprintf( stderr, "Failed to open batch manifest %s\n", Manifest );
+        return;
+    }
+
+    if ( ( State.Jobs = ( struct BatchJob* ) calloc( Jobs_GetSlotCount( Threads ), sizeof( struct BatchJob ) ) ) != NULL ) {
+        Jobs_RunOrdered( Threads, -1, ReadJob, RunJob, ReportJob, &State );
+        free( State.Jobs );
+    } else {
+        fprintf( stderr, "Failed to allocate batch job slots.\n" );
+    }
+
+    if ( State.Line != NULL ) {
+        free( State.Line );
+    }
+
+    if ( State.Manifest != stdin ) {
+        fclose( State.Manifest );
+    }
+}
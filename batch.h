@@ -0,0 +1,14 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/* Totals over every line of a manifest */
+struct BatchResult {
+    int JobCount;
+    int FailedCount;
+    int FramesWritten;
+    uint64_t BytesWritten;
+};
+
+void Batch_Run( const char* Manifest, int Threads, struct BatchResult* Result );
+
+#endif
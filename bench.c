@@ -0,0 +1,426 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <argp.h>
+#include <sys/stat.h>
+#include <FreeImage.h>
+#include "cmdline.h"
+#include "options.h"
+#include "output.h"
+#include "transpose.h"
+#include "dither.h"
+#include "resize.h"
+#include "convert.h"
+
+/*
+ * anim1b_bench:
+ * Runs synthetic frames through the same conversion and output code as anim1b
+ * for every combination of pattern, output backend, output format and threshold/dither,
+ * and reports how long each one took.
+ */
+
+enum {
+    Pattern_Noise = 0,
+    Pattern_Gradient,
+    Pattern_Sprites,
+    Pattern_Count
+};
+
+static const char* PatternNames[ Pattern_Count ] = {
+    "noise",
+    "gradient",
+    "sprites"
+};
+
+/* Output backends, picked by file extension */
+static const char* Backends[ ] = {
+    "bin",
+    "anm",
+    "gif"
+};
+
+static const char* Formats[ ] = {
+    "1306_horizontal",
+    "1306_vertical",
+    "linear",
+    "1306_dirty"
+};
+
+/* Passed straight to anim1b's command line parser */
+static const char* Dithers[ ] = {
+    "-t128",
+    "-dfs",
+    "-db4x4",
+    "-db8x8",
+    "-db16x16",
+    "-dc6x6",
+    "-dc8x8",
+    "-dc16x16",
+    "-datkinson",
+    "-dsierra",
+    "-dsierralite",
+    "-djjn",
+    "-dstucki"
+};
+
+#define CountOf( a ) ( ( int ) ( sizeof( a ) / sizeof( a[ 0 ] ) ) )
+
+static error_t ParseBenchArgs( int Key, char* Arg, struct argp_state* State );
+
+static int Width = 128;
+static int Height = 64;
+static int FrameCount = 100;
+static int Pattern = -1;
+static bool RGBInput = false;
+static const char* Directory = ".";
+
+static struct argp_option BenchOptions[ ] = {
+    { "size", 's', "WxH", 0, "Frame size, default 128x64", 0 },
+    { "frames", 'n', "count", 0, "Frames per run, default 100", 0 },
+    { "pattern", 'p', "pattern", 0, "Only run noise, gradient or sprites", 0 },
+    { "rgb", 'r', NULL, 0, "Generate 24bpp frames instead of 8bpp greyscale", 0 },
+    { "dir", 'o', "directory", 0, "Where to write the temporary output files, default .", 0 },
+    { NULL, 0, NULL, 0, NULL, 0 }
+};
+
+static struct argp BenchArgp = {
+    BenchOptions,
+    ParseBenchArgs,
+    NULL,
+    "anim1b_bench: Conversion benchmark for anim1b",
+    NULL,
+    NULL,
+    NULL
+};
+
+static error_t ParseBenchArgs( int Key, char* Arg, struct argp_state* State ) {
+    int i = 0;
+
+    switch ( Key ) {
+        case 's': {
+            if ( sscanf( Arg, "%dx%d", &Width, &Height ) != 2 || Width <= 0 || Height <= 0 || Width % 8 != 0 || Height % 8 != 0 ) {
+                argp_error( State, "Invalid frame size: %s, width and height must be divisible by 8", Arg );
+            }
+
+            break;
+        }
+        case 'n': {
+            FrameCount = ( int ) strtol( Arg, NULL, 10 );
+
+            if ( FrameCount < 1 ) {
+                argp_error( State, "Invalid frame count: %s", Arg );
+            }
+
+            break;
+        }
+        case 'p': {
+            for ( Pattern = -1, i = 0; i < Pattern_Count; i++ ) {
+                if ( strcasecmp( Arg, PatternNames[ i ] ) == 0 ) {
+                    Pattern = i;
+                }
+            }
+
+            if ( Pattern == -1 ) {
+                argp_error( State, "Unknown pattern: %s", Arg );
+            }
+
+            break;
+        }
+        case 'r': {
+            RGBInput = true;
+            break;
+        }
+        case 'o': {
+            Directory = Arg;
+            break;
+        }
+        default: return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static uint64_t GetTimeNS( void ) {
+    struct timespec Now;
+
+    clock_gettime( CLOCK_MONOTONIC, &Now );
+    return ( ( uint64_t ) Now.tv_sec * 1000000000ULL ) + ( uint64_t ) Now.tv_nsec;
+}
+
+static uint32_t XorShift( uint32_t* State ) {
+    *State^= *State << 13;
+    *State^= *State >> 17;
+    *State^= *State << 5;
+
+    return *State;
+}
+
+/*
+ * Triangle wave bouncing between 0 and (Range).
+ */
+static int Bounce( int Position, int Range ) {
+    Position%= ( Range * 2 );
+    return ( Position < Range ) ? Position : ( Range * 2 ) - Position;
+}
+
+/*
+ * Returns the brightness of pixel (x,y) of frame (Index) of (Pattern), y = 0 is the top.
+ */
+static uint8_t GetPatternPixel( int Pattern, int Index, int x, int y, uint32_t* Random ) {
+    int Radius = Height / 6;
+    int Value = 0;
+    int dx = 0;
+    int dy = 0;
+    int i = 0;
+
+    switch ( Pattern ) {
+        case Pattern_Noise: {
+            return ( uint8_t ) ( XorShift( Random ) >> 24 );
+        }
+        case Pattern_Gradient: {
+            /* Diagonal ramp scrolling a few pixels per frame */
+            return ( uint8_t ) ( ( ( x + y + ( Index * 4 ) ) * 255 ) / ( Width + Height ) );
+        }
+        case Pattern_Sprites: {
+            Value = ( x * 255 ) / Width;
+
+            /* A few balls bouncing around at different speeds over a horizontal ramp */
+            for ( i = 0; i < 4; i++ ) {
+                dx = x - ( Radius + Bounce( Index * ( 2 + i ) + ( i * 37 ), Width - ( Radius * 2 ) ) );
+                dy = y - ( Radius + Bounce( Index * ( 3 + i ) + ( i * 11 ), Height - ( Radius * 2 ) ) );
+
+                if ( ( dx * dx ) + ( dy * dy ) <= Radius * Radius ) {
+                    Value = ( i & 1 ) ? 0 : 255;
+                }
+            }
+
+            return ( uint8_t ) Value;
+        }
+        default: break;
+    };
+
+    return 0;
+}
+
+/*
+ * Generates frame (Index) of (Pattern) as an 8bpp greyscale or 24bpp bitmap.
+ */
+static FIBITMAP* GenerateFrame( int Pattern, int Index ) {
+    uint32_t Random = 0x9E3779B9u * ( uint32_t ) ( Index + 1 );
+    FIBITMAP* Result = NULL;
+    RGBQUAD* Palette = NULL;
+    uint8_t* Line = NULL;
+    uint8_t Value = 0;
+    int x = 0;
+    int y = 0;
+
+    if ( ( Result = FreeImage_Allocate( Width, Height, ( RGBInput == true ) ? 24 : 8, 0, 0, 0 ) ) == NULL ) {
+        return NULL;
+    }
+
+    if ( RGBInput == false ) {
+        Palette = FreeImage_GetPalette( Result );
+
+        for ( x = 0; x < 256; x++ ) {
+            Palette[ x ].rgbRed = Palette[ x ].rgbGreen = Palette[ x ].rgbBlue = ( BYTE ) x;
+        }
+    }
+
+    for ( y = 0; y < Height; y++ ) {
+        /* FreeImage scanlines are bottom-up */
+        Line = FreeImage_GetScanLine( Result, Height - 1 - y );
+
+        for ( x = 0; x < Width; x++ ) {
+            Value = GetPatternPixel( Pattern, Index, x, y, &Random );
+
+            if ( RGBInput == true ) {
+                Line[ ( x * 3 ) + FI_RGBA_RED ] = Value;
+                Line[ ( x * 3 ) + FI_RGBA_GREEN ] = ( uint8_t ) ( 255 - Value );
+                Line[ ( x * 3 ) + FI_RGBA_BLUE ] = ( uint8_t ) ( Value ^ ( x & 0xFF ) );
+            } else {
+                Line[ x ] = Value;
+            }
+        }
+    }
+
+    return Result;
+}
+
+/*
+ * Converts and writes every frame in (Input) with the given options, the same way anim1b would:
+ * --rgb frames are reduced to greyscale first, then converted and packed.
+ * Returns false if anything went wrong.
+ */
+static bool RunCase( FIBITMAP** Input, const char* Backend, const char* Format, const char* Dither, uint64_t* Elapsed, off_t* OutputSize ) {
+    char Filename[ 1024 ];
+    char* Argv[ 8 ];
+    struct Options Options;
+    struct Output Output;
+    struct Frame Frame;
+    struct stat Info;
+    FIBITMAP* Greyscale = NULL;
+    uint64_t Start = 0;
+    bool Result = true;
+    int i = 0;
+
+    snprintf( Filename, sizeof( Filename ), "%s/anim1b_bench.%s", Directory, Backend );
+    unlink( Filename );
+
+    Argv[ 0 ] = ( char* ) "anim1b_bench";
+    Argv[ 1 ] = ( char* ) "-f";
+    Argv[ 2 ] = ( char* ) Format;
+    Argv[ 3 ] = ( char* ) Dither;
+    Argv[ 4 ] = ( char* ) "-o";
+    Argv[ 5 ] = Filename;
+    Argv[ 6 ] = ( char* ) "synthetic";
+    Argv[ 7 ] = NULL;
+
+    if ( CmdLine_Handler( 7, Argv ) != 0 ) {
+        return false;
+    }
+
+    memset( &Frame, 0, sizeof( struct Frame ) );
+
+    CmdLine_GetOptions( &Options );
+    Output_Init( &Output, &Options, Filename );
+
+    Start = GetTimeNS( );
+
+    Output_SetSize( &Output, Width, Height );
+    Output_SetFrameCount( &Output, FrameCount );
+
+    if ( Output_Open( &Output ) == false ) {
+        fprintf( stderr, "Failed to open %s: %s\n", Filename, strerror( errno ) );
+        Result = false;
+    }
+
+    for ( i = 0; i < FrameCount && Result == true; i++ ) {
+        Frame.Width = Width;
+        Frame.Height = Height;
+        Frame.Output = Output_GetFrameBuffer( &Output, i );
+
+        if ( ( Greyscale = Convert_Greyscale( &Options, Input[ i ], &Frame ) ) == NULL ) {
+            Frame.Status = Frame_NoMemory;
+        } else {
+            Convert_Frame( &Options, Greyscale, &Frame );
+        }
+
+        if ( Frame.Status != Frame_Ok ) {
+            Result = false;
+        } else if ( Options.Container == Container_GIF ) {
+            Result = Output_WriteFrame( &Output, ( void* ) Frame.Bitmap, Options.Delay );
+        } else {
+            Result = Output_WriteFrame( &Output, Frame.Output, Options.Delay );
+        }
+
+        Convert_ReleaseFrame( &Frame );
+    }
+
+    Output_Close( &Output );
+
+    *Elapsed = GetTimeNS( ) - Start;
+    *OutputSize = ( stat( Filename, &Info ) == 0 ) ? Info.st_size : 0;
+
+    Output_Free( &Output );
+    Convert_FreeFrame( &Frame );
+    CmdLine_Free( );
+
+    unlink( Filename );
+    return Result;
+}
+
+static const char* GetDitherName( int Dither ) {
+    return ( Dither == 0 ) ? "threshold" : &Dithers[ Dither ][ 2 ];
+}
+
+static void RunPattern( int Pattern ) {
+    FIBITMAP** Input = NULL;
+    double Pixels = ( double ) Width * Height * FrameCount;
+    uint64_t Elapsed = 0;
+    off_t OutputSize = 0;
+    int Backend = 0;
+    int Format = 0;
+    int Dither = 0;
+    int i = 0;
+
+    if ( ( Input = ( FIBITMAP** ) calloc( FrameCount, sizeof( FIBITMAP* ) ) ) == NULL ) {
+        fprintf( stderr, "Failed to allocate frames.\n" );
+        return;
+    }
+
+    for ( i = 0; i < FrameCount; i++ ) {
+        if ( ( Input[ i ] = GenerateFrame( Pattern, i ) ) == NULL ) {
+            fprintf( stderr, "Failed to generate frame %d.\n", i );
+            break;
+        }
+    }
+
+    for ( Backend = 0; Backend < CountOf( Backends ) && i == FrameCount; Backend++ ) {
+        for ( Format = 0; Format < CountOf( Formats ); Format++ ) {
+            /* GIF output does not depend on the output format */
+            if ( strcmp( Backends[ Backend ], "gif" ) == 0 && Format > 0 ) {
+                break;
+            }
+
+            for ( Dither = 0; Dither < CountOf( Dithers ); Dither++ ) {
+                if ( RunCase( Input, Backends[ Backend ], Formats[ Format ], Dithers[ Dither ], &Elapsed, &OutputSize ) == false ) {
+                    printf( "%-9s %-4s %-16s %-9s failed\n", PatternNames[ Pattern ], Backends[ Backend ], Formats[ Format ], GetDitherName( Dither ) );
+                    continue;
+                }
+
+                printf( "%-9s %-4s %-16s %-9s %10.3f %12.1f %12lld\n",
+                    PatternNames[ Pattern ],
+                    Backends[ Backend ],
+                    ( strcmp( Backends[ Backend ], "gif" ) == 0 ) ? "-" : Formats[ Format ],
+                    GetDitherName( Dither ),
+                    ( double ) Elapsed / Pixels,
+                    ( double ) FrameCount / ( ( double ) Elapsed / 1e9 ),
+                    ( long long ) OutputSize
+                );
+            }
+        }
+    }
+
+    for ( i = 0; i < FrameCount; i++ ) {
+        if ( Input[ i ] != NULL ) {
+            FreeImage_Unload( Input[ i ] );
+        }
+    }
+
+    free( Input );
+}
+
+int main( int Argc, char** Argv ) {
+    int i = 0;
+
+    if ( argp_parse( &BenchArgp, Argc, Argv, 0, 0, NULL ) != 0 ) {
+        return 1;
+    }
+
+    FreeImage_Initialise( FALSE );
+    Transpose_Init( );
+
+    printf( "%d frames of %dx%d %s, transpose engine: %s\n", FrameCount, Width, Height, ( RGBInput == true ) ? "rgb24" : "gray8", Transpose_GetEngineName( ) );
+    printf( "%-9s %-4s %-16s %-9s %10s %12s %12s\n", "Pattern", "Out", "Format", "Dither", "ns/pixel", "frames/sec", "Bytes" );
+
+    for ( i = 0; i < Pattern_Count; i++ ) {
+        if ( Pattern == -1 || Pattern == i ) {
+            RunPattern( i );
+        }
+    }
+
+    FreeImage_DeInitialise( );
+    return 0;
+}
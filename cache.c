@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <FreeImage.h>
+#include "options.h"
+#include "output.h"
+#include "dither.h"
+#include "resize.h"
+#include "convert.h"
+#include "cache.h"
+
+/*
+ * Frame cache:
+ * Every entry is a file named after the hashes of the input image and of the options, holding
+ * a struct CacheHeader and the packed frame. The header repeats the whole key, so a file that was
+ * renamed, cut short or written by another version is a miss rather than a wrong frame.
+ * Entries are written under a temporary name and renamed into place, so jobs and processes
+ * sharing a cache directory never see half an entry.
+ */
+
+/* "A1C" and the entry version, bumped whenever the same options start packing frames differently */
+#define CacheMagic ( ( '1' << 24 ) | ( 'C' << 16 ) | ( '1' << 8 ) | 'A' )
+
+/* Input files are hashed this much at a time */
+#define HashChunkSize ( 64 * 1024 )
+
+struct CacheHeader {
+    uint32_t Magic;
+
+    uint16_t Width;
+    uint16_t Height;
+
+    uint64_t Hash[ 2 ];
+    uint64_t FileSize;
+    uint64_t OptionsHash;
+
+    uint32_t FrameTime;
+    uint32_t HasFrameTime;
+};
+
+/*
+ * FNV-1a, the same hash the dedup table uses, continued from (Hash).
+ */
+static uint64_t HashBytes( uint64_t Hash, const uint8_t* Data, size_t Size ) {
+    size_t i = 0;
+
+    for ( i = 0; i < Size; i++ ) {
+        Hash = ( Hash ^ Data[ i ] ) * 0x100000001B3ULL;
+    }
+
+    return Hash;
+}
+
+/*
+ * Multiply and rotate over 64 bit words, continued from (Hash).
+ * Unrelated to FNV-1a, so two different files would have to collide in both.
+ * A partial word at the end is padded with zeroes, the file size tells those apart.
+ */
+static uint64_t HashWords( uint64_t Hash, const uint8_t* Data, size_t Size ) {
+    uint64_t Word = 0;
+    size_t i = 0;
+
+    for ( i = 0; i < Size; i+= sizeof( uint64_t ) ) {
+        Word = 0;
+        memcpy( &Word, &Data[ i ], ( Size - i < sizeof( uint64_t ) ) ? Size - i : sizeof( uint64_t ) );
+
+        Hash^= Word * 0x9E3779B97F4A7C15ULL;
+        Hash = ( ( Hash << 31 ) | ( Hash >> 33 ) ) * 0xC2B2AE3D27D4EB4FULL;
+    }
+
+    return Hash;
+}
+
+/*
+ * Hashes every option that changes the packed frame, and the FreeImage version since that decodes the images.
+ * Options that only change how frames are written, like --compress and --dedup, don't matter.
+ */
+static uint64_t HashOptions( const struct Options* Options ) {
+    const char* Version = FreeImage_GetVersion( );
+    int64_t Values[ ] = {
+        CacheMagic,
+        Options->OutputFormat,
+        Options->DitherFlag,
+        Options->DitherAlgorithm,
+        Options->ThresholdValue,
+        Options->InvertFlag,
+        Options->ResizeWidth,
+        Options->ResizeHeight,
+        Options->ResizeMode,
+        Options->Rotation,
+        Options->MirrorFlag,
+        Options->PanelColumns,
+        Options->PanelRows
+    };
+
+    return HashBytes( HashBytes( 0xCBF29CE484222325ULL, ( const uint8_t* ) Values, sizeof( Values ) ), ( const uint8_t* ) Version, strlen( Version ) );
+}
+
+/*
+ * Writes the name of the entry for (Key) into (Path).
+ * Returns false if it doesn't fit.
+ */
+static bool GetEntryPath( const struct FrameCache* Cache, const struct CacheKey* Key, char* Path, size_t PathSize ) {
+    int Length = snprintf( Path, PathSize, "%s/%016llx%016llx%016llx.frame",
+        Cache->Directory,
+        ( unsigned long long ) Key->Hash[ 0 ],
+        ( unsigned long long ) Key->Hash[ 1 ],
+        ( unsigned long long ) Cache->OptionsHash
+    );
+
+    return ( Length > 0 && ( size_t ) Length < PathSize ) ? true : false;
+}
+
+/*
+ * Sets up (Cache) to keep frames converted with (Options) in (Directory), creating it if it doesn't exist.
+ * (Directory) has to stay valid while the cache is used.
+ * Returns false with errno set if it isn't a directory that can be used.
+ */
+bool Cache_Open( struct FrameCache* Cache, const char* Directory, const struct Options* Options ) {
+    struct stat Info;
+
+    NullCheck( Cache, return false );
+    NullCheck( Directory, return false );
+    NullCheck( Options, return false );
+
+    if ( mkdir( Directory, 0777 ) != 0 && errno != EEXIST ) {
+        return false;
+    }
+
+    if ( stat( Directory, &Info ) != 0 ) {
+        return false;
+    }
+
+    if ( S_ISDIR( Info.st_mode ) == 0 ) {
+        errno = ENOTDIR;
+        return false;
+    }
+
+    Cache->Directory = Directory;
+    Cache->OptionsHash = HashOptions( Options );
+
+    return true;
+}
+
+/*
+ * Hashes the contents of (Filename) into (Key), without decoding it.
+ * Returns false if it can't be read, loading the image reports why.
+ */
+bool Cache_HashFile( const char* Filename, struct CacheKey* Key ) {
+    uint8_t* Chunk = NULL;
+    size_t Size = 0;
+    bool Result = false;
+    FILE* fp = NULL;
+
+    NullCheck( Filename, return false );
+    NullCheck( Key, return false );
+
+    if ( ( fp = fopen( Filename, "rb" ) ) == NULL ) {
+        return false;
+    }
+
+    NullCheck( ( Chunk = ( uint8_t* ) malloc( HashChunkSize ) ), fclose( fp ); return false );
+
+    Key->Hash[ 0 ] = 0xCBF29CE484222325ULL;
+    Key->Hash[ 1 ] = 0x27D4EB2F165667C5ULL;
+    Key->FileSize = 0;
+
+    /* Only the last read of a regular file comes up short */
+    while ( ( Size = fread( Chunk, 1, HashChunkSize, fp ) ) > 0 ) {
+        Key->Hash[ 0 ] = HashBytes( Key->Hash[ 0 ], Chunk, Size );
+        Key->Hash[ 1 ] = HashWords( Key->Hash[ 1 ], Chunk, Size );
+        Key->FileSize+= Size;
+    }
+
+    Result = ( ferror( fp ) == 0 ) ? true : false;
+
+    free( Chunk );
+    fclose( fp );
+
+    return Result;
+}
+
+/*
+ * Looks up the frame converted from the image (Key) came from.
+ * On a hit the packed frame is read into (Buffer), which is grown to fit, and its details into (Entry).
+ * Returns false on a miss, including entries that can't be read or don't match.
+ */
+bool Cache_Load( const struct FrameCache* Cache, const struct CacheKey* Key, struct CacheEntry* Entry, uint8_t** Buffer, size_t* BufferSize ) {
+    struct CacheHeader Header;
+    char Path[ PATH_MAX ];
+    size_t Size = 0;
+    bool Result = false;
+    FILE* fp = NULL;
+
+    NullCheck( Cache, return false );
+    NullCheck( Key, return false );
+    NullCheck( Entry, return false );
+
+    if ( GetEntryPath( Cache, Key, Path, sizeof( Path ) ) == false || ( fp = fopen( Path, "rb" ) ) == NULL ) {
+        return false;
+    }
+
+    if ( fread( &Header, sizeof( struct CacheHeader ), 1, fp ) == 1 &&
+        Header.Magic == CacheMagic &&
+        Header.Hash[ 0 ] == Key->Hash[ 0 ] &&
+        Header.Hash[ 1 ] == Key->Hash[ 1 ] &&
+        Header.FileSize == Key->FileSize &&
+        Header.OptionsHash == Cache->OptionsHash &&
+        Header.Width > 0 && Header.Width % 8 == 0 &&
+        Header.Height > 0 && Header.Height % 8 == 0 ) {
+        Size = ( ( size_t ) Header.Width * Header.Height ) / 8;
+
+        /* Anything after the frame means it isn't an entry this version wrote */
+        if ( Convert_GrowBuffer( Buffer, BufferSize, Size ) == true && fread( *Buffer, 1, Size, fp ) == Size && fgetc( fp ) == EOF ) {
+            Entry->Width = Header.Width;
+            Entry->Height = Header.Height;
+            Entry->HasFrameTime = ( Header.HasFrameTime != 0 ) ? true : false;
+            Entry->FrameTime = Header.FrameTime;
+
+            Result = true;
+        }
+    }
+
+    fclose( fp );
+    return Result;
+}
+
+/*
+ * Adds the packed frame (Data) converted from the image (Key) came from, replacing any entry it had.
+ * Returns false if it couldn't be written, which only means it gets converted again next time.
+ */
+bool Cache_Store( const struct FrameCache* Cache, const struct CacheKey* Key, const struct CacheEntry* Entry, const uint8_t* Data ) {
+    struct CacheHeader Header;
+    char Temporary[ PATH_MAX ];
+    char Path[ PATH_MAX ];
+    size_t Size = 0;
+    bool Result = false;
+    FILE* fp = NULL;
+    int fd = -1;
+
+    NullCheck( Cache, return false );
+    NullCheck( Key, return false );
+    NullCheck( Entry, return false );
+    NullCheck( Data, return false );
+
+    CheckExpr( Entry->Width <= 0 || Entry->Width > UINT16_MAX || Entry->Height <= 0 || Entry->Height > UINT16_MAX, return false );
+
+    if ( GetEntryPath( Cache, Key, Path, sizeof( Path ) ) == false ) {
+        return false;
+    }
+
+    /* Two workers can store the same image at once, each gets a temporary file of its own.
+     * Nothing else running uses this name, so one that is already there was left by a run that crashed.
+     */
+    if ( snprintf( Temporary, sizeof( Temporary ), "%s/.frame.%ld.%lx", Cache->Directory, ( long ) getpid( ), ( unsigned long ) pthread_self( ) ) >= ( int ) sizeof( Temporary ) ) {
+        return false;
+    }
+
+    if ( ( fd = open( Temporary, O_WRONLY | O_CREAT | O_TRUNC, 0666 ) ) < 0 ) {
+        return false;
+    }
+
+    if ( ( fp = fdopen( fd, "wb" ) ) == NULL ) {
+        close( fd );
+        unlink( Temporary );
+
+        return false;
+    }
+
+    memset( &Header, 0, sizeof( struct CacheHeader ) );
+
+    Header.Magic = CacheMagic;
+    Header.Width = ( uint16_t ) Entry->Width;
+    Header.Height = ( uint16_t ) Entry->Height;
+    Header.Hash[ 0 ] = Key->Hash[ 0 ];
+    Header.Hash[ 1 ] = Key->Hash[ 1 ];
+    Header.FileSize = Key->FileSize;
+    Header.OptionsHash = Cache->OptionsHash;
+    Header.FrameTime = ( Entry->HasFrameTime == true ) ? Entry->FrameTime : 0;
+    Header.HasFrameTime = ( Entry->HasFrameTime == true ) ? 1 : 0;
+
+    Size = ( ( size_t ) Entry->Width * Entry->Height ) / 8;
+
+    Result = ( fwrite( &Header, sizeof( struct CacheHeader ), 1, fp ) == 1 && fwrite( Data, 1, Size, fp ) == Size ) ? true : false;
+    Result = ( fclose( fp ) == 0 && Result == true ) ? true : false;
+
+    if ( Result == false || rename( Temporary, Path ) != 0 ) {
+        unlink( Temporary );
+        return false;
+    }
+
+    return true;
+}
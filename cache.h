@@ -0,0 +1,43 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*
+ * Which input image a cache entry was converted from: two independent hashes
+ * of everything in the file, and its size.
+ */
+struct CacheKey {
+    uint64_t Hash[ 2 ];
+    uint64_t FileSize;
+};
+
+/*
+ * What is kept for an image besides its packed frame.
+ */
+struct CacheEntry {
+    /* Frame size before --rotate, the packed frame is Width * Height / 8 bytes */
+    int Width;
+    int Height;
+
+    /* Frame time stored with the input image, if it has one */
+    bool HasFrameTime;
+    uint32_t FrameTime;
+};
+
+/*
+ * Packed frames from earlier runs, see --cache.
+ * Entries are files in (Directory) named after the image and the options it was converted with,
+ * so entries for other options sit next to each other and nothing is ever invalidated in place.
+ */
+struct FrameCache {
+    const char* Directory;
+
+    /* Hash of every option that changes how an image is packed */
+    uint64_t OptionsHash;
+};
+
+bool Cache_Open( struct FrameCache* Cache, const char* Directory, const struct Options* Options );
+bool Cache_HashFile( const char* Filename, struct CacheKey* Key );
+bool Cache_Load( const struct FrameCache* Cache, const struct CacheKey* Key, struct CacheEntry* Entry, uint8_t** Buffer, size_t* BufferSize );
+bool Cache_Store( const struct FrameCache* Cache, const struct CacheKey* Key, const struct CacheEntry* Entry, const uint8_t* Data );
+
+#endif
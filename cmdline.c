@@ -13,13 +13,19 @@
 #include <FreeImage.h>
 #include <argp.h>
 #include <errno.h>
+#include <unistd.h>
 #include "cmdline.h"
 #include "output.h"
-
-#define DEFAULT_IMAGE_DELAY 100
+#include "options.h"
+#include "stream.h"
+#include "dither.h"
 
 static FREE_IMAGE_DITHER ParseDither( const char* DitherText );
 static int ParseOutputFormat( const char* FormatString );
+static int ParseRawFormat( const char* FormatString, int* Width, int* Height );
+static int ParseResizeMode( const char* ModeString );
+static int ParseRotation( const char* DegreesString );
+static bool CheckPanelSize( void );
 static error_t ParseArgs( int Key, char* Arg, struct argp_state* State );
 
 static FREE_IMAGE_DITHER DitherAlgorithm = FID_FS;
@@ -30,15 +36,87 @@ static char* OutputFilename = NULL;
 static int ThresholdValue = 128;
 static bool DitherFlag = false;
 static bool InvertFlag = false;
+static bool SelfCheckFlag = false;
+static int JobCount = 1;
+static bool CompressFlag = false;
+static int RawFormat = RawFormat_None;
+static int RawWidth = 0;
+static int RawHeight = 0;
+static bool StatsFlag = false;
+static char* StatsFilename = NULL;
+static bool BatchFlag = false;
+static char* BatchFilename = NULL;
+static bool TemporalFlag = false;
+static bool DedupFlag = false;
+static char* TimingFilename = NULL;
+static int Hysteresis = DEFAULT_HYSTERESIS;
+static int ResizeWidth = 0;
+static int ResizeHeight = 0;
+static int ResizeMode = Resize_Letterbox;
+static int Rotation = Rotate_None;
+static bool MirrorFlag = false;
+static char* CacheDirectory = NULL;
+static int PanelColumns = 1;
+static int PanelRows = 1;
+static bool InterleaveFlag = false;
+
+/* Set while parsing a line of a batch manifest, see CmdLine_ParseJob */
+static bool JobMode = false;
+static bool ParseFailed = false;
+
+#define ParseError( State, ... ) { \
+    ParseFailed = true; \
+    argp_error( State, __VA_ARGS__ ); \
+}
+
+#define RejectInJob( State, Name ) { \
+    if ( JobMode == true ) { \
+        ParseError( State, "%s can not be used in a batch job", Name ); \
+        break; \
+    } \
+}
+
+/* Keys for options that only have a long name */
+enum {
+    Key_SelfCheck = 0x100,
+    Key_Stats,
+    Key_Batch,
+    Key_Temporal,
+    Key_Dedup,
+    Key_Timing,
+    Key_Size,
+    Key_Resize,
+    Key_Rotate,
+    Key_Mirror,
+    Key_Cache,
+    Key_Panels,
+    Key_Interleave
+};
 
 static struct argp_option Options[ ] = {
     { "dither", 'd', "algorithm", OPTION_ARG_OPTIONAL, "Dither output", 0 },
     { "threshold", 't', "value", 0, "Threshold for non dithered output [0-255]", 0 },
+    { "temporal", Key_Temporal, "hysteresis", OPTION_ARG_OPTIONAL, "Reduce flicker by keeping pixels from the previous frame until their grey level changes by more than the hysteresis [0-255]", 0 },
     { "invert", 'i', NULL, 0, "Invert output", 0 },
-    { "delay", 'l', "delay", 0, "Delay between frames in milliseconds", 0 },
+    { "delay", 'l', "delay", 0, "Delay between frames in milliseconds, for frames that don't have their own", 0 },
+    { "timing", Key_Timing, "file", 0, "Read the delay of each frame in milliseconds from the file, one per line", 0 },
     { "noheader", 'n', NULL, 0, "Do not write header, only write raw frames", 0 },
     { "output", 'o', "output", 0, "Output file name", 0 },
     { "format", 'f', "format", 0, "Image output format", 0 },
+    { "compress", 'c', NULL, 0, "Compress ANM frames with RLE or a delta against the previous frame, whichever is smaller", 0 },
+    { "dedup", Key_Dedup, NULL, 0, "Store repeated frames in ANM output only once, and add a table of which frame to show when (ANM1). GIF output shows repeated frames for longer instead", 0 },
+    { "size", Key_Size, "WxH", 0, "Scale every frame to this size, which must be divisible by 8", 0 },
+    { "resize", Key_Resize, "policy", 0, "How --size scales frames with a different aspect ratio: fit, fill or letterbox (default)", 0 },
+    { "rotate", Key_Rotate, "degrees", 0, "Turn frames clockwise by 90, 180 or 270 degrees, for panels mounted on their side or upside down", 0 },
+    { "mirror", Key_Mirror, NULL, 0, "Mirror frames left to right, after turning them", 0 },
+    { "panels", Key_Panels, "CxR", 0, "Split frames into a grid of panels, C across and R down, and write a file for each panel", 0 },
+    { "interleave", Key_Interleave, NULL, 0, "Write every panel of a frame in turn to the one RAW output file instead", 0 },
+    { "raw", 'r', "format:WxH", 0, "Read raw frames of the given size from the input files, or stdin if there are none", 0 },
+    { "jobs", 'j', "count", 0, "Number of threads used to load and convert images, 0 for one per CPU", 0 },
+    { "cache", Key_Cache, "dir", 0, "Keep packed frames in the directory, and reuse them for input images that haven't changed", 0 },
+    { "selfcheck", Key_SelfCheck, NULL, 0, "Verify packed output against the per-pixel reference conversion", 0 },
+    { "stats", Key_Stats, "file", OPTION_ARG_OPTIONAL, "Print how long each conversion stage took, and write them to a JSON file if one is given", 0 },
+    { "batch", Key_Batch, "manifest", OPTION_ARG_OPTIONAL, "Run one conversion per line of the manifest, or of stdin if none is given", 0 },
     { NULL, 0, NULL, 0, NULL, 0 }
 };
 
@@ -46,18 +124,65 @@ const char* argp_program_version = "0.0.1";
 static char Documentation[ ] = "anim1b: Image to SSD1306 converter" \
     "\v" \
     "Supported dithering algorithms: \n" \
-    "  fs       Floyd-Steinberg\n" \
-    "  b4x4     Bayer 4x4\n" \
-    "  b8x8     Bayer 8x8\n" \
-    "  b16x16   Bayer 16x16\n" \
-    "  c6x6     Cluster 6x6\n" \
-    "  c8x8     Cluster 8x8\n" \
-    "  c16x16   Cluster 16x16\n" \
+    "  fs          Floyd-Steinberg\n" \
+    "  b4x4        Bayer 4x4\n" \
+    "  b8x8        Bayer 8x8\n" \
+    "  b16x16      Bayer 16x16\n" \
+    "  c6x6        Cluster 6x6\n" \
+    "  c8x8        Cluster 8x8\n" \
+    "  c16x16      Cluster 16x16\n" \
+    "  atkinson    Atkinson\n" \
+    "  sierra      Sierra\n" \
+    "  sierralite  Sierra Lite\n" \
+    "  jjn         Jarvis, Judice and Ninke\n" \
+    "  stucki      Stucki\n" \
     "\v" \
     "Supported output formats: \n" \
     "  1306_horizontal  SSD1306 Horizontal address mode\n" \
     "  1306_vertical    SSD1306 Vertical address mode\n" \
-    "  linear           Flat, linear 1BPP image data\n\n" \
+    "  linear           Flat, linear 1BPP image data\n" \
+    "  1306_dirty       SSD1306 Horizontal address mode, changed rectangles only\n" \
+    "\v" \
+    "Supported raw input formats: \n" \
+    "  gray8    8 bits per pixel greyscale\n" \
+    "  rgb24    24 bits per pixel, R G B byte order\n" \
+    "Example: ffmpeg -i video.mp4 -s 128x64 -f rawvideo -pix_fmt gray - | anim1b --raw=gray8:128x64 -o video.anm\n" \
+    "\v" \
+    "Scaling policies for --size: \n" \
+    "  fit        Stretch to the size given\n" \
+    "  fill       Keep the aspect ratio and cover the whole size, cropping what sticks out\n" \
+    "  letterbox  Keep the aspect ratio and fit inside the size, with black bars\n" \
+    "  Inputs of any size can be scaled, without --size they must be divisible by 8 and\n" \
+    "  match the first input.\n" \
+    "  --size is the size of frames before --rotate turns them, a 128x64 panel\n" \
+    "  mounted on its side takes --size=64x128 --rotate=90.\n" \
+    "\v" \
+    "Panel walls: \n" \
+    "  --panels splits every frame, after --rotate, into a grid of panels with sides divisible\n" \
+    "  by 8. Each panel is packed as a frame of its own and goes to a file named after the\n" \
+    "  output: -o sign.anm --panels=4x2 writes sign.0.anm to sign.7.anm, numbered along each\n" \
+    "  row from the top left. Every file is compressed, deduplicated and tracked for dirty\n" \
+    "  rectangles on its own. With --interleave a RAW file holds the panels of each frame\n" \
+    "  one after the other instead.\n" \
+    "\v" \
+    "Frame timing: \n" \
+    "  Each frame is shown for the delay on its line of the --timing file, otherwise for the\n" \
+    "  delay stored with the input image (GIF frames), otherwise for --delay.\n" \
+    "  Blank lines and lines starting with # in the timing file are skipped.\n" \
+    "  ANM output where the delays differ gets a frame table (ANM1).\n" \
+    "\v" \
+    "Frame cache: \n" \
+    "  With --cache every image is looked up by a hash of its contents and of the options that\n" \
+    "  change how it is packed, so rebuilding an animation only converts the images that changed.\n" \
+    "  Pages of animated GIFs and multi-page files are always converted, and so is everything\n" \
+    "  with --selfcheck. Entries are never removed, delete the directory to start over.\n" \
+    "\v" \
+    "Batch manifests: \n" \
+    "  One conversion per line, with the same options as the command line:\n" \
+    "    -o logo.anm -f 1306_vertical --dither=b8x8 logo.png\n" \
+    "  Blank lines and lines starting with # are skipped. --raw, --jobs and --stats\n" \
+    "  can't be used per line, --jobs next to --batch sets how many lines run at once.\n" \
+    "  Existing output files are replaced.\n\n" \
 ;
 
 static char ArgsDocumentation[ ] = "[input images]";
@@ -98,6 +223,16 @@ static FREE_IMAGE_DITHER ParseDither( const char* DitherText ) {
             Result = FID_CLUSTER8x8;
         else if ( strcasecmp( DitherText, "c16x16" ) == 0 )
             Result = FID_CLUSTER16x16;
+        else if ( strcasecmp( DitherText, "atkinson" ) == 0 )
+            Result = ( FREE_IMAGE_DITHER ) Dither_Atkinson;
+        else if ( strcasecmp( DitherText, "sierra" ) == 0 )
+            Result = ( FREE_IMAGE_DITHER ) Dither_Sierra;
+        else if ( strcasecmp( DitherText, "sierralite" ) == 0 )
+            Result = ( FREE_IMAGE_DITHER ) Dither_SierraLite;
+        else if ( strcasecmp( DitherText, "jjn" ) == 0 )
+            Result = ( FREE_IMAGE_DITHER ) Dither_JarvisJudiceNinke;
+        else if ( strcasecmp( DitherText, "stucki" ) == 0 )
+            Result = ( FREE_IMAGE_DITHER ) Dither_Stucki;
         else
             Result = -1;
     }
@@ -118,6 +253,8 @@ static int ParseOutputFormat( const char* FormatString ) {
         Result = Format_1306_Vertical;
     } else if ( strcasecmp( FormatString, "linear" ) == 0 ) {
         Result = Format_Linear;
+    } else if ( strcasecmp( FormatString, "1306_dirty" ) == 0 ) {
+        Result = Format_1306_Dirty;
     } else {
         Result = -1;
     }
@@ -125,6 +262,83 @@ static int ParseOutputFormat( const char* FormatString ) {
     return Result;
 }
 
+/*
+ * Returns a RawFormat_* value from a string like "gray8:128x64" and fills in (Width) and (Height).
+ * Returns -1 if it's not valid.
+ */
+static int ParseRawFormat( const char* FormatString, int* Width, int* Height ) {
+    const char* Size = NULL;
+    size_t Length = 0;
+    int Result = -1;
+
+    if ( ( Size = strchr( FormatString, ':' ) ) == NULL ) {
+        return -1;
+    }
+
+    Length = Size - FormatString;
+
+    if ( Length == strlen( "gray8" ) && strncasecmp( FormatString, "gray8", Length ) == 0 ) {
+        Result = RawFormat_Gray8;
+    } else if ( Length == strlen( "rgb24" ) && strncasecmp( FormatString, "rgb24", Length ) == 0 ) {
+        Result = RawFormat_RGB24;
+    } else {
+        return -1;
+    }
+
+    if ( sscanf( Size + 1, "%dx%d", Width, Height ) != 2 || *Width <= 0 || *Height <= 0 ) {
+        return -1;
+    }
+
+    return Result;
+}
+
+/*
+ * Returns a Resize_* value from the given string.
+ * Returns -1 if it's not valid.
+ */
+static int ParseResizeMode( const char* ModeString ) {
+    if ( strcasecmp( ModeString, "fit" ) == 0 ) {
+        return Resize_Fit;
+    } else if ( strcasecmp( ModeString, "fill" ) == 0 ) {
+        return Resize_Fill;
+    } else if ( strcasecmp( ModeString, "letterbox" ) == 0 ) {
+        return Resize_Letterbox;
+    }
+
+    return -1;
+}
+
+/*
+ * Returns the Rotate_* value for a clockwise turn of (DegreesString), or -1 if it isn't one.
+ */
+static int ParseRotation( const char* DegreesString ) {
+    switch ( ( int ) strtol( DegreesString, NULL, 10 ) ) {
+        case 0: return Rotate_None;
+        case 90: return Rotate_90;
+        case 180: return Rotate_180;
+        case 270: return Rotate_270;
+        default: break;
+    };
+
+    return -1;
+}
+
+/*
+ * Returns true if frames scaled to --size split evenly into the --panels grid once they are turned.
+ */
+static bool CheckPanelSize( void ) {
+    struct Options Options;
+    int Width = 0;
+    int Height = 0;
+    int PanelWidth = 0;
+    int PanelHeight = 0;
+
+    CmdLine_GetOptions( &Options );
+    Options_GetOutputSize( &Options, ResizeWidth, ResizeHeight, &Width, &Height );
+
+    return Options_GetPanelSize( &Options, Width, Height, &PanelWidth, &PanelHeight );
+}
+
 char* AddInputFile( const char* Filename ) {
     char* Result = NULL;
     int Len = 0;
@@ -153,7 +367,7 @@ static error_t ParseArgs( int Key, char* Arg, struct argp_state* State ) {
             DitherFlag = true;
 
             if ( DitherAlgorithm == -1 )
-                argp_error( State, "Unknown dithering algorithm: \"%s\"\n", Arg == NULL ? "" : Arg );
+                ParseError( State, "Unknown dithering algorithm: \"%s\"\n", Arg == NULL ? "" : Arg );
 
             break;
         }
@@ -162,11 +376,11 @@ static error_t ParseArgs( int Key, char* Arg, struct argp_state* State ) {
                 ThresholdValue = ( int ) strtol( Arg, NULL, 10 );
 
                 if ( errno == EINVAL || errno == ERANGE ) {
-                    argp_error( State, "Invalid threshold value: %s", Arg );
+                    ParseError( State, "Invalid threshold value: %s", Arg );
                 }
 
                 if ( ThresholdValue < 0 || ThresholdValue > 255 ) {
-                    argp_error( State, "Threshold out of range, expected 0-255 got %d", ThresholdValue );                
+                    ParseError( State, "Threshold out of range, expected 0-255 got %d", ThresholdValue );                
                 }
 
                 DitherFlag = false;
@@ -187,7 +401,7 @@ static error_t ParseArgs( int Key, char* Arg, struct argp_state* State ) {
                 Delay = ( int ) strtol( Arg, NULL, 10 );
 
                 if ( errno == EINVAL || errno == ERANGE ) {
-                    argp_error( State, "Invalid delay value: %s", Arg );
+                    ParseError( State, "Invalid delay value: %s", Arg );
                 }
             }
 
@@ -202,25 +416,190 @@ static error_t ParseArgs( int Key, char* Arg, struct argp_state* State ) {
                 OutputFormat = ParseOutputFormat( Arg );
 
                 if ( OutputFormat == -1 ) {
-                    argp_error( State, "Unknown output format: %s", Arg );
+                    ParseError( State, "Unknown output format: %s", Arg );
+                }
+            }
+
+            break;
+        }
+        case 'c': {
+            CompressFlag = true;
+            break;
+        }
+        case 'r': {
+            RejectInJob( State, "--raw" );
+
+            if ( Arg != NULL ) {
+                RawFormat = ParseRawFormat( Arg, &RawWidth, &RawHeight );
+
+                if ( RawFormat == -1 ) {
+                    ParseError( State, "Invalid raw input format: %s", Arg );
+                }
+            }
+
+            break;
+        }
+        case Key_Size: {
+            if ( sscanf( Arg, "%dx%d", &ResizeWidth, &ResizeHeight ) != 2 || ResizeWidth <= 0 || ResizeHeight <= 0 || ResizeWidth > 0xFFFF || ResizeHeight > 0xFFFF ) {
+                ParseError( State, "Invalid size: %s", Arg );
+            }
+
+            if ( ResizeWidth % 8 != 0 || ResizeHeight % 8 != 0 ) {
+                ParseError( State, "Width and height given to --size must be divisible by 8" );
+            }
+
+            break;
+        }
+        case Key_Resize: {
+            if ( ( ResizeMode = ParseResizeMode( Arg ) ) == -1 ) {
+                ParseError( State, "Unknown scaling policy: %s", Arg );
+            }
+
+            break;
+        }
+        case Key_Rotate: {
+            if ( ( Rotation = ParseRotation( Arg ) ) == -1 ) {
+                ParseError( State, "Frames can only be rotated by 0, 90, 180 or 270 degrees: %s", Arg );
+            }
+
+            break;
+        }
+        case Key_Mirror: {
+            MirrorFlag = true;
+            break;
+        }
+        case 'j': {
+            RejectInJob( State, "--jobs" );
+
+            if ( Arg != NULL ) {
+                JobCount = ( int ) strtol( Arg, NULL, 10 );
+
+                if ( errno == EINVAL || errno == ERANGE || JobCount < 0 ) {
+                    ParseError( State, "Invalid job count: %s", Arg );
+                }
+
+                if ( JobCount == 0 ) {
+                    JobCount = ( int ) sysconf( _SC_NPROCESSORS_ONLN );
+                    JobCount = ( JobCount < 1 ) ? 1 : JobCount;
                 }
             }
 
             break;
         }
+        case Key_SelfCheck: {
+            SelfCheckFlag = true;
+            break;
+        }
+        case Key_Stats: {
+            RejectInJob( State, "--stats" );
+
+            StatsFlag = true;
+            StatsFilename = Arg;
+            break;
+        }
+        case Key_Temporal: {
+            TemporalFlag = true;
+
+            if ( Arg != NULL ) {
+                Hysteresis = ( int ) strtol( Arg, NULL, 10 );
+
+                if ( errno == EINVAL || errno == ERANGE ) {
+                    ParseError( State, "Invalid hysteresis value: %s", Arg );
+                }
+
+                if ( Hysteresis < 0 || Hysteresis > 255 ) {
+                    ParseError( State, "Hysteresis out of range, expected 0-255 got %d", Hysteresis );
+                }
+            }
+
+            break;
+        }
+        case Key_Dedup: {
+            DedupFlag = true;
+            break;
+        }
+        case Key_Timing: {
+            TimingFilename = Arg;
+            break;
+        }
+        case Key_Cache: {
+            CacheDirectory = Arg;
+            break;
+        }
+        case Key_Panels: {
+            if ( sscanf( Arg, "%dx%d", &PanelColumns, &PanelRows ) != 2 || PanelColumns <= 0 || PanelRows <= 0 || PanelColumns > 0xFF || PanelRows > 0xFF ) {
+                ParseError( State, "Invalid panel grid: %s", Arg );
+            }
+
+            break;
+        }
+        case Key_Interleave: {
+            InterleaveFlag = true;
+            break;
+        }
+        case Key_Batch: {
+            RejectInJob( State, "--batch" );
+
+            BatchFlag = true;
+            BatchFilename = Arg;
+            break;
+        }
         case ARGP_KEY_ARG: {
             /* Add another input file to the list */
             AddInputFile( Arg );
             break;
         }
         case ARGP_KEY_END: {
+            /* Every line of the manifest has its own inputs and output */
+            if ( BatchFlag == true ) {
+                if ( State->arg_num > 0 || OutputFilename != NULL || RawFormat != RawFormat_None ) {
+                    ParseError( State, "--batch takes its inputs and outputs from the manifest" );
+                }
+
+                break;
+            }
+
             /* Make sure an output file name was passed in as an argument */
             if ( OutputFilename == NULL ) {
-                argp_error( State, "You must specify --output=filename" );
+                ParseError( State, "You must specify --output=filename" );
+            }
+
+            /* The frame table lives in the ANM header and at the end of the file */
+            if ( DedupFlag == true && Options_GetContainer( OutputFilename ) != Container_GIF && ( Options_GetContainer( OutputFilename ) != Container_ANM || ShouldWriteHeader == false ) ) {
+                ParseError( State, "--dedup needs .gif output, or .anm output with a header" );
+            }
+
+            /* Panels are cut out of packed frames, which GIF output doesn't have */
+            if ( PanelColumns * PanelRows > 1 && Options_GetContainer( OutputFilename ) == Container_GIF ) {
+                ParseError( State, "--panels needs RAW or ANM output" );
+            }
+
+            /* Dirty rectangles and the ANM header describe a single display */
+            if ( InterleaveFlag == true && ( Options_GetContainer( OutputFilename ) != Container_Raw || OutputFormat == Format_1306_Dirty ) ) {
+                ParseError( State, "--interleave needs RAW output in a format other than 1306_dirty" );
+            }
+
+            if ( ResizeWidth > 0 && CheckPanelSize( ) == false ) {
+                ParseError( State, "Frames of --size %dx%d can't be split into %dx%d panels with sides divisible by 8", ResizeWidth, ResizeHeight, PanelColumns, PanelRows );
+            }
+
+            /* Cached frames are packed frames of one image each */
+            if ( CacheDirectory != NULL && ( RawFormat != RawFormat_None || Options_GetContainer( OutputFilename ) == Container_GIF ) ) {
+                ParseError( State, "--cache needs input images, and RAW or ANM output" );
+            }
+
+            if ( CacheDirectory != NULL && TemporalFlag == true ) {
+                ParseError( State, "--cache can't be used with --temporal, which makes every frame depend on the ones before it" );
             }
 
-            if ( State->arg_num < 1 ) {
-                argp_error( State, "Not enough arguments" );
+            /* Raw frames of any other size have to be scaled */
+            if ( RawFormat != RawFormat_None && ResizeWidth == 0 && ( RawWidth % 8 != 0 || RawHeight % 8 != 0 ) ) {
+                ParseError( State, "Raw input width and height must be divisible by 8, or scaled with --size" );
+            }
+
+            /* Raw input can come from stdin */
+            if ( State->arg_num < 1 && RawFormat == RawFormat_None ) {
+                ParseError( State, "Not enough arguments" );
                 argp_usage( State );
             }
 
@@ -272,6 +651,111 @@ bool CmdLine_GetWriteHeaderFlag( void ) {
     return ShouldWriteHeader;
 }
 
+bool CmdLine_GetSelfCheckFlag( void ) {
+    return SelfCheckFlag;
+}
+
+int CmdLine_GetJobCount( void ) {
+    return JobCount;
+}
+
+bool CmdLine_GetCompressFlag( void ) {
+    return CompressFlag;
+}
+
+bool CmdLine_GetStatsFlag( void ) {
+    return StatsFlag;
+}
+
+const char* CmdLine_GetStatsFilename( void ) {
+    return StatsFilename;
+}
+
+/*
+ * Returns the --timing file, NULL if there isn't one.
+ */
+const char* CmdLine_GetTimingFilename( void ) {
+    return TimingFilename;
+}
+
+/*
+ * Returns the --cache directory, NULL if there isn't one.
+ */
+const char* CmdLine_GetCacheDirectory( void ) {
+    return CacheDirectory;
+}
+
+/*
+ * Fills (Options) with the conversion and output settings given on the command line.
+ */
+void CmdLine_GetOptions( struct Options* Options ) {
+    Options_SetDefaults( Options );
+
+    Options->OutputFormat = OutputFormat;
+    Options->Container = Options_GetContainer( OutputFilename );
+    Options->DitherFlag = DitherFlag;
+    Options->DitherAlgorithm = DitherAlgorithm;
+    Options->ThresholdValue = ThresholdValue;
+    Options->TemporalFlag = TemporalFlag;
+    Options->Hysteresis = Hysteresis;
+    Options->InvertFlag = InvertFlag;
+    Options->SelfCheckFlag = SelfCheckFlag;
+    Options->ResizeWidth = ResizeWidth;
+    Options->ResizeHeight = ResizeHeight;
+    Options->ResizeMode = ResizeMode;
+    Options->Rotation = Rotation;
+    Options->MirrorFlag = MirrorFlag;
+    Options->PanelColumns = PanelColumns;
+    Options->PanelRows = PanelRows;
+    Options->InterleaveFlag = InterleaveFlag;
+    Options->CompressFlag = CompressFlag;
+    Options->WriteHeader = ShouldWriteHeader;
+    Options->DedupFlag = DedupFlag;
+    Options->Delay = Delay;
+}
+
+/*
+ * Returns true if raw input frames are read from stdin.
+ */
+bool CmdLine_ReadsStdin( void ) {
+    int i = 0;
+
+    if ( RawFormat == RawFormat_None ) {
+        return false;
+    }
+
+    for ( i = 0; i < FilenameCount; i++ ) {
+        if ( strcmp( Filenames[ i ], "-" ) == 0 ) {
+            return true;
+        }
+    }
+
+    return ( FilenameCount == 0 ) ? true : false;
+}
+
+bool CmdLine_GetBatchFlag( void ) {
+    return BatchFlag;
+}
+
+/*
+ * Returns the batch manifest to read, NULL for stdin.
+ */
+const char* CmdLine_GetBatchFilename( void ) {
+    return BatchFilename;
+}
+
+int CmdLine_GetRawFormat( void ) {
+    return RawFormat;
+}
+
+int CmdLine_GetRawWidth( void ) {
+    return RawWidth;
+}
+
+int CmdLine_GetRawHeight( void ) {
+    return RawHeight;
+}
+
 int CmdLine_Handler( int Argc, char** Argv ) {
     Filenames = ( char** ) malloc( sizeof( char* ) * Argc );
 
@@ -283,6 +767,76 @@ int CmdLine_Handler( int Argc, char** Argv ) {
     return 1;
 }
 
+/*
+ * Parses one line of a batch manifest, already split into (Argv) with the
+ * manifest name and line number in Argv[ 0 ] for error messages.
+ * Unlike CmdLine_Handler this never exits, it returns non-zero if the line is invalid.
+ * Call CmdLine_Free once the options have been read.
+ */
+int CmdLine_ParseJob( int Argc, char** Argv ) {
+    int Result = 1;
+
+    Filenames = ( char** ) malloc( sizeof( char* ) * Argc );
+
+    if ( Filenames ) {
+        memset( Filenames, 0, sizeof( char* ) * Argc );
+
+        JobMode = true;
+        ParseFailed = false;
+
+        Result = argp_parse( &P, Argc, Argv, ARGP_IN_ORDER | ARGP_NO_EXIT | ARGP_NO_HELP, 0, NULL );
+
+        if ( ParseFailed == true ) {
+            Result = 1;
+        }
+
+        JobMode = false;
+    }
+
+    return Result;
+}
+
+/*
+ * Puts every option back to its default.
+ */
+static void SetDefaults( void ) {
+    DitherAlgorithm = FID_FS;
+    OutputFormat = Format_1306_Horizontal;
+    Delay = DEFAULT_IMAGE_DELAY;
+    ShouldWriteHeader = true;
+    OutputFilename = NULL;
+    ThresholdValue = 128;
+    DitherFlag = false;
+    InvertFlag = false;
+    SelfCheckFlag = false;
+    JobCount = 1;
+    CompressFlag = false;
+    RawFormat = RawFormat_None;
+    RawWidth = 0;
+    RawHeight = 0;
+    StatsFlag = false;
+    StatsFilename = NULL;
+    BatchFlag = false;
+    BatchFilename = NULL;
+    TemporalFlag = false;
+    Hysteresis = DEFAULT_HYSTERESIS;
+    DedupFlag = false;
+    TimingFilename = NULL;
+    ResizeWidth = 0;
+    ResizeHeight = 0;
+    Rotation = Rotate_None;
+    MirrorFlag = false;
+    CacheDirectory = NULL;
+    PanelColumns = 1;
+    PanelRows = 1;
+    InterleaveFlag = false;
+    ResizeMode = Resize_Letterbox;
+}
+
+/*
+ * Frees the input file list and resets all options,
+ * after which CmdLine_Handler can be called again.
+ */
 void CmdLine_Free( void ) {
     int i = 0;
 
@@ -298,4 +852,6 @@ void CmdLine_Free( void ) {
 
     FilenameCount = 0;
     Filenames = NULL;
+
+    SetDefaults( );
 }
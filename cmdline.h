@@ -1,6 +1,8 @@
 #ifndef _CMDLINE_H_
 #define _CMDLINE_H_
 
+struct Options;
+
 int CmdLine_GetOutputFormat( void );
 FREE_IMAGE_DITHER CmdLine_GetDitherAlgorithm( void );
 bool CmdLine_DitherEnabled( void );
@@ -11,7 +13,22 @@ int CmdLine_GetInputCount( void );
 bool CmdLine_GetInvertFlag( void );
 uint32_t CmdLine_GetOutputDelay( void );
 bool CmdLine_GetWriteHeaderFlag( void ); 
+bool CmdLine_GetSelfCheckFlag( void );
+int CmdLine_GetJobCount( void );
+bool CmdLine_GetCompressFlag( void );
+bool CmdLine_GetStatsFlag( void );
+const char* CmdLine_GetStatsFilename( void );
+const char* CmdLine_GetTimingFilename( void );
+const char* CmdLine_GetCacheDirectory( void );
+bool CmdLine_GetBatchFlag( void );
+const char* CmdLine_GetBatchFilename( void );
+bool CmdLine_ReadsStdin( void );
+void CmdLine_GetOptions( struct Options* Options );
+int CmdLine_GetRawFormat( void );
+int CmdLine_GetRawWidth( void );
+int CmdLine_GetRawHeight( void );
 int CmdLine_Handler( int Argc, char** Argv );
+int CmdLine_ParseJob( int Argc, char** Argv );
 void CmdLine_Free( void );
 
 #endif
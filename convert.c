@@ -0,0 +1,883 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <FreeImage.h>
+#include "options.h"
+#include "output.h"
+#include "pack.h"
+#include "dither.h"
+#include "resize.h"
+#include "stats.h"
+#include "convert.h"
+
+/* The greyscale kernel takes FreeImage's BGR(A) byte order, which is what it uses on little endian machines */
+#if defined( __SSE2__ ) && FI_RGBA_RED == 2 && FI_RGBA_GREEN == 1 && FI_RGBA_BLUE == 0
+#define CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define BIT( n ) ( 1 << n )
+
+/*
+ * Checks to see if the input image is already in the correct (1BPP) format
+ * and if it isn't we perform the conversion ourselves.
+ * (Invert) is false if the colours have already been inverted.
+ */
+FIBITMAP* GetProcessedOutput( const struct Options* Options, FIBITMAP* Input, bool Invert ) {
+    FREE_IMAGE_DITHER Algo = FID_FS;
+    FIBITMAP* Output = NULL;
+    int ColorThreshold = 0;
+    uint64_t Start = 0;
+
+    NullCheck( Input, return NULL );
+
+    /* If requested, invert the colours on the input image data */
+    if ( Invert == true ) {
+        Start = Stats_Start( );
+            FreeImage_Invert( Input );
+        Stats_Stop( Stage_Invert, Start );
+    }
+
+    Start = Stats_Start( );
+
+    if ( FreeImage_GetBPP( Input ) == 1 ) {
+        /* Input is already 1bpp, no changes needed */
+        Output = FreeImage_Clone( Input );
+    } else {
+        /* Convert input to 1BPP based on the user's command
+         * line selection or the defaults.
+         */
+        if ( Options->DitherFlag == true ) {
+            /* Convert_Frame never gets here with native kernels, anything else that does gets the closest one FreeImage has */
+            Algo = ( Dither_HasReference( true, Options->DitherAlgorithm ) == true ) ? Options->DitherAlgorithm : FID_FS;
+            Output = FreeImage_Dither( Input, Algo );
+        } else {
+            ColorThreshold = Options->ThresholdValue;
+            Output = FreeImage_Threshold( Input, ColorThreshold );
+        }
+    }
+
+    Stats_Stop( Stage_Convert, Start );
+    return Output;
+}
+
+/*
+ * FreeImage's Floyd-Steinberg can't carry anything over from the previous frame,
+ * so temporal dithering uses the native one instead.
+ */
+static FREE_IMAGE_DITHER GetDitherAlgorithm( const struct Options* Options ) {
+    if ( Options->TemporalFlag == true && Options->DitherAlgorithm == FID_FS ) {
+        return ( FREE_IMAGE_DITHER ) Dither_FloydSteinberg;
+    }
+
+    return Options->DitherAlgorithm;
+}
+
+/*
+ * Returns true if (Input) can be converted by the threshold/ordered dither engine
+ * in dither.c instead of FreeImage_Threshold/FreeImage_Dither.
+ */
+static bool CanConvertNatively( const struct Options* Options, FIBITMAP* Input ) {
+    if ( FreeImage_GetImageType( Input ) != FIT_BITMAP || FreeImage_GetBPP( Input ) == 1 ) {
+        return false;
+    }
+
+    return Dither_IsNative( Options->DitherFlag, GetDitherAlgorithm( Options ) );
+}
+
+/*
+ * Returns true if (Input) isn't something the native engine reads, like a 16 bit or floating point
+ * image, but the dither algorithm only exists there. Those are reduced to 8bpp greyscale first
+ * rather than quietly getting a different algorithm from FreeImage.
+ */
+static bool NeedsNativeInput( const struct Options* Options, FIBITMAP* Input ) {
+    if ( FreeImage_GetImageType( Input ) == FIT_BITMAP ) {
+        return false;
+    }
+
+    return ( Dither_HasReference( Options->DitherFlag, GetDitherAlgorithm( Options ) ) == true ) ? false : true;
+}
+
+/*
+ * FreeImage's Rec. 709 luma weights, multiplied out for every channel value.
+ * Summing these in the same order as FreeImage's GREY( ) macro gives the same result
+ * without the compiler being able to fuse the multiplies into the adds.
+ */
+static float LumaRed[ 256 ];
+static float LumaGreen[ 256 ];
+static float LumaBlue[ 256 ];
+static pthread_once_t LumaOnce = PTHREAD_ONCE_INIT;
+
+static void InitLumaTables( void ) {
+    int i = 0;
+
+    for ( i = 0; i < 256; i++ ) {
+        LumaRed[ i ] = 0.2126F * i;
+        LumaGreen[ i ] = 0.7152F * i;
+        LumaBlue[ i ] = 0.0722F * i;
+    }
+}
+
+#if defined( CONVERT_SSE2 )
+
+/*
+ * Four pixels at a time, with the same float multiplies and adds as the tables in the same order.
+ * GCC would otherwise be free to fuse them when building for FMA, which rounds differently.
+ * Returns the number of pixels done, the caller finishes the row.
+ */
+#if defined( __GNUC__ ) && ! defined( __clang__ )
+__attribute__( ( optimize( "fp-contract=off" ) ) )
+#endif
+static int GreyRowSSE2( const uint8_t* Line, int Width, int BytesPerPixel, uint8_t Xor, uint8_t* Output ) {
+    const __m128 Red = _mm_set1_ps( 0.2126F );
+    const __m128 Green = _mm_set1_ps( 0.7152F );
+    const __m128 Blue = _mm_set1_ps( 0.0722F );
+    const __m128 Half = _mm_set1_ps( 0.5F );
+    const __m128i Mask = _mm_set1_epi32( 0xFF );
+    const __m128i XorMask = _mm_set1_epi8( ( char ) Xor );
+    __m128i Pixels;
+    __m128i Grey;
+    __m128 Sum;
+    uint32_t Packed = 0;
+    int x = 0;
+
+    /* Loads are 16 bytes, which is a little more than four 24bpp pixels, so stop before reading past the row */
+    int Stop = ( BytesPerPixel == 4 ) ? 4 : 6;
+
+    for ( x = 0; x + Stop <= Width; x+= 4, Line+= BytesPerPixel * 4 ) {
+        Pixels = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* ) Line ), XorMask );
+
+        if ( BytesPerPixel == 3 ) {
+            /* BGR BGR BGR BGR into BGR. BGR. BGR. BGR. */
+            Pixels = _mm_unpacklo_epi64(
+                _mm_unpacklo_epi32( Pixels, _mm_srli_si128( Pixels, 3 ) ),
+                _mm_unpacklo_epi32( _mm_srli_si128( Pixels, 6 ), _mm_srli_si128( Pixels, 9 ) )
+            );
+        }
+
+        Sum = _mm_add_ps(
+            _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Pixels, 16 ), Mask ) ), Red ),
+            _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Pixels, 8 ), Mask ) ), Green )
+        );
+
+        Sum = _mm_add_ps( Sum, _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( Pixels, Mask ) ), Blue ) );
+        Grey = _mm_cvttps_epi32( _mm_add_ps( Sum, Half ) );
+
+        Grey = _mm_packs_epi32( Grey, Grey );
+        Packed = ( uint32_t ) _mm_cvtsi128_si32( _mm_packus_epi16( Grey, Grey ) );
+
+        memcpy( &Output[ x ], &Packed, sizeof( uint32_t ) );
+    }
+
+    return x;
+}
+
+#endif
+
+/*
+ * Same as FreeImage_ConvertToGreyscale for 24 and 32bpp images, with every channel XORed
+ * with (Xor) first, which is what FreeImage_Invert does when it is 0xFF.
+ * (Output) is 8bpp with (OutputPitch) bytes per scanline, in the same scanline order as (Input).
+ */
+static void ConvertToGreyscaleNative( FIBITMAP* Input, uint8_t Xor, uint8_t* Output, int OutputPitch ) {
+    int BytesPerPixel = FreeImage_GetBPP( Input ) / 8;
+    int Height = FreeImage_GetHeight( Input );
+    int Width = FreeImage_GetWidth( Input );
+    const uint8_t* Line = NULL;
+    uint8_t* Grey = NULL;
+    int x = 0;
+    int y = 0;
+
+    pthread_once( &LumaOnce, InitLumaTables );
+
+    for ( y = 0; y < Height; y++ ) {
+        Line = FreeImage_GetScanLine( Input, y );
+        Grey = Output + ( ( ptrdiff_t ) y * OutputPitch );
+        x = 0;
+
+#if defined( CONVERT_SSE2 )
+        x = GreyRowSSE2( Line, Width, BytesPerPixel, Xor, Grey );
+        Line+= x * BytesPerPixel;
+#endif
+
+        for ( ; x < Width; x++, Line+= BytesPerPixel ) {
+            Grey[ x ] = ( uint8_t ) ( LumaRed[ Line[ FI_RGBA_RED ] ^ Xor ] + LumaGreen[ Line[ FI_RGBA_GREEN ] ^ Xor ] + LumaBlue[ Line[ FI_RGBA_BLUE ] ^ Xor ] + 0.5F );
+        }
+    }
+}
+
+/*
+ * Reduces 24 and 32bpp (Input) to an 8bpp greyscale bitmap kept in (Frame) in one pass, with
+ * --invert applied on the way, so nothing after this has to go over the colour image again.
+ * The result is the same as FreeImage_Invert followed by FreeImage_ConvertToGreyscale,
+ * Frame->Inverted is set if it has been inverted. Images that get scaled are left for
+ * the conversion to invert, which does it in the dither pass.
+ * Returns (Input) as it is for any other kind of image, NULL if there is no memory for the bitmap.
+ * Safe to call from any thread as long as every thread has its own frame.
+ */
+FIBITMAP* Convert_Greyscale( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame ) {
+    bool Invert = Options->InvertFlag;
+    uint64_t Start = 0;
+    int Width = 0;
+    int Height = 0;
+    int BPP = 0;
+
+    NullCheck( Input, return NULL );
+
+    BPP = FreeImage_GetBPP( Input );
+
+    if ( FreeImage_GetImageType( Input ) != FIT_BITMAP || ( BPP != 24 && BPP != 32 ) ) {
+        return Input;
+    }
+
+    Width = FreeImage_GetWidth( Input );
+    Height = FreeImage_GetHeight( Input );
+
+    if ( Frame->GreyBitmap != NULL && ( ( int ) FreeImage_GetWidth( Frame->GreyBitmap ) != Width || ( int ) FreeImage_GetHeight( Frame->GreyBitmap ) != Height ) ) {
+        FreeImage_Unload( Frame->GreyBitmap );
+        Frame->GreyBitmap = NULL;
+    }
+
+    /* FreeImage gives 8bpp bitmaps a greyscale palette, so this is FIC_MINISBLACK */
+    if ( Frame->GreyBitmap == NULL && ( Frame->GreyBitmap = FreeImage_Allocate( Width, Height, 8, 0, 0, 0 ) ) == NULL ) {
+        return NULL;
+    }
+
+    /* Scaled images are inverted in the dither pass like greyscale input, since the scaler rounds halves up
+     * and would not always give the exact inverse of the scaled image for one inverted beforehand.
+     */
+    if ( Options->ResizeWidth > 0 ) {
+        Invert = false;
+    }
+
+    Start = Stats_Start( );
+        ConvertToGreyscaleNative( Input, ( Invert == true ) ? 0xFF : 0x00, FreeImage_GetBits( Frame->GreyBitmap ), FreeImage_GetPitch( Frame->GreyBitmap ) );
+    Stats_Stop( Stage_Grey, Start );
+
+    Frame->Inverted = Invert;
+    return Frame->GreyBitmap;
+}
+
+/*
+ * Native equivalent of GetProcessedOutput:
+ * Converts (Input) into a 1bpp bitmap at (Bits) in one pass, without allocating one.
+ * Bits is indexed by FreeImage scanline, BitsPitch may be negative to write it top-down.
+ */
+static bool GetProcessedOutputNative( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame, uint8_t* Bits, int BitsPitch ) {
+    FIBITMAP* Greyscale = NULL;
+    const uint8_t* Grey = NULL;
+    bool Invert = ( Options->InvertFlag == true && Frame->Inverted == false ) ? true : false;
+    uint8_t GreyXor = 0x00;
+    uint64_t Start = 0;
+    int GreyPitch = 0;
+
+    if ( FreeImage_GetBPP( Input ) == 8 && FreeImage_GetColorType( Input ) == FIC_MINISBLACK ) {
+        /* Already greyscale, so the invert can be folded into the dither pass */
+        GreyXor = ( Invert == true ) ? 0xFF : 0x00;
+        Start = Stats_Start( );
+
+        Grey = FreeImage_GetBits( Input );
+        GreyPitch = FreeImage_GetPitch( Input );
+    } else {
+        /* FreeImage converts to greyscale internally, do the same after inverting the source colours */
+        if ( Invert == true ) {
+            Start = Stats_Start( );
+                FreeImage_Invert( Input );
+            Stats_Stop( Stage_Invert, Start );
+        }
+
+        Start = Stats_Start( );
+
+        if ( ( Greyscale = FreeImage_ConvertToGreyscale( Input ) ) == NULL ) {
+            return false;
+        }
+
+        Grey = FreeImage_GetBits( Greyscale );
+        GreyPitch = FreeImage_GetPitch( Greyscale );
+    }
+
+    Dither_Frame( &Frame->Plan, Grey, GreyPitch, GreyXor, FreeImage_GetHeight( Input ), Bits, BitsPitch );
+    Stats_Stop( Stage_Convert, Start );
+
+    if ( Greyscale != NULL ) {
+        FreeImage_Unload( Greyscale );
+    }
+
+    return true;
+}
+
+/*
+ * Runs (Reference) through the FreeImage conversion and compares the result
+ * against the 1bpp bitmap at (Bits), which is laid out as for GetProcessedOutputNative.
+ * Returns false if they differ.
+ */
+static bool SelfCheckNative( const struct Options* Options, FIBITMAP* Reference, bool Invert, const uint8_t* Bits, int BitsPitch ) {
+    FIBITMAP* Output = NULL;
+    bool Result = true;
+    int LineSize = 0;
+    int y = 0;
+
+    if ( ( Output = GetProcessedOutput( Options, Reference, Invert ) ) == NULL ) {
+        fprintf( stderr, "Self check failed: FreeImage could not convert the reference image.\n" );
+        return false;
+    }
+
+    LineSize = FreeImage_GetWidth( Output ) / 8;
+
+    for ( y = 0; y < ( int ) FreeImage_GetHeight( Output ) && Result == true; y++ ) {
+        if ( memcmp( FreeImage_GetScanLine( Output, y ), Bits + ( ( ptrdiff_t ) y * BitsPitch ), LineSize ) != 0 ) {
+            fprintf( stderr, "Self check failed: scanline %d differs from FreeImage.\n", y );
+            Result = false;
+        }
+    }
+
+    FreeImage_Unload( Output );
+    return Result;
+}
+
+/*
+ * Sets (or clears) the pixel at (x,y) for the
+ * SSD1306's horizontal addressing mode.
+ */
+void SetPixelHorizontal( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) {
+#if 0
+    int PixelOffset = x + ( ( y / 8 ) * ImageWidth );
+    int BitOffset = ( y & 0x07 );
+
+    ( void ) ImageHeight;
+
+    Output[ PixelOffset ] = ( Color == true ) ? Output[ PixelOffset ] | BIT( BitOffset ) : Output[ PixelOffset ] & ~BIT( BitOffset );
+#endif
+    int BitOffset = ( y & 0x07 );
+
+    ( void ) ImageHeight;
+
+    /* 
+     * Divide the y coordinate by 8 to get which page
+     * the bit we want to set is on.
+     */
+    y>>= 3;
+
+    if ( Color == true ) {
+        Output[ x + ( y * ImageWidth ) ] |= BIT( BitOffset );
+    } else {
+        Output[ x + ( y * ImageWidth ) ] &= ~BIT( BitOffset );
+    }
+}
+
+void SetPixelVertical( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) {
+    int BitOffset = ( y & 0x07 );
+    int PageOffset = ( y / 8 );
+    int PixelOffset = 0;
+
+    ( void ) ImageWidth;
+
+    PixelOffset = ( x * ( ImageHeight / 8 ) ) + PageOffset;
+    Output[ PixelOffset ] = ( Color == true ) ? ( Output[ PixelOffset ] | BIT( BitOffset ) ) : ( Output[ PixelOffset ] & ~BIT( BitOffset ) );
+}
+
+void SetPixelLinear( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) {
+    int BitOffset = 7 - ( x & 0x07 );
+    int PixelOffset = 0;
+
+    ( void ) ImageHeight;
+
+    PixelOffset = y * ( ImageWidth / 8 );
+    PixelOffset+= ( x / 8 );
+
+    Output[ PixelOffset ] = ( Color == true ) ? ( Output[ PixelOffset ] | BIT( BitOffset ) ) : ( Output[ PixelOffset ] & ~BIT( BitOffset ) );
+}
+
+static bool GetPackInvert( const struct Options* Options, int Format );
+
+/*
+ * Reference conversion, one pixel at a time through the SetPixel functions above.
+ * Only used by --selfcheck to verify the packing kernels in pack.c.
+ * (Width)x(Height) is the size of (Input), which is turned and mirrored here one pixel at a time
+ * and then set in the panel it falls in.
+ */
+static void DoPerPixelConversion( const struct Options* Options, FIBITMAP* Input, uint8_t* Output, int Width, int Height ) {
+    void ( *SetPixelFn ) ( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) = NULL;
+    bool Invert = GetPackInvert( Options, Options->OutputFormat );
+    uint8_t Color = 0;
+    uint8_t* Panel = NULL;
+    int OutputWidth = 0;
+    int OutputHeight = 0;
+    int PanelWidth = 0;
+    int PanelHeight = 0;
+    int SourceX = 0;
+    int SourceY = 0;
+    int Mirrored = 0;
+    int x = 0;
+    int y = 0;
+
+    Options_GetOutputSize( Options, Width, Height, &OutputWidth, &OutputHeight );
+
+    if ( Options_GetPanelSize( Options, OutputWidth, OutputHeight, &PanelWidth, &PanelHeight ) == false ) {
+        return;
+    }
+
+    switch ( Options->OutputFormat ) {
+        case Format_1306_Horizontal:
+        case Format_1306_Dirty: {
+            SetPixelFn = SetPixelHorizontal;
+            break;
+        }
+        case Format_1306_Vertical: {
+            SetPixelFn = SetPixelVertical;
+            break;
+        }
+        case Format_Linear: {
+            SetPixelFn = SetPixelLinear;
+            break;
+        }
+        default: return;
+    };
+
+    for ( x = 0; x < OutputWidth; x++ ) {
+        for ( y = 0; y < OutputHeight; y++ ) {
+            /* Undo the mirror, then the clockwise turn */
+            Mirrored = ( Options->MirrorFlag == true ) ? OutputWidth - 1 - x : x;
+
+            switch ( Options->Rotation ) {
+                case Rotate_90: {
+                    SourceX = y;
+                    SourceY = OutputWidth - 1 - Mirrored;
+                    break;
+                }
+                case Rotate_180: {
+                    SourceX = OutputWidth - 1 - Mirrored;
+                    SourceY = OutputHeight - 1 - y;
+                    break;
+                }
+                case Rotate_270: {
+                    SourceX = OutputHeight - 1 - y;
+                    SourceY = Mirrored;
+                    break;
+                }
+                default: {
+                    SourceX = Mirrored;
+                    SourceY = y;
+                    break;
+                }
+            };
+
+            /* Scanlines are bottom-up */
+            FreeImage_GetPixelIndex( Input, SourceX, Height - 1 - SourceY, &Color );
+
+            Panel = &Output[ ( ( size_t ) ( ( ( y / PanelHeight ) * ( OutputWidth / PanelWidth ) ) + ( x / PanelWidth ) ) * PanelWidth * PanelHeight ) / 8 ];
+            SetPixelFn( Panel, x % PanelWidth, y % PanelHeight, PanelWidth, PanelHeight, ( Invert == true ) ? ! Color : Color );
+        }
+    }
+}
+
+/*
+ * Compares the packed framebuffer against the per-pixel reference conversion.
+ * Returns false if they differ.
+ */
+static bool SelfCheckOutput( const struct Options* Options, FIBITMAP* Input, const uint8_t* Output, int Width, int Height ) {
+    size_t DisplaySize = ( Width * Height ) / 8;
+    uint8_t* Reference = NULL;
+    bool Result = false;
+    size_t i = 0;
+
+    if ( ( Reference = ( uint8_t* ) malloc( DisplaySize ) ) == NULL ) {
+        fprintf( stderr, "Failed to allocate a self check framebuffer.\n" );
+        return false;
+    }
+
+    DoPerPixelConversion( Options, Input, Reference, Width, Height );
+
+    if ( memcmp( Reference, Output, DisplaySize ) == 0 ) {
+        Result = true;
+    } else {
+        for ( i = 0; i < DisplaySize && Reference[ i ] == Output[ i ]; i++ ) {
+        }
+
+        fprintf( stderr, "Self check failed: byte %zu is 0x%02X, expected 0x%02X.\n", i, Output[ i ], Reference[ i ] );
+    }
+
+    free( Reference );
+    return Result;
+}
+
+/*
+ * Horizontal output has always had the invert flag applied a second time while packing,
+ * keep doing that so existing output does not change.
+ */
+static bool GetPackInvert( const struct Options* Options, int Format ) {
+    return ( Format == Format_1306_Horizontal || Format == Format_1306_Dirty ) ? Options->InvertFlag : false;
+}
+
+/*
+ * Packs the 1bpp image (Input) into (Output) in the selected output format.
+ * Returns false if --selfcheck is enabled and the result does not match
+ * the per-pixel reference.
+ */
+bool DoOutputConversion( const struct Options* Options, FIBITMAP* Input, uint8_t* Output, int Width, int Height ) {
+    int Format = Options->OutputFormat;
+    uint64_t Start = 0;
+
+    /* FreeImage scanlines are bottom-up, pack them from the top one down */
+    Start = Stats_Start( );
+        Pack_Panels( FreeImage_GetScanLine( Input, Height - 1 ), -( int ) FreeImage_GetPitch( Input ), Width, Height, Format, Options->Rotation, Options->MirrorFlag, GetPackInvert( Options, Format ), Options->PanelColumns, Options->PanelRows, Output );
+    Stats_Stop( Stage_Pack, Start );
+
+    if ( Options->SelfCheckFlag == true ) {
+        return SelfCheckOutput( Options, Input, Output, Width, Height );
+    }
+
+    return true;
+}
+
+/*
+ * Makes sure (*Buffer) can hold at least (Size) bytes.
+ */
+bool Convert_GrowBuffer( uint8_t** Buffer, size_t* BufferSize, size_t Size ) {
+    uint8_t* Result = NULL;
+
+    if ( Size > *BufferSize ) {
+        if ( ( Result = ( uint8_t* ) realloc( *Buffer, Size ) ) == NULL ) {
+            return false;
+        }
+
+        *Buffer = Result;
+        *BufferSize = Size;
+    }
+
+    return true;
+}
+
+/*
+ * Allocates an empty 1bpp bitmap with the same black/white palette FreeImage_Threshold uses.
+ */
+static FIBITMAP* AllocateMonoBitmap( int Width, int Height ) {
+    FIBITMAP* Result = NULL;
+    RGBQUAD* Palette = NULL;
+
+    if ( ( Result = FreeImage_Allocate( Width, Height, 1, 0, 0, 0 ) ) != NULL ) {
+        Palette = FreeImage_GetPalette( Result );
+
+        Palette[ 0 ].rgbRed = Palette[ 0 ].rgbGreen = Palette[ 0 ].rgbBlue = 0;
+        Palette[ 1 ].rgbRed = Palette[ 1 ].rgbGreen = Palette[ 1 ].rgbBlue = 255;
+    }
+
+    return Result;
+}
+
+/*
+ * Falls back to the slot's own framebuffer if the frame can't be packed
+ * straight into the output file.
+ */
+static bool PrepareFrameOutput( struct Frame* Frame ) {
+    if ( Frame->Output == NULL ) {
+        if ( Convert_GrowBuffer( &Frame->Framebuffer, &Frame->FramebufferSize, ( Frame->Width * Frame->Height ) / 8 ) == false ) {
+            return false;
+        }
+
+        Frame->Output = Frame->Framebuffer;
+    }
+
+    return true;
+}
+
+/*
+ * Converts through FreeImage_Threshold/FreeImage_Dither and the packing kernels.
+ */
+static void ConvertWithFreeImage( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame ) {
+    /* This really should never fail, but if it does try to keep going anyway */
+    if ( ( Frame->Bitmap = GetProcessedOutput( Options, Input, Options->InvertFlag == true && Frame->Inverted == false ) ) == NULL ) {
+        Frame->Status = Frame_ConvertFailed;
+    } else if ( Options->Container != Container_GIF ) {
+        /* RAW And ANM modes require working on a 1bpp framebuffer so we need
+         * to allocate one of the proper size ourselves here.
+         */
+        if ( PrepareFrameOutput( Frame ) == false ) {
+            Frame->Status = Frame_NoMemory;
+        } else if ( DoOutputConversion( Options, Frame->Bitmap, Frame->Output, Frame->Width, Frame->Height ) == false ) {
+            Frame->Status = Frame_CheckFailed;
+        }
+
+        FreeImage_Unload( Frame->Bitmap );
+        Frame->Bitmap = NULL;
+    }
+}
+
+/*
+ * Converts through the native threshold/dither engine:
+ * GIF output gets a 1bpp bitmap filled in directly, RAW/ANM output is dithered into a
+ * top-down 1bpp buffer and packed from there. Linear output has the same layout as that
+ * buffer so unless it has to be turned, mirrored or split into panels it is dithered straight into the framebuffer.
+ */
+static void ConvertNative( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame ) {
+    int Format = Options->OutputFormat;
+    int LineSize = Frame->Width / 8;
+    size_t DisplaySize = ( Frame->Width * Frame->Height ) / 8;
+    FIBITMAP* Reference = NULL;
+    uint8_t* Target = NULL;
+    uint8_t* Bits = NULL;
+    uint64_t Start = 0;
+    int Pitch = 0;
+
+    if ( Frame->Plan.Width != Frame->Width ) {
+        Dither_FreePlan( &Frame->Plan );
+
+        if ( Dither_CreatePlan( &Frame->Plan, Options->DitherFlag, GetDitherAlgorithm( Options ), Options->ThresholdValue, Frame->Width ) == false ) {
+            Frame->Status = Frame_NoMemory;
+            return;
+        }
+
+        if ( Options->TemporalFlag == true ) {
+            Dither_SetTemporal( &Frame->Plan, Options->Hysteresis );
+        }
+    }
+
+    if ( Options->Container == Container_GIF ) {
+        /* FreeImage_AppendPage keeps its own copy, so the same bitmap is reused for every image */
+        if ( Frame->MonoBitmap != NULL && ( ( int ) FreeImage_GetWidth( Frame->MonoBitmap ) != Frame->Width || ( int ) FreeImage_GetHeight( Frame->MonoBitmap ) != Frame->Height ) ) {
+            FreeImage_Unload( Frame->MonoBitmap );
+            Frame->MonoBitmap = NULL;
+        }
+
+        if ( Frame->MonoBitmap == NULL && ( Frame->MonoBitmap = AllocateMonoBitmap( Frame->Width, Frame->Height ) ) == NULL ) {
+            Frame->Status = Frame_NoMemory;
+            return;
+        }
+
+        Frame->Bitmap = Frame->MonoBitmap;
+        Bits = FreeImage_GetBits( Frame->Bitmap );
+        Pitch = FreeImage_GetPitch( Frame->Bitmap );
+    } else {
+        if ( PrepareFrameOutput( Frame ) == false ) {
+            Frame->Status = Frame_NoMemory;
+            return;
+        }
+
+        if ( Format == Format_Linear && Options->Rotation == Rotate_None && Options->MirrorFlag == false && Options_GetPanelCount( Options ) == 1 ) {
+            Target = Frame->Output;
+        } else if ( Convert_GrowBuffer( &Frame->Mono, &Frame->MonoSize, DisplaySize ) == true ) {
+            Target = Frame->Mono;
+        } else {
+            Frame->Status = Frame_NoMemory;
+            return;
+        }
+
+        /* FreeImage scanlines are bottom-up, write them top-down */
+        Bits = &Target[ ( Frame->Height - 1 ) * LineSize ];
+        Pitch = -LineSize;
+    }
+
+    /* The native path inverts the input in place, so check against an untouched copy.
+     * There's nothing to check temporal dithering or the error diffusion kernels FreeImage doesn't have against.
+     */
+    if ( Options->SelfCheckFlag == true && Options->TemporalFlag == false && Dither_HasReference( Options->DitherFlag, Options->DitherAlgorithm ) == true ) {
+        Reference = FreeImage_Clone( Input );
+    }
+
+    if ( GetProcessedOutputNative( Options, Input, Frame, Bits, Pitch ) == false ) {
+        Frame->Status = Frame_ConvertFailed;
+    } else {
+        if ( Reference != NULL && SelfCheckNative( Options, Reference, Options->InvertFlag == true && Frame->Inverted == false, Bits, Pitch ) == false ) {
+            Frame->Status = Frame_CheckFailed;
+        }
+
+        if ( Target != NULL && Target == Frame->Mono ) {
+            Start = Stats_Start( );
+                Pack_Panels( Frame->Mono, LineSize, Frame->Width, Frame->Height, Format, Options->Rotation, Options->MirrorFlag, GetPackInvert( Options, Format ), Options->PanelColumns, Options->PanelRows, Frame->Output );
+            Stats_Stop( Stage_Pack, Start );
+        }
+    }
+
+    if ( Reference != NULL ) {
+        FreeImage_Unload( Reference );
+    }
+}
+
+/*
+ * Converts (Input), which NeedsNativeInput says has to be, to 8bpp greyscale and through the native engine.
+ */
+static void ConvertStandardNative( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame ) {
+    FIBITMAP* Standard = NULL;
+    FIBITMAP* Greyscale = NULL;
+    uint64_t Start = 0;
+
+    Start = Stats_Start( );
+
+    if ( ( Standard = FreeImage_ConvertToStandardType( Input, TRUE ) ) != NULL ) {
+        Greyscale = FreeImage_ConvertToGreyscale( Standard );
+        FreeImage_Unload( Standard );
+    }
+
+    Stats_Stop( Stage_Grey, Start );
+
+    if ( Greyscale == NULL ) {
+        Frame->Status = Frame_ConvertFailed;
+        return;
+    }
+
+    ConvertNative( Options, Greyscale, Frame );
+    FreeImage_Unload( Greyscale );
+}
+
+/*
+ * Scales (Input) to --size as an 8bpp greyscale bitmap kept in (Frame) and sets the frame size to match.
+ * Frame->Width and Frame->Height must be the size of (Input), colour input is expected
+ * to have been through Convert_Greyscale already.
+ * Returns (Input) as it is if there is nothing to scale, NULL if it can't be scaled.
+ * Safe to call from any thread as long as every thread has its own frame.
+ */
+FIBITMAP* Convert_Resize( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame ) {
+    FIBITMAP* Greyscale = NULL;
+    const uint8_t* Grey = NULL;
+    bool Invert = ( Options->InvertFlag == true && Frame->Inverted == false ) ? true : false;
+    uint8_t Fill = 0x00;
+    int GreyPitch = 0;
+    int Width = Options->ResizeWidth;
+    int Height = Options->ResizeHeight;
+
+    NullCheck( Input, return NULL );
+
+    if ( Width <= 0 || Height <= 0 || ( Frame->Width == Width && Frame->Height == Height ) ) {
+        return Input;
+    }
+
+    if ( Frame->Resize.SourceWidth != Frame->Width || Frame->Resize.SourceHeight != Frame->Height || Frame->Resize.Width != Width || Frame->Resize.Height != Height || Frame->Resize.Mode != Options->ResizeMode ) {
+        if ( Resize_CreatePlan( &Frame->Resize, Frame->Width, Frame->Height, Width, Height, Options->ResizeMode ) == false ) {
+            return NULL;
+        }
+    }
+
+    /* 8bpp greyscale, which the conversion after this takes as it is */
+    if ( Frame->Resized == NULL && ( Frame->Resized = FreeImage_Allocate( Width, Height, 8, 0, 0, 0 ) ) == NULL ) {
+        return NULL;
+    }
+
+    if ( FreeImage_GetBPP( Input ) == 8 && FreeImage_GetColorType( Input ) == FIC_MINISBLACK ) {
+        Grey = FreeImage_GetBits( Input );
+        GreyPitch = FreeImage_GetPitch( Input );
+    } else {
+        if ( ( Greyscale = FreeImage_ConvertToGreyscale( Input ) ) == NULL ) {
+            return NULL;
+        }
+
+        Grey = FreeImage_GetBits( Greyscale );
+        GreyPitch = FreeImage_GetPitch( Greyscale );
+    }
+
+    /* Letterbox bars are still to be inverted along with the image, so fill them with what comes out black */
+    if ( Options->Container != Container_GIF && GetPackInvert( Options, Options->OutputFormat ) == true ) {
+        Invert = ( Invert == true ) ? false : true;
+    }
+
+    Fill = ( Invert == true ) ? 0xFF : 0x00;
+
+    /* Scanlines are bottom-up, start both at the top row */
+    Resize_Frame(
+        &Frame->Resize,
+        Grey + ( ( ptrdiff_t ) ( Frame->Height - 1 ) * GreyPitch ),
+        -GreyPitch,
+        FreeImage_GetScanLine( Frame->Resized, Height - 1 ),
+        -( int ) FreeImage_GetPitch( Frame->Resized ),
+        Fill
+    );
+
+    if ( Greyscale != NULL ) {
+        FreeImage_Unload( Greyscale );
+    }
+
+    Frame->Width = Width;
+    Frame->Height = Height;
+
+    return Frame->Resized;
+}
+
+/*
+ * Converts (Input) into (Frame) using (Options):
+ * GIF output ends up in Frame->Bitmap, RAW/ANM output is packed into Frame->Output,
+ * or into the frame's own framebuffer if that is NULL.
+ * Frame->Width and Frame->Height must already be set, the result is in Frame->Status.
+ * Safe to call from any thread as long as every thread has its own frame.
+ */
+void Convert_Frame( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame ) {
+    NullCheck( Options, return );
+    NullCheck( Frame, return );
+
+    Frame->Status = Frame_Ok;
+    Frame->Bitmap = NULL;
+
+    if ( Input == NULL ) {
+        Frame->Status = Frame_OpenFailed;
+    } else if ( ( Input = Convert_Greyscale( Options, Input, Frame ) ) == NULL ) {
+        Frame->Status = Frame_NoMemory;
+    } else if ( CanConvertNatively( Options, Input ) == true ) {
+        ConvertNative( Options, Input, Frame );
+    } else if ( NeedsNativeInput( Options, Input ) == true ) {
+        ConvertStandardNative( Options, Input, Frame );
+    } else {
+        ConvertWithFreeImage( Options, Input, Frame );
+    }
+
+    /* The next image starts out in colour again */
+    Frame->Inverted = false;
+}
+
+/*
+ * Drops the GIF output bitmap once it has been written.
+ */
+void Convert_ReleaseFrame( struct Frame* Frame ) {
+    if ( Frame->Bitmap != NULL && Frame->Bitmap != Frame->MonoBitmap ) {
+        FreeImage_Unload( Frame->Bitmap );
+    }
+
+    Frame->Bitmap = NULL;
+}
+
+/*
+ * Frees everything the frame has allocated.
+ */
+void Convert_FreeFrame( struct Frame* Frame ) {
+    Convert_ReleaseFrame( Frame );
+
+    if ( Frame->Framebuffer != NULL ) {
+        free( Frame->Framebuffer );
+    }
+
+    if ( Frame->Mono != NULL ) {
+        free( Frame->Mono );
+    }
+
+    if ( Frame->GreyBitmap != NULL ) {
+        FreeImage_Unload( Frame->GreyBitmap );
+    }
+
+    if ( Frame->MonoBitmap != NULL ) {
+        FreeImage_Unload( Frame->MonoBitmap );
+    }
+
+    if ( Frame->Resized != NULL ) {
+        FreeImage_Unload( Frame->Resized );
+    }
+
+    if ( Frame->Input != NULL ) {
+        FreeImage_Unload( Frame->Input );
+    }
+
+    if ( Frame->Page != NULL ) {
+        FreeImage_Unload( Frame->Page );
+    }
+
+    Dither_FreePlan( &Frame->Plan );
+    Resize_FreePlan( &Frame->Resize );
+    memset( Frame, 0, sizeof( struct Frame ) );
+}
@@ -0,0 +1,72 @@
+#ifndef _CONVERT_H_
+#define _CONVERT_H_
+
+enum {
+    Frame_Ok = 0,
+    Frame_OpenFailed,
+    Frame_ConvertFailed,
+    Frame_CheckFailed,
+    Frame_NoMemory
+};
+
+/*
+ * One converted image on its way from a worker to the output file.
+ * Every buffer in here is kept for the next image converted in the same slot,
+ * so once the first image has been converted the native path allocates nothing
+ * per frame. Inputs FreeImage has to convert still allocate inside FreeImage.
+ */
+struct Frame {
+    /* 1bpp image, only kept around for GIF output */
+    FIBITMAP* Bitmap;
+
+    /* Bitmap for GIF output from the native conversion path */
+    FIBITMAP* MonoBitmap;
+
+    /* Packed RAW/ANM output, reused for every image converted in this slot */
+    uint8_t* Framebuffer;
+    size_t FramebufferSize;
+
+    /* Where this frame gets packed: its place in a mapped output file, or Framebuffer */
+    uint8_t* Output;
+
+    /* Top-down 1bpp image for the native conversion path */
+    uint8_t* Mono;
+    size_t MonoSize;
+
+    /* 24/32bpp input reduced to 8bpp greyscale, see Convert_Greyscale */
+    FIBITMAP* GreyBitmap;
+
+    /* Frame as read from a raw input stream */
+    FIBITMAP* Input;
+
+    /* Page of a multi-page input, read in order and unloaded once converted */
+    FIBITMAP* Page;
+
+    struct DitherPlan Plan;
+
+    /* Input scaled to --size as 8bpp greyscale, and the tables to do it with for the last input size */
+    FIBITMAP* Resized;
+    struct ResizePlan Resize;
+
+    int Width;
+    int Height;
+    int Status;
+
+    /* Set while the image being converted already has --invert applied */
+    bool Inverted;
+
+    /* Milliseconds to show this frame for */
+    uint32_t Delay;
+};
+
+FIBITMAP* GetProcessedOutput( const struct Options* Options, FIBITMAP* Input, bool Invert );
+bool DoOutputConversion( const struct Options* Options, FIBITMAP* Input, uint8_t* Output, int Width, int Height );
+
+bool Convert_GrowBuffer( uint8_t** Buffer, size_t* BufferSize, size_t Size );
+FIBITMAP* Convert_Greyscale( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame );
+FIBITMAP* Convert_Resize( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame );
+void Convert_Frame( const struct Options* Options, FIBITMAP* Input, struct Frame* Frame );
+void Convert_ReleaseFrame( struct Frame* Frame );
+void Convert_FreeFrame( struct Frame* Frame );
+
+#endif
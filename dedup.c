@@ -0,0 +1,220 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "dedup.h"
+
+/* Stored frames and table entries are allocated this many at a time */
+#define GrowBy 256
+
+/*
+ * Sets up deduplication of (FrameSize) byte frames.
+ * With (AnyOrder) every stored frame is kept so a repeat of any of them is found,
+ * otherwise only a repeat of the last stored frame is.
+ */
+bool Dedup_Create( struct FrameDedup* Dedup, size_t FrameSize, bool AnyOrder ) {
+    NullCheck( Dedup, return false );
+
+    memset( Dedup, 0, sizeof( struct FrameDedup ) );
+
+    Dedup->FrameSize = FrameSize;
+    Dedup->AnyOrder = AnyOrder;
+
+    return true;
+}
+
+void Dedup_Free( struct FrameDedup* Dedup ) {
+    if ( Dedup != NULL ) {
+        if ( Dedup->Entries != NULL ) {
+            free( Dedup->Entries );
+        }
+
+        if ( Dedup->Frames != NULL ) {
+            free( Dedup->Frames );
+        }
+
+        if ( Dedup->Hashes != NULL ) {
+            free( Dedup->Hashes );
+        }
+
+        if ( Dedup->Slots != NULL ) {
+            free( Dedup->Slots );
+        }
+
+        memset( Dedup, 0, sizeof( struct FrameDedup ) );
+    }
+}
+
+/*
+ * 64 bit FNV-1a.
+ */
+static uint64_t HashFrame( const uint8_t* Frame, size_t Size ) {
+    uint64_t Hash = 0xCBF29CE484222325ULL;
+    size_t i = 0;
+
+    for ( i = 0; i < Size; i++ ) {
+        Hash = ( Hash ^ Frame[ i ] ) * 0x100000001B3ULL;
+    }
+
+    return Hash;
+}
+
+/*
+ * Returns the index of the stored frame (Frame) is a copy of, or -1 if there isn't one.
+ */
+int Dedup_Find( const struct FrameDedup* Dedup, const uint8_t* Frame ) {
+    uint64_t Hash = 0;
+    int Slot = 0;
+    int Index = 0;
+
+    NullCheck( Dedup, return -1 );
+    NullCheck( Frame, return -1 );
+
+    if ( Dedup->FrameCount == 0 ) {
+        return -1;
+    }
+
+    if ( Dedup->AnyOrder == false ) {
+        return ( memcmp( Dedup->Frames, Frame, Dedup->FrameSize ) == 0 ) ? Dedup->FrameCount - 1 : -1;
+    }
+
+    Hash = HashFrame( Frame, Dedup->FrameSize );
+
+    for ( Slot = ( int ) ( Hash & ( Dedup->SlotCount - 1 ) ); ( Index = Dedup->Slots[ Slot ] ) >= 0; Slot = ( Slot + 1 ) & ( Dedup->SlotCount - 1 ) ) {
+        /* A matching hash is very likely, but not guaranteed, to be the same frame */
+        if ( Dedup->Hashes[ Index ] == Hash && memcmp( &Dedup->Frames[ Index * Dedup->FrameSize ], Frame, Dedup->FrameSize ) == 0 ) {
+            return Index;
+        }
+    }
+
+    return -1;
+}
+
+static void InsertSlot( struct FrameDedup* Dedup, int Index ) {
+    int Slot = ( int ) ( Dedup->Hashes[ Index ] & ( Dedup->SlotCount - 1 ) );
+
+    while ( Dedup->Slots[ Slot ] >= 0 ) {
+        Slot = ( Slot + 1 ) & ( Dedup->SlotCount - 1 );
+    }
+
+    Dedup->Slots[ Slot ] = Index;
+}
+
+/*
+ * Keeps the hash table at most half full.
+ */
+static bool GrowSlots( struct FrameDedup* Dedup ) {
+    int Count = ( Dedup->SlotCount > 0 ) ? Dedup->SlotCount * 2 : 1024;
+    int i = 0;
+
+    if ( ( Dedup->FrameCount + 1 ) * 2 <= Dedup->SlotCount ) {
+        return true;
+    }
+
+    if ( Dedup->Slots != NULL ) {
+        free( Dedup->Slots );
+    }
+
+    NullCheck( ( Dedup->Slots = ( int* ) malloc( sizeof( int ) * Count ) ), return false );
+
+    Dedup->SlotCount = Count;
+
+    for ( i = 0; i < Count; i++ ) {
+        Dedup->Slots[ i ] = -1;
+    }
+
+    for ( i = 0; i < Dedup->FrameCount; i++ ) {
+        InsertSlot( Dedup, i );
+    }
+
+    return true;
+}
+
+/*
+ * Records (Frame) as the next frame stored in the output, its index is the
+ * number of frames stored before it.
+ */
+bool Dedup_AddFrame( struct FrameDedup* Dedup, const uint8_t* Frame ) {
+    uint8_t* Frames = NULL;
+    uint64_t* Hashes = NULL;
+
+    NullCheck( Dedup, return false );
+    NullCheck( Frame, return false );
+
+    if ( Dedup->AnyOrder == false ) {
+        if ( Dedup->Frames == NULL ) {
+            NullCheck( ( Dedup->Frames = ( uint8_t* ) malloc( Dedup->FrameSize ) ), return false );
+        }
+
+        memcpy( Dedup->Frames, Frame, Dedup->FrameSize );
+        Dedup->FrameCount++;
+
+        return true;
+    }
+
+    if ( Dedup->FrameCount >= Dedup->FramesSize ) {
+        Frames = ( uint8_t* ) realloc( Dedup->Frames, Dedup->FrameSize * ( Dedup->FramesSize + GrowBy ) );
+        NullCheck( Frames, return false );
+        Dedup->Frames = Frames;
+
+        Hashes = ( uint64_t* ) realloc( Dedup->Hashes, sizeof( uint64_t ) * ( Dedup->FramesSize + GrowBy ) );
+        NullCheck( Hashes, return false );
+        Dedup->Hashes = Hashes;
+
+        Dedup->FramesSize+= GrowBy;
+    }
+
+    if ( GrowSlots( Dedup ) == false ) {
+        return false;
+    }
+
+    memcpy( &Dedup->Frames[ Dedup->FrameCount * Dedup->FrameSize ], Frame, Dedup->FrameSize );
+    Dedup->Hashes[ Dedup->FrameCount ] = HashFrame( Frame, Dedup->FrameSize );
+
+    InsertSlot( Dedup, Dedup->FrameCount++ );
+    return true;
+}
+
+/*
+ * Shows stored frame (Frame) for (Delay) milliseconds, which merges into the
+ * last entry if that showed the same frame and the delays still fit.
+ */
+bool Dedup_AddEntry( struct FrameDedup* Dedup, int Frame, uint32_t Delay ) {
+    struct ANM1_FrameEntry* Entries = NULL;
+    struct ANM1_FrameEntry* Last = NULL;
+
+    NullCheck( Dedup, return false );
+
+    if ( Dedup->EntryCount > 0 ) {
+        Last = &Dedup->Entries[ Dedup->EntryCount - 1 ];
+
+        if ( Last->Frame == Frame && Last->Delay + Delay <= 0xFFFF ) {
+            Last->Delay = ( uint16_t ) ( Last->Delay + Delay );
+            return true;
+        }
+    }
+
+    if ( Dedup->EntryCount >= Dedup->EntriesSize ) {
+        Entries = ( struct ANM1_FrameEntry* ) realloc( Dedup->Entries, sizeof( struct ANM1_FrameEntry ) * ( Dedup->EntriesSize + GrowBy ) );
+        NullCheck( Entries, return false );
+
+        Dedup->Entries = Entries;
+        Dedup->EntriesSize+= GrowBy;
+    }
+
+    Dedup->Entries[ Dedup->EntryCount ].Frame = ( uint16_t ) Frame;
+    Dedup->Entries[ Dedup->EntryCount ].Delay = ( uint16_t ) ( Delay > 0xFFFF ? 0xFFFF : Delay );
+    Dedup->EntryCount++;
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef _DEDUP_H_
+#define _DEDUP_H_
+
+/*
+ * Finds frames that are already in the output so ANM1 files can show them again
+ * without storing them twice, and builds the frame table that plays them back.
+ */
+struct FrameDedup {
+    /* One entry per time a stored frame is shown */
+    struct ANM1_FrameEntry* Entries;
+    int EntryCount;
+    int EntriesSize;
+
+    /* Copies of the stored frames to compare against and their hashes.
+     * When frames can only be referred to in order just the last one is kept.
+     */
+    uint8_t* Frames;
+    uint64_t* Hashes;
+    int FramesSize;
+    int FrameCount;
+
+    /* Open addressing table of stored frame indices by hash, -1 where empty */
+    int* Slots;
+    int SlotCount;
+
+    size_t FrameSize;
+    bool AnyOrder;
+};
+
+bool Dedup_Create( struct FrameDedup* Dedup, size_t FrameSize, bool AnyOrder );
+void Dedup_Free( struct FrameDedup* Dedup );
+int Dedup_Find( const struct FrameDedup* Dedup, const uint8_t* Frame );
+bool Dedup_AddFrame( struct FrameDedup* Dedup, const uint8_t* Frame );
+bool Dedup_AddEntry( struct FrameDedup* Dedup, int Frame, uint32_t Delay );
+
+#endif
@@ -0,0 +1,191 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "dirty.h"
+
+/*
+ * Every rectangle costs its header in the file and a set of address commands on the bus,
+ * so unchanged gaps smaller than that are sent rather than split around.
+ */
+#define RectOverhead ( ( int ) sizeof( struct ANM_DirtyRect ) )
+
+/* A page can't have more spans than this since they are separated by at least one column */
+#define GetMaxSpans( Width ) ( ( ( Width ) / 2 ) + 1 )
+
+/*
+ * Sets up a tracker for SSD1306 horizontal mode framebuffers of the given size.
+ */
+bool Dirty_Create( struct DirtyTracker* Tracker, int Width, int Height ) {
+    int MaxRects = ( Height / 8 ) * GetMaxSpans( Width );
+
+    NullCheck( Tracker, return false );
+
+    memset( Tracker, 0, sizeof( struct DirtyTracker ) );
+
+    Tracker->Width = Width;
+    Tracker->Height = Height;
+    Tracker->Previous = ( uint8_t* ) malloc( ( Width * Height ) / 8 );
+    Tracker->Rects = ( struct ANM_DirtyRect* ) malloc( sizeof( struct ANM_DirtyRect ) * MaxRects );
+    Tracker->Active = ( int* ) malloc( sizeof( int ) * GetMaxSpans( Width ) );
+    Tracker->Next = ( int* ) malloc( sizeof( int ) * GetMaxSpans( Width ) );
+
+    if ( Tracker->Previous == NULL || Tracker->Rects == NULL || Tracker->Active == NULL || Tracker->Next == NULL ) {
+        Dirty_Free( Tracker );
+        return false;
+    }
+
+    return true;
+}
+
+void Dirty_Free( struct DirtyTracker* Tracker ) {
+    if ( Tracker != NULL ) {
+        if ( Tracker->Previous != NULL ) {
+            free( Tracker->Previous );
+        }
+
+        if ( Tracker->Rects != NULL ) {
+            free( Tracker->Rects );
+        }
+
+        if ( Tracker->Active != NULL ) {
+            free( Tracker->Active );
+        }
+
+        if ( Tracker->Next != NULL ) {
+            free( Tracker->Next );
+        }
+
+        memset( Tracker, 0, sizeof( struct DirtyTracker ) );
+    }
+}
+
+static int GetRectArea( const struct ANM_DirtyRect* Rect ) {
+    return ( ( Rect->EndPage - Rect->StartPage ) + 1 ) * ( ( Rect->EndColumn - Rect->StartColumn ) + 1 );
+}
+
+/*
+ * Covers columns [StartColumn, EndColumn] of (Page), either by growing one of the
+ * rectangles that reach the page above when that costs less than starting a new one,
+ * or by adding a new rectangle.
+ * Returns the index of the rectangle used.
+ */
+static int AddSpan( struct DirtyTracker* Tracker, int ActiveCount, int* Count, int Page, int StartColumn, int EndColumn ) {
+    struct ANM_DirtyRect* Rect = NULL;
+    struct ANM_DirtyRect Merged;
+    int Separate = 0;
+    int i = 0;
+
+    for ( i = 0; i < ActiveCount; i++ ) {
+        Rect = &Tracker->Rects[ Tracker->Active[ i ] ];
+
+        /* Already grown onto this page by an earlier span */
+        if ( Rect->EndPage != Page - 1 ) {
+            continue;
+        }
+
+        Merged.StartPage = Rect->StartPage;
+        Merged.EndPage = ( uint8_t ) Page;
+        Merged.StartColumn = ( uint16_t ) ( ( StartColumn < Rect->StartColumn ) ? StartColumn : Rect->StartColumn );
+        Merged.EndColumn = ( uint16_t ) ( ( EndColumn > Rect->EndColumn ) ? EndColumn : Rect->EndColumn );
+
+        Separate = GetRectArea( Rect ) + RectOverhead + ( ( EndColumn - StartColumn ) + 1 );
+
+        if ( GetRectArea( &Merged ) <= Separate ) {
+            *Rect = Merged;
+            return Tracker->Active[ i ];
+        }
+    }
+
+    Rect = &Tracker->Rects[ *Count ];
+
+    Rect->StartPage = ( uint8_t ) Page;
+    Rect->EndPage = ( uint8_t ) Page;
+    Rect->StartColumn = ( uint16_t ) StartColumn;
+    Rect->EndColumn = ( uint16_t ) EndColumn;
+
+    return ( *Count )++;
+}
+
+/*
+ * Compares (Current) against the previous framebuffer and fills Tracker->Rects with the
+ * areas that have to be sent to the display, then remembers (Current) for next time.
+ * The first call always returns one full screen rectangle.
+ * Returns the number of rectangles, 0 if nothing changed.
+ */
+int Dirty_Update( struct DirtyTracker* Tracker, const uint8_t* Current ) {
+    const uint8_t* CurrentPage = NULL;
+    const uint8_t* PreviousPage = NULL;
+    int ActiveCount = 0;
+    int NextCount = 0;
+    int LastChanged = 0;
+    int Width = 0;
+    int Start = 0;
+    int Count = 0;
+    int Page = 0;
+    int Rect = 0;
+    int* Swap = NULL;
+    int x = 0;
+
+    NullCheck( Tracker, return 0 );
+    NullCheck( Current, return 0 );
+
+    Width = Tracker->Width;
+
+    if ( Tracker->HavePrevious == false ) {
+        Tracker->Rects[ 0 ].StartPage = 0;
+        Tracker->Rects[ 0 ].EndPage = ( uint8_t ) ( ( Tracker->Height / 8 ) - 1 );
+        Tracker->Rects[ 0 ].StartColumn = 0;
+        Tracker->Rects[ 0 ].EndColumn = ( uint16_t ) ( Width - 1 );
+
+        Count = 1;
+    } else {
+        for ( Page = 0; Page < Tracker->Height / 8; Page++ ) {
+            CurrentPage = &Current[ Page * Width ];
+            PreviousPage = &Tracker->Previous[ Page * Width ];
+            NextCount = 0;
+
+            for ( x = 0; x < Width; ) {
+                if ( CurrentPage[ x ] == PreviousPage[ x ] ) {
+                    x++;
+                    continue;
+                }
+
+                /* Extend the span until we find a gap worth skipping */
+                for ( Start = x, LastChanged = x; x < Width && x - LastChanged <= RectOverhead; x++ ) {
+                    if ( CurrentPage[ x ] != PreviousPage[ x ] ) {
+                        LastChanged = x;
+                    }
+                }
+
+                Rect = AddSpan( Tracker, ActiveCount, &Count, Page, Start, LastChanged );
+
+                if ( NextCount == 0 || Tracker->Next[ NextCount - 1 ] != Rect ) {
+                    Tracker->Next[ NextCount++ ] = Rect;
+                }
+
+                x = LastChanged + 1;
+            }
+
+            Swap = Tracker->Active;
+            Tracker->Active = Tracker->Next;
+            Tracker->Next = Swap;
+            ActiveCount = NextCount;
+        }
+    }
+
+    memcpy( Tracker->Previous, Current, ( Width * Tracker->Height ) / 8 );
+    Tracker->HavePrevious = true;
+
+    return Count;
+}
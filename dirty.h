@@ -0,0 +1,27 @@
+#ifndef _DIRTY_H_
+#define _DIRTY_H_
+
+/*
+ * Tracks what is on the display so that only changed areas have to be sent.
+ */
+struct DirtyTracker {
+    /* Last framebuffer passed to Dirty_Update */
+    uint8_t* Previous;
+    bool HavePrevious;
+
+    /* Result of the last Dirty_Update */
+    struct ANM_DirtyRect* Rects;
+
+    /* Indices of the rectangles that reach the page being scanned, and the page after it */
+    int* Active;
+    int* Next;
+
+    int Width;
+    int Height;
+};
+
+bool Dirty_Create( struct DirtyTracker* Tracker, int Width, int Height );
+void Dirty_Free( struct DirtyTracker* Tracker );
+int Dirty_Update( struct DirtyTracker* Tracker, const uint8_t* Current );
+
+#endif
@@ -0,0 +1,595 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "dither.h"
+
+#if defined( __SSE2__ )
+#define DITHER_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Native replacements for FreeImage_Threshold and the ordered modes of FreeImage_Dither.
+ *
+ * Every mode boils down to comparing each greyscale pixel against a per-position threshold,
+ * so the matrices are expanded once into full rows of thresholds and the per-frame work is
+ * a straight compare of two byte arrays, packed 8 pixels to a byte.
+ *
+ * The matrices and rounding below follow FreeImage's Halftoning.cpp exactly so the
+ * results are bit identical; use --selfcheck to compare against FreeImage.
+ *
+ * The error diffusion kernels FreeImage doesn't have are done here as well, see DiffuseFrame.
+ * So is temporal dithering, which no FreeImage mode can do, see StabilisePixel.
+ */
+
+/* Clustered dot matrices, from FreeImage */
+static const int Cluster6x6[ 36 ] = {
+    34, 29, 17, 21, 30, 35,
+    28, 14,  9, 16, 20, 31,
+    13,  8,  4,  5, 15, 19,
+    12,  3,  0,  1, 10, 18,
+    27,  7,  2,  6, 23, 24,
+    33, 26, 11, 22, 25, 32
+};
+
+static const int Cluster8x8[ 64 ] = {
+     3,  9, 17, 27, 25, 15,  7,  1,
+    11, 29, 38, 46, 44, 36, 23,  5,
+    21, 33, 52, 58, 56, 48, 42, 13,
+    31, 40, 54, 62, 60, 50, 34, 19,
+    30, 45, 55, 63, 61, 51, 35, 18,
+    20, 41, 53, 59, 57, 49, 39, 14,
+    10, 28, 47, 37, 43, 32, 22,  6,
+     2,  8, 16, 26, 24, 12,  4,  0
+};
+
+static const int Cluster16x16[ 256 ] = {
+      4,  12,  24,  44,  72, 100, 136, 152, 150, 134,  98,  70,  42,  23,  11,   3,
+      7,  16,  32,  52,  76, 104, 144, 160, 158, 142, 102,  74,  50,  31,  15,   6,
+     19,  27,  40,  60,  92, 132, 168, 180, 178, 166, 130,  90,  58,  39,  26,  18,
+     36,  48,  56,  80, 124, 176, 188, 204, 203, 187, 175, 122,  79,  55,  47,  35,
+     64,  68,  84, 116, 164, 200, 212, 224, 223, 211, 199, 162, 114,  83,  67,  63,
+     88,  96, 112, 156, 192, 216, 232, 240, 239, 231, 214, 190, 154, 111,  95,  87,
+    108, 120, 148, 184, 208, 228, 244, 252, 251, 243, 226, 206, 182, 147, 119, 107,
+    128, 140, 172, 196, 219, 235, 247, 256, 255, 246, 234, 218, 194, 171, 139, 127,
+    126, 138, 170, 195, 220, 236, 248, 253, 254, 245, 233, 217, 193, 169, 137, 125,
+    106, 118, 146, 183, 207, 227, 242, 249, 250, 241, 225, 205, 181, 145, 117, 105,
+     86,  94, 110, 155, 191, 215, 229, 238, 237, 230, 213, 189, 153, 109,  93,  85,
+     62,  66,  82, 115, 163, 198, 210, 221, 222, 209, 197, 161, 113,  81,  65,  61,
+     34,  46,  54,  78, 123, 174, 186, 202, 201, 185, 173, 121,  77,  53,  45,  33,
+     20,  28,  37,  59,  91, 131, 167, 179, 177, 165, 129,  89,  57,  38,  25,  17,
+      8,  13,  29,  51,  75, 103, 143, 159, 157, 141, 101,  73,  49,  30,  14,   5,
+      1,   9,  21,  43,  71,  99, 135, 151, 149, 133,  97,  69,  41,  22,  10,   2
+};
+
+/*
+ * Error diffusion kernels: how much of a pixel's error goes to each of its neighbours,
+ * out of (Divisor). The first row is the current one where only pixels after the current
+ * one get any, the others are the rows below, centred on the current pixel.
+ * Atkinson only passes on 6/8 of the error on purpose.
+ */
+struct DiffusionKernel {
+    int Algorithm;
+    int Rows;
+    int Divisor;
+    int Weights[ 3 ][ 5 ];
+};
+
+static const struct DiffusionKernel Kernels[ ] = {
+    { Dither_Atkinson, 3, 8, {
+        { 0, 0, 0, 1, 1 },
+        { 0, 1, 1, 1, 0 },
+        { 0, 0, 1, 0, 0 }
+    } },
+    { Dither_Sierra, 3, 32, {
+        { 0, 0, 0, 5, 3 },
+        { 2, 4, 5, 4, 2 },
+        { 0, 2, 3, 2, 0 }
+    } },
+    { Dither_SierraLite, 2, 4, {
+        { 0, 0, 0, 2, 0 },
+        { 0, 1, 1, 0, 0 },
+        { 0, 0, 0, 0, 0 }
+    } },
+    { Dither_JarvisJudiceNinke, 3, 48, {
+        { 0, 0, 0, 7, 5 },
+        { 3, 5, 7, 5, 3 },
+        { 1, 3, 5, 3, 1 }
+    } },
+    { Dither_Stucki, 3, 42, {
+        { 0, 0, 0, 8, 4 },
+        { 2, 4, 8, 4, 2 },
+        { 1, 2, 4, 2, 1 }
+    } },
+    { Dither_FloydSteinberg, 2, 16, {
+        { 0, 0, 0, 7, 0 },
+        { 0, 3, 5, 1, 0 },
+        { 0, 0, 0, 0, 0 }
+    } }
+};
+
+/* Kernels reach this many pixels to either side, error rows are padded by as much */
+#define KernelReach 2
+
+/* Accumulated errors are 16.16 fixed point, kernel weights are 4.12 and get multiplied by errors in 12.4 */
+#define ErrorShift 16
+#define WeightShift 12
+
+struct DiffusionTap {
+    int Row;
+    int Offset;
+    int32_t Weight;
+};
+
+/*
+ * Bayer matrix value at (x,y) for a matrix of 2^Order by 2^Order.
+ */
+static int DitherValue( int x, int y, int Order ) {
+    int d = 0;
+
+    while ( Order-- > 0 ) {
+        d = ( d << 1 | ( ( x & 1 ) ^ ( y & 1 ) ) ) << 1 | ( y & 1 );
+        x >>= 1;
+        y >>= 1;
+    }
+
+    return d;
+}
+
+/*
+ * Returns the minimum value a pixel at (x,y) of the matrix must have to be set.
+ * Can be anywhere from 0 (always set) to above 255 (never set).
+ */
+static int GetThreshold( bool DitherEnabled, FREE_IMAGE_DITHER Algorithm, int Threshold, int x, int y ) {
+    int Order = 0;
+    int l = 0;
+
+    if ( DitherEnabled == false ) {
+        /* FreeImage_Threshold: set if >= T */
+        return Threshold;
+    }
+
+    switch ( Algorithm ) {
+        case FID_BAYER4x4: Order = 2; break;
+        case FID_BAYER8x8: Order = 3; break;
+        case FID_BAYER16x16: Order = 4; break;
+        case FID_CLUSTER6x6: Order = 3; break;
+        case FID_CLUSTER8x8: Order = 4; break;
+        case FID_CLUSTER16x16: Order = 8; break;
+        default: return 256;
+    };
+
+    switch ( Algorithm ) {
+        case FID_BAYER4x4:
+        case FID_BAYER8x8:
+        case FID_BAYER16x16: {
+            /* Dispersed dot: set if > matrix value */
+            l = 1 << Order;
+            return ( uint8_t ) ( 255 * ( ( ( double ) DitherValue( y, x, Order ) + 0.5 ) / ( l * l ) ) ) + 1;
+        }
+        case FID_CLUSTER6x6: {
+            /* Clustered dot: set if >= scaled matrix value */
+            l = 2 * Order;
+            return Cluster6x6[ y + ( l * x ) ] * ( 256 / ( l * Order ) );
+        }
+        case FID_CLUSTER8x8: {
+            l = 2 * Order;
+            return Cluster8x8[ y + ( l * x ) ] * ( 256 / ( l * Order ) );
+        }
+        case FID_CLUSTER16x16: {
+            l = 2 * Order;
+            return Cluster16x16[ y + ( l * x ) ] * ( 256 / ( l * Order ) );
+        }
+        default: break;
+    };
+
+    return 256;
+}
+
+static int GetMatrixSize( bool DitherEnabled, FREE_IMAGE_DITHER Algorithm ) {
+    if ( DitherEnabled == true ) {
+        switch ( Algorithm ) {
+            case FID_BAYER4x4: return 4;
+            case FID_BAYER8x8: return 8;
+            case FID_BAYER16x16: return 16;
+            case FID_CLUSTER6x6: return 6;
+            case FID_CLUSTER8x8: return 8;
+            case FID_CLUSTER16x16: return 16;
+            default: return 0;
+        };
+    }
+
+    return 1;
+}
+
+static const struct DiffusionKernel* GetKernel( bool DitherEnabled, FREE_IMAGE_DITHER Algorithm ) {
+    int i = 0;
+
+    if ( DitherEnabled == true ) {
+        for ( i = 0; i < ( int ) ( sizeof( Kernels ) / sizeof( Kernels[ 0 ] ) ); i++ ) {
+            if ( Kernels[ i ].Algorithm == ( int ) Algorithm ) {
+                return &Kernels[ i ];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns true if the given mode can be handled here rather than by FreeImage.
+ * Floyd-Steinberg is left to FreeImage.
+ */
+bool Dither_IsNative( bool DitherEnabled, FREE_IMAGE_DITHER Algorithm ) {
+    return ( GetMatrixSize( DitherEnabled, Algorithm ) > 0 || GetKernel( DitherEnabled, Algorithm ) != NULL ) ? true : false;
+}
+
+/*
+ * Returns true if FreeImage can do the same conversion, which --selfcheck compares against.
+ */
+bool Dither_HasReference( bool DitherEnabled, FREE_IMAGE_DITHER Algorithm ) {
+    return ( GetKernel( DitherEnabled, Algorithm ) == NULL ) ? true : false;
+}
+
+/*
+ * Builds the threshold tables for images (Width) pixels wide.
+ * Returns false if the mode is not supported or we ran out of memory.
+ */
+bool Dither_CreatePlan( struct DitherPlan* Plan, bool DitherEnabled, FREE_IMAGE_DITHER Algorithm, int Threshold, int Width ) {
+    int Value = 0;
+    int x = 0;
+    int y = 0;
+
+    NullCheck( Plan, return false );
+
+    memset( Plan, 0, sizeof( struct DitherPlan ) );
+
+    Plan->Width = Width;
+
+    if ( ( Plan->Kernel = GetKernel( DitherEnabled, Algorithm ) ) != NULL ) {
+        Plan->Errors = ( int32_t* ) calloc( Plan->Kernel->Rows * ( Width + ( KernelReach * 2 ) ), sizeof( int32_t ) );
+        return ( Plan->Errors != NULL ) ? true : false;
+    }
+
+    if ( ( Plan->Size = GetMatrixSize( DitherEnabled, Algorithm ) ) == 0 ) {
+        return false;
+    }
+
+    Plan->Thresholds = ( uint8_t* ) malloc( Plan->Size * Width );
+    Plan->Flips = ( uint8_t* ) malloc( Plan->Size * Width );
+
+    if ( Plan->Thresholds == NULL || Plan->Flips == NULL ) {
+        Dither_FreePlan( Plan );
+        return false;
+    }
+
+    for ( y = 0; y < Plan->Size; y++ ) {
+        for ( x = 0; x < Width; x++ ) {
+            Value = GetThreshold( DitherEnabled, Algorithm, Threshold, x % Plan->Size, y );
+
+            /* A byte can't hold 256, but "never set" is the same as "always set" flipped */
+            if ( Value > 255 ) {
+                Plan->Thresholds[ ( y * Width ) + x ] = 0;
+                Plan->Flips[ ( y * Width ) + x ] = 0xFF;
+            } else {
+                Plan->Thresholds[ ( y * Width ) + x ] = ( uint8_t ) ( Value < 0 ? 0 : Value );
+                Plan->Flips[ ( y * Width ) + x ] = 0x00;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Makes every frame dithered with (Plan) start from the one before it:
+ * a pixel keeps its last value until its grey level has moved more than (Hysteresis)
+ * away from the level it was set at. Frames must be dithered in order.
+ */
+void Dither_SetTemporal( struct DitherPlan* Plan, int Hysteresis ) {
+    NullCheck( Plan, return );
+
+    Plan->Temporal = true;
+    Plan->Hysteresis = Hysteresis;
+    Plan->HaveHistory = false;
+}
+
+/*
+ * Makes the next frame start over, for when the previous one belongs to another animation.
+ */
+void Dither_ResetHistory( struct DitherPlan* Plan ) {
+    NullCheck( Plan, return );
+    Plan->HaveHistory = false;
+}
+
+/*
+ * Makes sure there is history for (Size) pixels, frames of a different size start over.
+ */
+static bool PrepareHistory( struct DitherPlan* Plan, size_t Size ) {
+    if ( Plan->HistorySize != Size ) {
+        if ( Plan->Levels != NULL ) {
+            free( Plan->Levels );
+        }
+
+        Plan->HistorySize = 0;
+        Plan->HaveHistory = false;
+
+        NullCheck( ( Plan->Levels = ( uint8_t* ) malloc( Size * 2 ) ), return false );
+
+        Plan->Decisions = &Plan->Levels[ Size ];
+        Plan->HistorySize = Size;
+    }
+
+    return true;
+}
+
+/*
+ * Temporal dithering: pixel (i) keeps what it was last set to unless its grey level (Level)
+ * has moved by more than the hysteresis since, otherwise (Set) becomes its new value.
+ * Measuring from the level the pixel was last set at, rather than the previous frame,
+ * means slow fades still get through.
+ */
+static inline bool StabilisePixel( struct DitherPlan* Plan, size_t i, uint8_t Level, bool Set ) {
+    if ( Plan->HaveHistory == true && abs( ( int ) Level - ( int ) Plan->Levels[ i ] ) <= Plan->Hysteresis ) {
+        return ( Plan->Decisions[ i ] != 0 ) ? true : false;
+    }
+
+    Plan->Levels[ i ] = Level;
+    Plan->Decisions[ i ] = ( Set == true ) ? 1 : 0;
+
+    return Set;
+}
+
+/*
+ * Runs a thresholded/ordered row of 1bpp output for scanline (y) through StabilisePixel.
+ */
+static void StabiliseRow( struct DitherPlan* Plan, const uint8_t* Line, uint8_t GreyXor, int y, uint8_t* Out ) {
+    size_t Index = ( size_t ) y * Plan->Width;
+    uint8_t Mask = 0;
+    bool Set = false;
+    int x = 0;
+
+    for ( x = 0; x < Plan->Width; x++ ) {
+        Mask = ( uint8_t ) ( 0x80 >> ( x & 7 ) );
+        Set = ( Out[ x >> 3 ] & Mask ) ? true : false;
+
+        if ( StabilisePixel( Plan, Index + x, Line[ x ] ^ GreyXor, Set ) == true ) {
+            Out[ x >> 3 ] |= Mask;
+        } else {
+            Out[ x >> 3 ] &= ( uint8_t ) ~Mask;
+        }
+    }
+}
+
+void Dither_FreePlan( struct DitherPlan* Plan ) {
+    if ( Plan != NULL ) {
+        if ( Plan->Thresholds != NULL ) {
+            free( Plan->Thresholds );
+        }
+
+        if ( Plan->Flips != NULL ) {
+            free( Plan->Flips );
+        }
+
+        if ( Plan->Errors != NULL ) {
+            free( Plan->Errors );
+        }
+
+        if ( Plan->Levels != NULL ) {
+            free( Plan->Levels );
+        }
+
+        memset( Plan, 0, sizeof( struct DitherPlan ) );
+    }
+}
+
+static uint8_t ReverseBits( uint8_t Byte ) {
+    Byte = ( uint8_t ) ( ( Byte & 0xF0 ) >> 4 | ( Byte & 0x0F ) << 4 );
+    Byte = ( uint8_t ) ( ( Byte & 0xCC ) >> 2 | ( Byte & 0x33 ) << 2 );
+    Byte = ( uint8_t ) ( ( Byte & 0xAA ) >> 1 | ( Byte & 0x55 ) << 1 );
+
+    return Byte;
+}
+
+/*
+ * Compares (Count) pixels starting at (x) and packs them MSB first into (Bits).
+ * Count must be a multiple of 8.
+ */
+static void DitherSpan( const uint8_t* Grey, const uint8_t* Thresholds, const uint8_t* Flips, uint8_t GreyXor, int x, int Count, uint8_t* Bits ) {
+    uint8_t Byte = 0;
+    int End = x + Count;
+    int i = 0;
+
+    for ( ; x < End; x+= 8 ) {
+        Byte = 0;
+
+        for ( i = 0; i < 8; i++ ) {
+            Byte |= ( uint8_t ) ( ( ( ( Grey[ x + i ] ^ GreyXor ) >= Thresholds[ x + i ] ) ^ ( Flips[ x + i ] & 1 ) ) << ( 7 - i ) );
+        }
+
+        Bits[ x / 8 ] = Byte;
+    }
+}
+
+#if defined( DITHER_SSE2 )
+
+/*
+ * 16 pixels at a time: unsigned >= is max( a, b ) == a and movemask collects the results.
+ * movemask puts the leftmost pixel in the LSB so each byte gets reversed on the way out.
+ */
+static int DitherSpanSSE2( const uint8_t* Grey, const uint8_t* Thresholds, const uint8_t* Flips, uint8_t GreyXor, int Width, uint8_t* Bits ) {
+    const __m128i XorMask = _mm_set1_epi8( ( char ) GreyXor );
+    __m128i Pixels;
+    __m128i Limits;
+    int Mask = 0;
+    int x = 0;
+
+    for ( x = 0; x + 16 <= Width; x+= 16 ) {
+        Pixels = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* ) &Grey[ x ] ), XorMask );
+        Limits = _mm_loadu_si128( ( const __m128i* ) &Thresholds[ x ] );
+
+        Pixels = _mm_cmpeq_epi8( _mm_max_epu8( Pixels, Limits ), Pixels );
+        Mask = _mm_movemask_epi8( _mm_xor_si128( Pixels, _mm_loadu_si128( ( const __m128i* ) &Flips[ x ] ) ) );
+
+        Bits[ x / 8 ] = ReverseBits( ( uint8_t ) Mask );
+        Bits[ ( x / 8 ) + 1 ] = ReverseBits( ( uint8_t ) ( Mask >> 8 ) );
+    }
+
+    return x;
+}
+
+#endif
+
+/*
+ * Turns the kernel weights into fixed point taps, skipping the empty ones.
+ * Returns the number of taps.
+ */
+static int GetTaps( const struct DiffusionKernel* Kernel, struct DiffusionTap* Taps ) {
+    int Count = 0;
+    int x = 0;
+    int y = 0;
+
+    for ( y = 0; y < Kernel->Rows; y++ ) {
+        for ( x = 0; x < 5; x++ ) {
+            if ( Kernel->Weights[ y ][ x ] != 0 ) {
+                Taps[ Count ].Row = y;
+                Taps[ Count ].Offset = x - KernelReach;
+                Taps[ Count ].Weight = ( ( Kernel->Weights[ y ][ x ] << WeightShift ) + ( Kernel->Divisor / 2 ) ) / Kernel->Divisor;
+                Count++;
+            }
+        }
+    }
+
+    return Count;
+}
+
+/*
+ * Serpentine error diffusion: rows go top to bottom, alternating left to right and right to left
+ * with the kernel mirrored to match. Only as many rows of error as the kernel covers are kept,
+ * as a ring, and the row just finished is cleared to become the last row of the kernel.
+ */
+static void DiffuseFrame( struct DitherPlan* Plan, const uint8_t* Grey, int GreyPitch, uint8_t GreyXor, int Height, uint8_t* Bits, int BitsPitch, bool Temporal ) {
+    const struct DiffusionKernel* Kernel = Plan->Kernel;
+    struct DiffusionTap Taps[ 15 ];
+    int32_t* ErrorRows[ 3 ];
+    int RowSize = Plan->Width + ( KernelReach * 2 );
+    int Width = Plan->Width;
+    int TapCount = 0;
+    const uint8_t* Line = NULL;
+    uint8_t* Out = NULL;
+    int32_t Value = 0;
+    int32_t Error = 0;
+    uint8_t Level = 0;
+    bool Set = false;
+    int Direction = 0;
+    int Row = 0;
+    int x = 0;
+    int i = 0;
+    int t = 0;
+
+    TapCount = GetTaps( Kernel, Taps );
+    memset( Plan->Errors, 0, sizeof( int32_t ) * RowSize * Kernel->Rows );
+
+    for ( Row = 0; Row < Height; Row++ ) {
+        /* Scanlines are bottom-up */
+        Line = Grey + ( ( ptrdiff_t ) ( Height - 1 - Row ) * GreyPitch );
+        Out = Bits + ( ( ptrdiff_t ) ( Height - 1 - Row ) * BitsPitch );
+
+        for ( i = 0; i < Kernel->Rows; i++ ) {
+            ErrorRows[ i ] = &Plan->Errors[ ( ( Row + i ) % Kernel->Rows ) * RowSize + KernelReach ];
+        }
+
+        Direction = ( Row & 1 ) ? -1 : 1;
+        x = ( Direction == 1 ) ? 0 : Width - 1;
+
+        memset( Out, 0, Width / 8 );
+
+        for ( i = 0; i < Width; i++, x+= Direction ) {
+            Level = Line[ x ] ^ GreyXor;
+            Value = ( ( int32_t ) Level << ErrorShift ) + ErrorRows[ 0 ][ x ];
+            Set = ( Value >= ( 128 << ErrorShift ) ) ? true : false;
+
+            /* A pixel that keeps its old value still passes on its error against that value */
+            if ( Temporal == true ) {
+                Set = StabilisePixel( Plan, ( size_t ) ( Height - 1 - Row ) * Width + x, Level, Set );
+            }
+
+            if ( Set == true ) {
+                Out[ x >> 3 ] |= ( uint8_t ) ( 0x80 >> ( x & 7 ) );
+                Value-= ( 255 << ErrorShift );
+            }
+
+            Error = ( Value + ( 1 << ( WeightShift - 1 ) ) ) >> WeightShift;
+
+            for ( t = 0; t < TapCount; t++ ) {
+                ErrorRows[ Taps[ t ].Row ][ x + ( Taps[ t ].Offset * Direction ) ]+= Error * Taps[ t ].Weight;
+            }
+        }
+
+        memset( ErrorRows[ 0 ] - KernelReach, 0, sizeof( int32_t ) * RowSize );
+    }
+}
+
+/*
+ * Thresholds/dithers a greyscale image into a 1bpp, MSB first bitmap.
+ * Grey and Bits are indexed by FreeImage scanline (bottom-up), since that is what
+ * the ordered matrices are aligned to. Either pitch may be negative.
+ * Every pixel is XORed with (GreyXor) first which is how the invert option is applied.
+ */
+void Dither_Frame( struct DitherPlan* Plan, const uint8_t* Grey, int GreyPitch, uint8_t GreyXor, int Height, uint8_t* Bits, int BitsPitch ) {
+    const uint8_t* Thresholds = NULL;
+    const uint8_t* Flips = NULL;
+    const uint8_t* Line = NULL;
+    uint8_t* Out = NULL;
+    bool Temporal = false;
+    int Width = 0;
+    int x = 0;
+    int y = 0;
+
+    NullCheck( Plan, return );
+    NullCheck( Grey, return );
+    NullCheck( Bits, return );
+
+    /* Without memory for the history this frame is dithered on its own */
+    Temporal = ( Plan->Temporal == true && PrepareHistory( Plan, ( size_t ) Plan->Width * Height ) == true ) ? true : false;
+
+    if ( Plan->Kernel != NULL ) {
+        DiffuseFrame( Plan, Grey, GreyPitch, GreyXor, Height, Bits, BitsPitch, Temporal );
+        Plan->HaveHistory = Temporal;
+        return;
+    }
+
+    Width = Plan->Width;
+
+    for ( y = 0; y < Height; y++ ) {
+        Thresholds = &Plan->Thresholds[ ( y % Plan->Size ) * Width ];
+        Flips = &Plan->Flips[ ( y % Plan->Size ) * Width ];
+        Line = Grey + ( ( ptrdiff_t ) y * GreyPitch );
+        Out = Bits + ( ( ptrdiff_t ) y * BitsPitch );
+        x = 0;
+
+#if defined( DITHER_SSE2 )
+        x = DitherSpanSSE2( Line, Thresholds, Flips, GreyXor, Width, Out );
+#endif
+
+        DitherSpan( Line, Thresholds, Flips, GreyXor, x, Width - x, Out );
+
+        if ( Temporal == true ) {
+            StabiliseRow( Plan, Line, GreyXor, y, Out );
+        }
+    }
+
+    Plan->HaveHistory = Temporal;
+}
@@ -0,0 +1,61 @@
+#ifndef _DITHER_H_
+#define _DITHER_H_
+
+/*
+ * Error diffusion kernels FreeImage doesn't have. They are numbered past the
+ * FREE_IMAGE_DITHER values so either can be stored as the dither algorithm.
+ */
+enum {
+    Dither_Atkinson = 0x100,
+    Dither_Sierra,
+    Dither_SierraLite,
+    Dither_JarvisJudiceNinke,
+    Dither_Stucki,
+
+    /* Only used for temporal dithering, which FreeImage's Floyd-Steinberg can't do */
+    Dither_FloydSteinberg
+};
+
+struct DiffusionKernel;
+
+/*
+ * Threshold tables for the native threshold/ordered dither engine.
+ * Built once for a given image width and reused for every frame.
+ */
+struct DitherPlan {
+    /* (Size) rows of (Width) thresholds, a pixel is set if it is >= its threshold */
+    uint8_t* Thresholds;
+
+    /* (Size) rows of (Width) 0x00/0xFF masks to flip the result with */
+    uint8_t* Flips;
+
+    /* Dither matrix dimensions, 1 for a plain threshold */
+    int Size;
+    int Width;
+
+    /* Error diffusion only, instead of the tables above:
+     * the kernel and a ring of (Kernel->Rows) rows of fixed point errors.
+     */
+    const struct DiffusionKernel* Kernel;
+    int32_t* Errors;
+
+    /* Temporal dithering, see Dither_SetTemporal:
+     * the grey level every pixel was last decided at and what was decided, by FreeImage scanline.
+     */
+    bool Temporal;
+    int Hysteresis;
+    uint8_t* Levels;
+    uint8_t* Decisions;
+    size_t HistorySize;
+    bool HaveHistory;
+};
+
+bool Dither_IsNative( bool DitherEnabled, FREE_IMAGE_DITHER Algorithm );
+bool Dither_HasReference( bool DitherEnabled, FREE_IMAGE_DITHER Algorithm );
+bool Dither_CreatePlan( struct DitherPlan* Plan, bool DitherEnabled, FREE_IMAGE_DITHER Algorithm, int Threshold, int Width );
+void Dither_SetTemporal( struct DitherPlan* Plan, int Hysteresis );
+void Dither_ResetHistory( struct DitherPlan* Plan );
+void Dither_FreePlan( struct DitherPlan* Plan );
+void Dither_Frame( struct DitherPlan* Plan, const uint8_t* Grey, int GreyPitch, uint8_t GreyXor, int Height, uint8_t* Bits, int BitsPitch );
+
+#endif
@@ -0,0 +1,411 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "options.h"
+#include "output.h"
+#include "pack.h"
+#include "gif.h"
+
+/* Pixel values are colour table indices: the two colours, and one for pixels that did not change.
+ * LZW needs a minimum code size of 2 for that, which also leaves room for a fourth, unused, value.
+ */
+#define TransparentIndex 2
+#define MinCodeSize 2
+#define ClearCode ( 1 << MinCodeSize )
+#define EndCode ( ClearCode + 1 )
+#define MaxCodeSize 12
+#define MaxCodes ( 1 << MaxCodeSize )
+
+/* Disposal method 1: leave the frame in place for the next one to draw over */
+#define DisposeNone ( 1 << 2 )
+
+static void PutByte( struct GIFEncoder* Encoder, uint8_t Value ) {
+    Encoder->Block[ Encoder->BlockSize++ ] = Value;
+
+    if ( Encoder->BlockSize == sizeof( Encoder->Block ) ) {
+        fputc( Encoder->BlockSize, Encoder->File );
+        fwrite( Encoder->Block, 1, Encoder->BlockSize, Encoder->File );
+
+        Encoder->BlockSize = 0;
+    }
+}
+
+static void PutWord( FILE* File, uint16_t Value ) {
+    fputc( Value & 0xFF, File );
+    fputc( ( Value >> 8 ) & 0xFF, File );
+}
+
+static void ResetCodes( struct GIFEncoder* Encoder ) {
+    memset( Encoder->Codes, 0, sizeof( Encoder->Codes[ 0 ] ) * MaxCodes );
+
+    Encoder->NextCode = EndCode + 1;
+    Encoder->CodeSize = MinCodeSize + 1;
+}
+
+/*
+ * Writes (Code) at the current code size, which grows as soon as the next string added
+ * to the table would not fit. Decoders make the same decision after reading each code.
+ */
+static void PutCode( struct GIFEncoder* Encoder, int Code ) {
+    Encoder->Bits|= ( uint32_t ) Code << Encoder->BitCount;
+    Encoder->BitCount+= Encoder->CodeSize;
+
+    while ( Encoder->BitCount >= 8 ) {
+        PutByte( Encoder, ( uint8_t ) ( Encoder->Bits & 0xFF ) );
+
+        Encoder->Bits>>= 8;
+        Encoder->BitCount-= 8;
+    }
+
+    if ( Code == ClearCode ) {
+        ResetCodes( Encoder );
+    } else if ( Encoder->NextCode >= ( 1 << Encoder->CodeSize ) && Encoder->CodeSize < MaxCodeSize ) {
+        Encoder->CodeSize++;
+    }
+}
+
+static void StartImageData( struct GIFEncoder* Encoder ) {
+    fputc( MinCodeSize, Encoder->File );
+
+    Encoder->Bits = 0;
+    Encoder->BitCount = 0;
+    Encoder->BlockSize = 0;
+    Encoder->Prefix = -1;
+    Encoder->CodeSize = MinCodeSize + 1;
+
+    PutCode( Encoder, ClearCode );
+}
+
+static void EncodePixel( struct GIFEncoder* Encoder, int Value ) {
+    uint16_t Next = 0;
+
+    if ( Encoder->Prefix < 0 ) {
+        Encoder->Prefix = Value;
+        return;
+    }
+
+    if ( ( Next = Encoder->Codes[ Encoder->Prefix ][ Value ] ) != 0 ) {
+        Encoder->Prefix = Next;
+        return;
+    }
+
+    PutCode( Encoder, Encoder->Prefix );
+
+    if ( Encoder->NextCode < MaxCodes ) {
+        Encoder->Codes[ Encoder->Prefix ][ Value ] = ( uint16_t ) Encoder->NextCode++;
+    } else {
+        PutCode( Encoder, ClearCode );
+    }
+
+    Encoder->Prefix = Value;
+}
+
+static void EndImageData( struct GIFEncoder* Encoder ) {
+    if ( Encoder->Prefix >= 0 ) {
+        PutCode( Encoder, Encoder->Prefix );
+    }
+
+    PutCode( Encoder, EndCode );
+
+    if ( Encoder->BitCount > 0 ) {
+        PutByte( Encoder, ( uint8_t ) ( Encoder->Bits & 0xFF ) );
+    }
+
+    if ( Encoder->BlockSize > 0 ) {
+        fputc( Encoder->BlockSize, Encoder->File );
+        fwrite( Encoder->Block, 1, Encoder->BlockSize, Encoder->File );
+    }
+
+    /* Block terminator */
+    fputc( 0, Encoder->File );
+}
+
+/*
+ * Sets up (Encoder) to write (Width)x(Height) frames to (File), which must be open for writing.
+ * Frames are turned by (Rotation), one of the Rotate_* values, and mirrored if (Mirror) is set
+ * on their way in, (Width) and (Height) are their size after that.
+ */
+bool GIF_Create( struct GIFEncoder* Encoder, FILE* File, int Width, int Height, int Rotation, bool Mirror ) {
+    size_t Size = ( ( size_t ) Width * Height ) / 8;
+
+    NullCheck( Encoder, return false );
+    NullCheck( File, return false );
+
+    memset( Encoder, 0, sizeof( struct GIFEncoder ) );
+
+    Encoder->File = File;
+    Encoder->Width = Width;
+    Encoder->Height = Height;
+    Encoder->RowSize = ( size_t ) Width / 8;
+    Encoder->Rotation = Rotation;
+    Encoder->Mirror = Mirror;
+
+    /* Frames on their side come in the other way round */
+    Encoder->FrameWidth = ( Rotation == Rotate_90 || Rotation == Rotate_270 ) ? Height : Width;
+    Encoder->FrameHeight = ( Rotation == Rotate_90 || Rotation == Rotate_270 ) ? Width : Height;
+
+    /* Until the first frame says otherwise */
+    memset( Encoder->Colours[ 1 ], 0xFF, 3 );
+
+    Encoder->Previous = ( uint8_t* ) malloc( Size );
+    Encoder->Current = ( uint8_t* ) malloc( Size );
+    Encoder->Columns = ( uint8_t* ) malloc( Encoder->RowSize );
+    Encoder->Codes = ( uint16_t ( * )[ 4 ] ) malloc( sizeof( Encoder->Codes[ 0 ] ) * MaxCodes );
+
+    if ( Encoder->Previous == NULL || Encoder->Current == NULL || Encoder->Columns == NULL || Encoder->Codes == NULL ) {
+        GIF_Free( Encoder );
+        return false;
+    }
+
+    return true;
+}
+
+void GIF_Free( struct GIFEncoder* Encoder ) {
+    if ( Encoder != NULL ) {
+        if ( Encoder->Previous != NULL ) {
+            free( Encoder->Previous );
+        }
+
+        if ( Encoder->Current != NULL ) {
+            free( Encoder->Current );
+        }
+
+        if ( Encoder->Columns != NULL ) {
+            free( Encoder->Columns );
+        }
+
+        if ( Encoder->Codes != NULL ) {
+            free( Encoder->Codes );
+        }
+
+        memset( Encoder, 0, sizeof( struct GIFEncoder ) );
+    }
+}
+
+/*
+ * Screen descriptor, a global colour table of the two colours with the transparent entry after them,
+ * and the NETSCAPE2.0 extension so the animation loops forever.
+ */
+static void WriteHeader( struct GIFEncoder* Encoder ) {
+    static const uint8_t Loop[ ] = { 0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00 };
+    static const uint8_t Unused[ 6 ] = { 0 };
+
+    fwrite( "GIF89a", 1, 6, Encoder->File );
+    PutWord( Encoder->File, ( uint16_t ) Encoder->Width );
+    PutWord( Encoder->File, ( uint16_t ) Encoder->Height );
+
+    /* Global colour table of 4 entries, 8 bits per primary */
+    fputc( 0xF1, Encoder->File );
+    fputc( 0, Encoder->File );
+    fputc( 0, Encoder->File );
+
+    fwrite( Encoder->Colours, 1, sizeof( Encoder->Colours ), Encoder->File );
+    fwrite( Unused, 1, sizeof( Unused ), Encoder->File );
+
+    fwrite( Loop, 1, sizeof( Loop ), Encoder->File );
+}
+
+/*
+ * Copies (Bitmap) into Encoder->Current, top-down and with each pixel being the index of
+ * the closer of the two colours of the first frame. Turning and mirroring it is done by the
+ * linear packing kernels, which have the same layout.
+ */
+static void ReadFrame( struct GIFEncoder* Encoder, FIBITMAP* Bitmap ) {
+    const RGBQUAD* Palette = FreeImage_GetPalette( Bitmap );
+    uint8_t Fill[ 2 ] = { 0x00, 0xFF };
+    int Luma[ 2 ] = { 0, 255 };
+    int Target = 0;
+    int i = 0;
+
+    for ( i = 0; i < 2; i++ ) {
+        Luma[ i ] = ( Encoder->Colours[ i ][ 0 ] + Encoder->Colours[ i ][ 1 ] + Encoder->Colours[ i ][ 2 ] ) / 3;
+    }
+
+    /* Each bit value gets the byte pattern of the global index it maps to */
+    for ( i = 0; i < 2 && Palette != NULL; i++ ) {
+        Target = ( Palette[ i ].rgbRed + Palette[ i ].rgbGreen + Palette[ i ].rgbBlue ) / 3;
+        Fill[ i ] = ( abs( Target - Luma[ 0 ] ) <= abs( Target - Luma[ 1 ] ) ) ? 0x00 : 0xFF;
+    }
+
+    /* Both bit values on the same index leave nothing to copy */
+    if ( Fill[ 0 ] == Fill[ 1 ] ) {
+        memset( Encoder->Current, Fill[ 0 ], Encoder->RowSize * Encoder->Height );
+        return;
+    }
+
+    /* Scanlines are bottom-up, start at the top one */
+    Pack_Frame(
+        FreeImage_GetScanLine( Bitmap, Encoder->FrameHeight - 1 ),
+        -( int ) FreeImage_GetPitch( Bitmap ),
+        Encoder->FrameWidth,
+        Encoder->FrameHeight,
+        Format_Linear,
+        Encoder->Rotation,
+        Encoder->Mirror,
+        ( Fill[ 0 ] == 0xFF ) ? true : false,
+        Encoder->Current
+    );
+}
+
+static int GetPixel( const uint8_t* Frame, size_t RowSize, int x, int y ) {
+    return ( Frame[ ( y * RowSize ) + ( x >> 3 ) ] >> ( 7 - ( x & 7 ) ) ) & 1;
+}
+
+/*
+ * Finds the smallest rectangle holding every pixel that changed since the last frame.
+ * Returns false if nothing did.
+ */
+static bool GetChangedRect( struct GIFEncoder* Encoder, int* Left, int* Top, int* Right, int* Bottom ) {
+    const uint8_t* Previous = NULL;
+    const uint8_t* Current = NULL;
+    size_t First = 0;
+    size_t Last = 0;
+    size_t x = 0;
+    int y = 0;
+
+    *Top = -1;
+    memset( Encoder->Columns, 0, Encoder->RowSize );
+
+    for ( y = 0; y < Encoder->Height; y++ ) {
+        Previous = &Encoder->Previous[ y * Encoder->RowSize ];
+        Current = &Encoder->Current[ y * Encoder->RowSize ];
+
+        if ( memcmp( Previous, Current, Encoder->RowSize ) != 0 ) {
+            for ( x = 0; x < Encoder->RowSize; x++ ) {
+                Encoder->Columns[ x ]|= Previous[ x ] ^ Current[ x ];
+            }
+
+            *Top = ( *Top < 0 ) ? y : *Top;
+            *Bottom = y;
+        }
+    }
+
+    if ( *Top < 0 ) {
+        return false;
+    }
+
+    for ( First = 0; Encoder->Columns[ First ] == 0; First++ ) {
+    }
+
+    for ( Last = Encoder->RowSize - 1; Encoder->Columns[ Last ] == 0; Last-- ) {
+    }
+
+    /* Pixels are stored most significant bit first */
+    for ( *Left = ( int ) First * 8; ( Encoder->Columns[ First ] & ( 0x80 >> ( *Left & 7 ) ) ) == 0; ( *Left )++ ) {
+    }
+
+    for ( *Right = ( int ) Last * 8 + 7; ( Encoder->Columns[ Last ] & ( 0x80 >> ( *Right & 7 ) ) ) == 0; ( *Right )-- ) {
+    }
+
+    return true;
+}
+
+/*
+ * Encodes 1bpp (Bitmap), to be shown for (Delay) milliseconds, and writes it out.
+ */
+bool GIF_AddFrame( struct GIFEncoder* Encoder, FIBITMAP* Bitmap, uint32_t Delay ) {
+    uint32_t Hundredths = Delay / 10;
+    uint8_t* Swap = NULL;
+    bool Transparent = false;
+    int Left = 0;
+    int Top = 0;
+    int Right = Encoder->Width - 1;
+    int Bottom = Encoder->Height - 1;
+    int Value = 0;
+    int x = 0;
+    int y = 0;
+
+    NullCheck( Encoder, return false );
+    NullCheck( Encoder->File, return false );
+    NullCheck( Bitmap, return false );
+    CheckExpr( FreeImage_GetBPP( Bitmap ) != 1, return false );
+    CheckExpr( ( int ) FreeImage_GetWidth( Bitmap ) != Encoder->FrameWidth || ( int ) FreeImage_GetHeight( Bitmap ) != Encoder->FrameHeight, return false );
+
+    if ( Encoder->FrameCount == 0 ) {
+        if ( FreeImage_GetPalette( Bitmap ) != NULL ) {
+            for ( x = 0; x < 2; x++ ) {
+                Encoder->Colours[ x ][ 0 ] = FreeImage_GetPalette( Bitmap )[ x ].rgbRed;
+                Encoder->Colours[ x ][ 1 ] = FreeImage_GetPalette( Bitmap )[ x ].rgbGreen;
+                Encoder->Colours[ x ][ 2 ] = FreeImage_GetPalette( Bitmap )[ x ].rgbBlue;
+            }
+        }
+
+        WriteHeader( Encoder );
+    }
+
+    ReadFrame( Encoder, Bitmap );
+
+    /* A frame where nothing changed is a single transparent pixel */
+    if ( Encoder->FrameCount > 0 ) {
+        Transparent = true;
+
+        if ( GetChangedRect( Encoder, &Left, &Top, &Right, &Bottom ) == false ) {
+            Left = Right = Top = Bottom = 0;
+        }
+    }
+
+    /* Graphic control extension */
+    fputc( 0x21, Encoder->File );
+    fputc( 0xF9, Encoder->File );
+    fputc( 0x04, Encoder->File );
+    fputc( DisposeNone | ( ( Transparent == true ) ? 0x01 : 0x00 ), Encoder->File );
+    PutWord( Encoder->File, ( uint16_t ) ( ( Hundredths > 0xFFFF ) ? 0xFFFF : Hundredths ) );
+    fputc( TransparentIndex, Encoder->File );
+    fputc( 0, Encoder->File );
+
+    /* Image descriptor, no local colour table */
+    fputc( 0x2C, Encoder->File );
+    PutWord( Encoder->File, ( uint16_t ) Left );
+    PutWord( Encoder->File, ( uint16_t ) Top );
+    PutWord( Encoder->File, ( uint16_t ) ( ( Right - Left ) + 1 ) );
+    PutWord( Encoder->File, ( uint16_t ) ( ( Bottom - Top ) + 1 ) );
+    fputc( 0, Encoder->File );
+
+    StartImageData( Encoder );
+
+    for ( y = Top; y <= Bottom; y++ ) {
+        for ( x = Left; x <= Right; x++ ) {
+            Value = GetPixel( Encoder->Current, Encoder->RowSize, x, y );
+
+            if ( Transparent == true && Value == GetPixel( Encoder->Previous, Encoder->RowSize, x, y ) ) {
+                Value = TransparentIndex;
+            }
+
+            EncodePixel( Encoder, Value );
+        }
+    }
+
+    EndImageData( Encoder );
+
+    Swap = Encoder->Previous;
+    Encoder->Previous = Encoder->Current;
+    Encoder->Current = Swap;
+    Encoder->FrameCount++;
+
+    return ( ferror( Encoder->File ) == 0 ) ? true : false;
+}
+
+/*
+ * Writes the trailer, the file itself is left to the caller.
+ */
+bool GIF_Finish( struct GIFEncoder* Encoder ) {
+    NullCheck( Encoder, return false );
+    NullCheck( Encoder->File, return false );
+
+    if ( Encoder->FrameCount == 0 ) {
+        WriteHeader( Encoder );
+    }
+
+    fputc( 0x3B, Encoder->File );
+    return ( ferror( Encoder->File ) == 0 ) ? true : false;
+}
@@ -0,0 +1,51 @@
+#ifndef _GIF_H_
+#define _GIF_H_
+
+/*
+ * Streaming GIF89a writer for 1bpp frames.
+ * Frames are LZW encoded and written as soon as they are added, only the last frame is kept
+ * to work out what changed. Every frame after the first only covers the rectangle that changed,
+ * with the pixels in it that did not change left transparent.
+ */
+struct GIFEncoder {
+    FILE* File;
+
+    /* Size of the frames written, after they have been turned */
+    int Width;
+    int Height;
+    size_t RowSize;
+
+    /* One of the Rotate_* values, whether frames are mirrored after turning them, and their size before */
+    int Rotation;
+    bool Mirror;
+    int FrameWidth;
+    int FrameHeight;
+
+    /* Top-down 1bpp frames in global colour table indices, and the columns that changed */
+    uint8_t* Previous;
+    uint8_t* Current;
+    uint8_t* Columns;
+    int FrameCount;
+
+    /* The two colours of the first frame */
+    uint8_t Colours[ 2 ][ 3 ];
+
+    /* LZW string table as a tree, the code for each string followed by each pixel value */
+    uint16_t ( *Codes )[ 4 ];
+    int NextCode;
+    int CodeSize;
+    int Prefix;
+
+    /* Bits waiting to be written, and the data sub-block being filled */
+    uint32_t Bits;
+    int BitCount;
+    uint8_t Block[ 255 ];
+    int BlockSize;
+};
+
+bool GIF_Create( struct GIFEncoder* Encoder, FILE* File, int Width, int Height, int Rotation, bool Mirror );
+void GIF_Free( struct GIFEncoder* Encoder );
+bool GIF_AddFrame( struct GIFEncoder* Encoder, FIBITMAP* Bitmap, uint32_t Delay );
+bool GIF_Finish( struct GIFEncoder* Encoder );
+
+#endif
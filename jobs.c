@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "jobs.h"
+
+/*
+ * Ordered work pipeline:
+ * Worker threads pick up items in increasing order and produce them into a ring of slots,
+ * the calling thread consumes them strictly in order. Workers never get more than
+ * one ring ahead of the consumer so memory use is bounded by the slot count.
+ * If there is a read function workers take turns calling it in item order, the first
+ * item it fails to read becomes the new end of the queue.
+ */
+struct JobQueue {
+    pthread_mutex_t Lock;
+    pthread_cond_t SlotFree;
+    pthread_cond_t SlotDone;
+
+    /* Only used with a read function */
+    pthread_mutex_t ReadLock;
+    pthread_cond_t ReadTurn;
+    int NextRead;
+
+    Jobs_ReadFn Read;
+    Jobs_WorkFn Work;
+    void* Context;
+
+    bool* Done;
+    int SlotCount;
+    int NextIndex;
+    int NextWrite;
+    int Count;
+    bool Stop;
+};
+
+/* Each worker gets this many slots so it can start on the next item while the last one is written */
+#define SlotsPerThread 2
+
+int Jobs_GetSlotCount( int Threads ) {
+    return ( Threads > 1 ) ? Threads * SlotsPerThread : 1;
+}
+
+/*
+ * Waits for item (Index)'s turn and reads it.
+ * Returns false if the input ended before or at (Index).
+ */
+static bool ReadInOrder( struct JobQueue* Queue, int Index, int Slot ) {
+    bool Result = false;
+
+    pthread_mutex_lock( &Queue->ReadLock );
+        while ( Queue->NextRead != Index ) {
+            pthread_cond_wait( &Queue->ReadTurn, &Queue->ReadLock );
+        }
+    pthread_mutex_unlock( &Queue->ReadLock );
+
+    pthread_mutex_lock( &Queue->Lock );
+        Result = ( Index < Queue->Count ) ? true : false;
+    pthread_mutex_unlock( &Queue->Lock );
+
+    if ( Result == true && Queue->Read( Queue->Context, Index, Slot ) == false ) {
+        pthread_mutex_lock( &Queue->Lock );
+            Queue->Count = Index;
+            pthread_cond_broadcast( &Queue->SlotDone );
+        pthread_mutex_unlock( &Queue->Lock );
+
+        Result = false;
+    }
+
+    pthread_mutex_lock( &Queue->ReadLock );
+        Queue->NextRead++;
+        pthread_cond_broadcast( &Queue->ReadTurn );
+    pthread_mutex_unlock( &Queue->ReadLock );
+
+    return Result;
+}
+
+static void* WorkerThread( void* Param ) {
+    struct JobQueue* Queue = ( struct JobQueue* ) Param;
+    bool Available = false;
+    int Index = 0;
+    int Slot = 0;
+
+    pthread_mutex_lock( &Queue->Lock );
+
+    while ( true ) {
+        while ( Queue->Stop == false && Queue->NextIndex < Queue->Count && Queue->NextIndex >= Queue->NextWrite + Queue->SlotCount ) {
+            pthread_cond_wait( &Queue->SlotFree, &Queue->Lock );
+        }
+
+        if ( Queue->Stop == true || Queue->NextIndex >= Queue->Count ) {
+            break;
+        }
+
+        Index = Queue->NextIndex++;
+        Slot = Index % Queue->SlotCount;
+
+        pthread_mutex_unlock( &Queue->Lock );
+            Available = ( Queue->Read == NULL || ReadInOrder( Queue, Index, Slot ) == true ) ? true : false;
+
+            if ( Available == true ) {
+                Queue->Work( Queue->Context, Index, Slot );
+            }
+        pthread_mutex_lock( &Queue->Lock );
+
+        if ( Available == true ) {
+            Queue->Done[ Slot ] = true;
+            pthread_cond_broadcast( &Queue->SlotDone );
+        }
+    }
+
+    pthread_mutex_unlock( &Queue->Lock );
+    return NULL;
+}
+
+/*
+ * Runs Work( ) for items [0, Count) on (Threads) worker threads and Write( ) for each
+ * of them in order on the calling thread. The caller must provide Jobs_GetSlotCount( Threads )
+ * slots for the work function to fill.
+ * (Read) is optional, with one (Count) may be negative to keep going until the input ends.
+ * Returns the number of items that were handed to Write( ).
+ */
+int Jobs_RunOrdered( int Threads, int Count, Jobs_ReadFn Read, Jobs_WorkFn Work, Jobs_WriteFn Write, void* Context ) {
+    struct JobQueue Queue;
+    pthread_t* Workers = NULL;
+    int WorkersStarted = 0;
+    int Index = 0;
+    int Slot = 0;
+    bool Continue = true;
+    int i = 0;
+
+    NullCheck( Work, return 0 );
+    NullCheck( Write, return 0 );
+
+    memset( &Queue, 0, sizeof( struct JobQueue ) );
+
+    Queue.SlotCount = Jobs_GetSlotCount( Threads );
+    Queue.Read = Read;
+    Queue.Work = Work;
+    Queue.Context = Context;
+    Queue.Count = ( Count < 0 && Read != NULL ) ? INT_MAX : Count;
+
+    if ( Threads > 1 ) {
+        Workers = ( pthread_t* ) malloc( sizeof( pthread_t ) * Threads );
+        Queue.Done = ( bool* ) calloc( Queue.SlotCount, sizeof( bool ) );
+
+        if ( Workers != NULL && Queue.Done != NULL ) {
+            pthread_mutex_init( &Queue.Lock, NULL );
+            pthread_cond_init( &Queue.SlotFree, NULL );
+            pthread_cond_init( &Queue.SlotDone, NULL );
+            pthread_mutex_init( &Queue.ReadLock, NULL );
+            pthread_cond_init( &Queue.ReadTurn, NULL );
+
+            for ( i = 0; i < Threads; i++ ) {
+                if ( pthread_create( &Workers[ WorkersStarted ], NULL, WorkerThread, &Queue ) == 0 ) {
+                    WorkersStarted++;
+                }
+            }
+        }
+    }
+
+    /* Single threaded, or we could not start any threads: do everything here */
+    if ( WorkersStarted == 0 ) {
+        for ( Index = 0; Index < Queue.Count && Continue == true; Index++ ) {
+            if ( Read != NULL && Read( Context, Index, 0 ) == false ) {
+                break;
+            }
+
+            Work( Context, Index, 0 );
+            Continue = Write( Context, Index, 0 );
+        }
+    } else {
+        for ( Index = 0; Continue == true; Index++ ) {
+            Slot = Index % Queue.SlotCount;
+
+            pthread_mutex_lock( &Queue.Lock );
+                while ( Queue.Done[ Slot ] == false && Index < Queue.Count ) {
+                    pthread_cond_wait( &Queue.SlotDone, &Queue.Lock );
+                }
+
+                /* The input may have ended while we were waiting */
+                Continue = ( Index < Queue.Count ) ? true : false;
+            pthread_mutex_unlock( &Queue.Lock );
+
+            if ( Continue == false ) {
+                break;
+            }
+
+            Continue = Write( Context, Index, Slot );
+
+            pthread_mutex_lock( &Queue.Lock );
+                Queue.Done[ Slot ] = false;
+                Queue.NextWrite++;
+                Queue.Stop = ! Continue;
+
+                pthread_cond_broadcast( &Queue.SlotFree );
+            pthread_mutex_unlock( &Queue.Lock );
+        }
+
+        for ( i = 0; i < WorkersStarted; i++ ) {
+            pthread_join( Workers[ i ], NULL );
+        }
+
+        pthread_cond_destroy( &Queue.ReadTurn );
+        pthread_mutex_destroy( &Queue.ReadLock );
+        pthread_cond_destroy( &Queue.SlotDone );
+        pthread_cond_destroy( &Queue.SlotFree );
+        pthread_mutex_destroy( &Queue.Lock );
+    }
+
+    if ( Queue.Done != NULL ) {
+        free( Queue.Done );
+    }
+
+    if ( Workers != NULL ) {
+        free( Workers );
+    }
+
+    return Index;
+}
@@ -0,0 +1,20 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+/* Called one item at a time and in order, before Work( ), to fetch item (Index) into slot (Slot)
+ * from an input that can only be read sequentially. Returning false ends the input.
+ */
+typedef bool ( *Jobs_ReadFn ) ( void* Context, int Index, int Slot );
+
+/* Called from a worker thread to produce item (Index) into slot (Slot) */
+typedef void ( *Jobs_WorkFn ) ( void* Context, int Index, int Slot );
+
+/* Called from the calling thread, in order, to consume item (Index) from slot (Slot).
+ * Returning false stops the pipeline.
+ */
+typedef bool ( *Jobs_WriteFn ) ( void* Context, int Index, int Slot );
+
+int Jobs_GetSlotCount( int Threads );
+int Jobs_RunOrdered( int Threads, int Count, Jobs_ReadFn Read, Jobs_WorkFn Work, Jobs_WriteFn Write, void* Context );
+
+#endif
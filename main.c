@@ -9,13 +9,19 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include <FreeImage.h>
 #include "cmdline.h"
+#include "options.h"
 #include "output.h"
-
-#define BIT( n ) ( 1 << n )
+#include "transpose.h"
+#include "stream.h"
+#include "stats.h"
+#include "process.h"
+#include "batch.h"
 
 void ErrorHandler( FREE_IMAGE_FORMAT Fmt, const char* Message ) {
     const char* FormatName = ( Fmt != FIF_UNKNOWN ) ? FreeImage_GetFormatFromFIF( Fmt ) : "UNKNOWN";
@@ -23,283 +29,111 @@ void ErrorHandler( FREE_IMAGE_FORMAT Fmt, const char* Message ) {
 }
 
 /*
- * Opens the given input file (Filename) as an FIBITMAP handle.
- * OutImageWidth and OutImageHeight MUST point to valid integers to receive
- * the image width and height.
- * Width and height of the input image must be divisible by 8.
- */
-FIBITMAP* OpenInputImage( const char* Filename, int* OutImageWidth, int* OutImageHeight ) {
-    FREE_IMAGE_FORMAT InputFormat = FIF_UNKNOWN;
-    FIBITMAP* Input = NULL;
-
-    NullCheck( Filename, return NULL );
-    NullCheck( OutImageWidth, return NULL );
-    NullCheck( OutImageHeight, return NULL );
-
-    InputFormat = FreeImage_GetFIFFromFilename( Filename );
-
-    if ( InputFormat != FIF_UNKNOWN ) {
-        Input = FreeImage_Load( InputFormat, Filename, 0 );
-        
-        if ( Input != NULL ) {
-            *OutImageWidth = FreeImage_GetWidth( Input );
-            *OutImageHeight = FreeImage_GetHeight( Input );
-
-            if ( *OutImageWidth % 8 == 0 && *OutImageHeight % 8 == 0 )
-                return Input;
-
-            fprintf( stderr, "Error: Input image width and height must be divisible by 8.\n" );
-
-            FreeImage_Unload( Input );
-            Input = NULL;
-        }
-    }
-
-    return Input;
-}
-
-/*
- * Checks to see if the input image is already in the correct (1BPP) format
- * and if it isn't we perform the conversion ourselves.
+ * Returns the size of (Filename) in bytes, 0 if it does not exist.
  */
-FIBITMAP* GetProcessedOutput( FIBITMAP* Input ) {
-    FREE_IMAGE_DITHER Algo = FID_FS;
-    FIBITMAP* Output = NULL;
-    int ColorThreshold = 0;
-
-    NullCheck( Input, return NULL );
-
-    /* If requested, invert the colours on the input image data */
-    if ( CmdLine_GetInvertFlag( ) == true ) {
-        FreeImage_Invert( Input );
-    }
+static uint64_t GetFileSize( const char* Filename ) {
+    struct stat Info;
 
-    if ( FreeImage_GetBPP( Input ) == 1 ) {
-        /* Input is already 1bpp, no changes needed */
-        Output = FreeImage_Clone( Input );
-    } else {
-        /* Convert input to 1BPP based on the user's command
-         * line selection or the defaults.
-         */
-        if ( CmdLine_DitherEnabled( ) == true ) {
-            Algo = CmdLine_GetDitherAlgorithm( );
-            Output = FreeImage_Dither( Input, Algo );
-        } else {
-            ColorThreshold = CmdLine_GetColorThreshold( );
-            Output = FreeImage_Threshold( Input, ColorThreshold );
-        }
+    if ( Filename == NULL || stat( Filename, &Info ) != 0 ) {
+        return 0;
     }
 
-    return Output;
+    return ( uint64_t ) Info.st_size;
 }
 
-/*
- * Sets (or clears) the pixel at (x,y) for the
- * SSD1306's horizontal addressing mode.
- */
-void SetPixelHorizontal( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) {
-#if 0
-    int PixelOffset = x + ( ( y / 8 ) * ImageWidth );
-    int BitOffset = ( y & 0x07 );
+void ProcessFiles( void ) {
+    struct ProcessJob Job;
 
-    ( void ) ImageHeight;
+    memset( &Job, 0, sizeof( struct ProcessJob ) );
 
-    Output[ PixelOffset ] = ( Color == true ) ? Output[ PixelOffset ] | BIT( BitOffset ) : Output[ PixelOffset ] & ~BIT( BitOffset );
-#endif
-    int BitOffset = ( y & 0x07 );
+    CmdLine_GetOptions( &Job.Options );
 
-    ( void ) ImageHeight;
+    Job.OutputFilename = CmdLine_GetOutputFilename( );
+    Job.InputFilenames = CmdLine_GetInputFilenames( );
+    Job.InputCount = CmdLine_GetInputCount( );
+    Job.RawFormat = CmdLine_GetRawFormat( );
+    Job.RawWidth = CmdLine_GetRawWidth( );
+    Job.RawHeight = CmdLine_GetRawHeight( );
+    Job.TimingFilename = CmdLine_GetTimingFilename( );
+    Job.CacheDirectory = CmdLine_GetCacheDirectory( );
 
-    /* 
-     * Divide the y coordinate by 8 to get which page
-     * the bit we want to set is on.
-     */
-    y>>= 3;
+    /* Can't ask about overwriting the output when stdin is busy with input frames */
+    Job.Overwrite = ( CmdLine_ReadsStdin( ) == true ) ? Overwrite_Never : Overwrite_Ask;
 
-    /* Invert color if command line option set */
-    if ( CmdLine_GetInvertFlag( ) == true ) {
-        Color = ! Color;
-    }
+    Process_Run( &Job, CmdLine_GetJobCount( ) );
 
-    if ( Color == true ) {
-        Output[ x + ( y * ImageWidth ) ] |= BIT( BitOffset );
+    if ( Job.RawFormat != RawFormat_None ) {
+        printf( "Processed %d frames.\n", Job.FramesWritten );
+    } else if ( Job.FrameCount > Job.InputCount ) {
+        printf( "Processed %d of %d frames from %d input images.\n", Job.FramesWritten, Job.FrameCount, Job.InputCount );
     } else {
-        Output[ x + ( y * ImageWidth ) ] &= ~BIT( BitOffset );
+        printf( "Processed %d of %d input images.\n", Job.FramesWritten, Job.InputCount );
     }
-}
 
-void SetPixelVertical( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) {
-    int BitOffset = ( y & 0x07 );
-    int PageOffset = ( y / 8 );
-    int PixelOffset = 0;
-
-    ( void ) ImageWidth;
-
-    PixelOffset = ( x * ( ImageHeight / 8 ) ) + PageOffset;
-    Output[ PixelOffset ] = ( Color == true ) ? ( Output[ PixelOffset ] | BIT( BitOffset ) ) : ( Output[ PixelOffset ] & ~BIT( BitOffset ) );
-}
-
-void SetPixelLinear( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) {
-    int BitOffset = 7 - ( x & 0x07 );
-    int PixelOffset = 0;
-
-    ( void ) ImageHeight;
-
-    PixelOffset = y * ( ImageWidth / 8 );
-    PixelOffset+= ( x / 8 );
-
-    Output[ PixelOffset ] = ( Color == true ) ? ( Output[ PixelOffset ] | BIT( BitOffset ) ) : ( Output[ PixelOffset ] & ~BIT( BitOffset ) );
-}
-
-void DoOutputConversion( FIBITMAP* Input, uint8_t* Output, int Width, int Height ) {
-    void ( *SetPixelFn ) ( uint8_t* Output, int x, int y, int ImageWidth, int ImageHeight, bool Color ) = NULL;
-    uint8_t Color = 0;
-    int x = 0;
-    int y = 0;
-
-    switch ( CmdLine_GetOutputFormat( ) ) {
-        case Format_1306_Horizontal: {
-            SetPixelFn = SetPixelHorizontal;
-            break;
-        }
-        case Format_1306_Vertical: {
-            SetPixelFn = SetPixelVertical;
-            break;
-        }
-        case Format_Linear: {
-            SetPixelFn = SetPixelLinear;
-            break;
-        }
-        default: return;
-    };
+    if ( Job.CacheDirectory != NULL ) {
+        printf( "Reused %d frames from the cache.\n", Job.FramesCached );
+    }
+    
+    if ( Job.Errors == true ) {
+        fprintf( stderr, "There were errors during the conversion.\nOutput file may be incomplete or invalid.\n" );
+    }
 
-    FreeImage_FlipVertical( Input );
+    if ( CmdLine_GetStatsFlag( ) == true ) {
+        Stats_Finish( Job.FramesWritten, GetFileSize( Job.OutputFilename ) );
+        Stats_Print( stdout );
 
-    for ( x = 0; x < Width; x++ ) {
-        for ( y = 0; y < Height; y++ ) {
-            FreeImage_GetPixelIndex( Input, x, y, &Color );
-            SetPixelFn( Output, x, y, Width, Height, Color );
+        if ( CmdLine_GetStatsFilename( ) != NULL ) {
+            Stats_WriteJSON( CmdLine_GetStatsFilename( ) );
         }
     }
 }
 
-void ProcessFiles( void ) {
-    const char** InputFilenames = NULL;
-    const char* OutputFilename = NULL;
-    uint8_t* OutputFramebuffer = NULL;
-    FIBITMAP* OutputBitmap = NULL;
-    FIBITMAP* InputBitmap = NULL;
-    int InputFileCount = 0;
-    int FramesWritten = 0;
-    int InputWidth = 0;
-    int InputHeight = 0;
-    int OutputWidth = 0;
-    int OutputHeight = 0;   
-    bool Errors = false;
-    int i = 0;
-
-    InputFilenames = CmdLine_GetInputFilenames( );
-    OutputFilename = CmdLine_GetOutputFilename( );
-    InputFileCount = CmdLine_GetInputCount( );
-
-    NullCheck( InputFilenames, return );
-    NullCheck( OutputFilename, return );
-
-    for ( i = 0; i < InputFileCount; i++ ) {
-        /* Make sure we successfully open the input image, if we don't then just bail immediately */
-        if ( ( InputBitmap = OpenInputImage( InputFilenames[ i ], &InputWidth, &InputHeight ) ) == NULL ) {
-            fprintf( stderr, "Failed to open image %s\n", InputFilenames[ i ] );
-
-            Errors = true;
-            break;
-        }
-
-        /* Small setup bits at the start */
-        if ( i == 0 ) {
-            SetOutputParameters( InputWidth, InputHeight );
+void ProcessBatch( void ) {
+    const char* StatsFilename = CmdLine_GetStatsFilename( );
+    bool StatsFlag = CmdLine_GetStatsFlag( );
+    int Threads = CmdLine_GetJobCount( );
+    struct BatchResult Result;
+    char* Manifest = NULL;
 
-            OutputWidth = InputWidth;
-            OutputHeight = InputHeight;
-
-            /* Ditto */
-            if ( OpenOutputFile( ) == false ) {
-                if ( DidUserCancel( ) == false ) {
-                    fprintf( stderr, "Failed to open output file: %s\n", strerror( errno ) );
-                    Errors = true;
-                }
-                
-                break;
-            }     
-
-            /* RAW And ANM modes require working on a 1bpp framebuffer so we need
-             * to allocate one of the proper size ourselves here.
-             */
-            if ( ( OutputFramebuffer = ( uint8_t* ) malloc( ( InputWidth * InputHeight ) / 8 ) ) == NULL ) {
-                fprintf( stderr, "Failed to allocate an output framebuffer.\n" );
-
-                Errors = true;
-                break;
-            }       
-        }
+    if ( CmdLine_GetBatchFilename( ) != NULL ) {
+        NullCheck( ( Manifest = strdup( CmdLine_GetBatchFilename( ) ) ), return );
+    }
 
-        /* If the current image is not the same size as the first image then write a warning
-         * and move onto the next image.
-         */
-        if ( InputWidth != OutputWidth || InputHeight != OutputHeight ) {
-            fprintf( stderr, "Image %s has a size of %dx%d when we expected %dx%d. Skipping.\n", 
-                InputFilenames[ i ],
-                InputWidth,
-                InputHeight,
-                OutputWidth,
-                OutputHeight
-            );
+    /* Every manifest line goes through the command line parser again */
+    CmdLine_Free( );
 
-            Errors = true;
-            continue;
-        }
+    Batch_Run( Manifest, Threads, &Result );
 
-        /* This really should never fail, but if it does try to keep going anyway */
-        if ( ( OutputBitmap = GetProcessedOutput( InputBitmap ) ) == NULL ) {
-            fprintf( stderr, "Failed to convert image %s. Skipping.\n", InputFilenames[ i ] );
+    printf( "Ran %d jobs, %d failed.\n", Result.JobCount, Result.FailedCount );
 
-            Errors = true;
-            continue;
-        }
+    if ( StatsFlag == true ) {
+        Stats_Finish( Result.FramesWritten, Result.BytesWritten );
+        Stats_Print( stdout );
 
-        if ( IsOutputAGIF( ) == false ) {
-            /* Do special format conversions for RAW/ANM output */
-            DoOutputConversion( OutputBitmap, OutputFramebuffer, OutputWidth, OutputHeight );
-            WriteOutputFile( OutputFramebuffer );
-        } else {
-            /* Straight through for GIFs */
-            WriteOutputFile( ( void* ) OutputBitmap );
+        if ( StatsFilename != NULL ) {
+            Stats_WriteJSON( StatsFilename );
         }
-
-        FreeImage_Unload( InputBitmap );
-        FreeImage_Unload( OutputBitmap );
-
-        FramesWritten++;
     }
 
-    printf( "Processed %d of %d input images.\n", FramesWritten, InputFileCount );
-    
-    if ( Errors == true ) {
-        fprintf( stderr, "There were errors during the conversion.\nOutput file may be incomplete or invalid.\n" );
+    if ( Manifest != NULL ) {
+        free( Manifest );
     }
-
-    if ( OutputFramebuffer != NULL ) {
-        free( OutputFramebuffer );
-    }
-
-    CloseOutputFile( );
 }
 
 int main( int Argc, char** Argv ) {
     FreeImage_Initialise( FALSE );
     FreeImage_SetOutputMessage( ErrorHandler );
+    Transpose_Init( );
 
     if ( CmdLine_Handler( Argc, Argv ) == 0 ) {
-        ProcessFiles( );
+        Stats_Init( CmdLine_GetStatsFlag( ) );
+            if ( CmdLine_GetBatchFlag( ) == true ) {
+                ProcessBatch( );
+            } else {
+                ProcessFiles( );
+            }
+        Stats_Free( );
+
         CmdLine_Free( );
     }
 
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "options.h"
+#include "output.h"
+
+/*
+ * Fills (Options) with the same defaults the command line starts with.
+ */
+void Options_SetDefaults( struct Options* Options ) {
+    NullCheck( Options, return );
+
+    memset( Options, 0, sizeof( struct Options ) );
+
+    Options->OutputFormat = Format_1306_Horizontal;
+    Options->Container = Container_Raw;
+    Options->DitherFlag = false;
+    Options->DitherAlgorithm = FID_FS;
+    Options->ThresholdValue = 128;
+    Options->TemporalFlag = false;
+    Options->Hysteresis = DEFAULT_HYSTERESIS;
+    Options->InvertFlag = false;
+    Options->SelfCheckFlag = false;
+    Options->ResizeWidth = 0;
+    Options->ResizeHeight = 0;
+    Options->ResizeMode = Resize_Letterbox;
+    Options->Rotation = Rotate_None;
+    Options->MirrorFlag = false;
+    Options->PanelColumns = 1;
+    Options->PanelRows = 1;
+    Options->InterleaveFlag = false;
+    Options->CompressFlag = false;
+    Options->WriteHeader = true;
+    Options->DedupFlag = false;
+    Options->Delay = DEFAULT_IMAGE_DELAY;
+}
+
+/*
+ * Picks the container from the extension of (Filename):
+ * .gif and .anm files get those, anything else is raw frames.
+ */
+int Options_GetContainer( const char* Filename ) {
+    size_t Length = 0;
+
+    if ( Filename != NULL && ( Length = strlen( Filename ) ) >= 4 ) {
+        if ( strcasecmp( &Filename[ Length - 4 ], ".gif" ) == 0 ) {
+            return Container_GIF;
+        }
+
+        if ( strcasecmp( &Filename[ Length - 4 ], ".anm" ) == 0 ) {
+            return Container_ANM;
+        }
+    }
+
+    return Container_Raw;
+}
+
+/*
+ * Returns the size (Width)x(Height) frames end up with in the output once they have been turned.
+ */
+void Options_GetOutputSize( const struct Options* Options, int Width, int Height, int* OutputWidth, int* OutputHeight ) {
+    bool Sideways = ( Options->Rotation == Rotate_90 || Options->Rotation == Rotate_270 ) ? true : false;
+
+    *OutputWidth = ( Sideways == true ) ? Height : Width;
+    *OutputHeight = ( Sideways == true ) ? Width : Height;
+}
+
+/*
+ * Returns the number of panels every frame is split into, 1 if it isn't.
+ */
+int Options_GetPanelCount( const struct Options* Options ) {
+    return ( Options->PanelColumns > 0 && Options->PanelRows > 0 ) ? Options->PanelColumns * Options->PanelRows : 1;
+}
+
+/*
+ * Works out the size of one panel of an (OutputWidth)x(OutputHeight) frame, the size it has once turned.
+ * Returns false if the frame doesn't split evenly into panels with sides divisible by 8.
+ */
+bool Options_GetPanelSize( const struct Options* Options, int OutputWidth, int OutputHeight, int* PanelWidth, int* PanelHeight ) {
+    int Columns = ( Options->PanelColumns > 0 ) ? Options->PanelColumns : 1;
+    int Rows = ( Options->PanelRows > 0 ) ? Options->PanelRows : 1;
+
+    *PanelWidth = OutputWidth / Columns;
+    *PanelHeight = OutputHeight / Rows;
+
+    if ( OutputWidth % Columns != 0 || OutputHeight % Rows != 0 ) {
+        return false;
+    }
+
+    return ( *PanelWidth > 0 && *PanelWidth % 8 == 0 && *PanelHeight > 0 && *PanelHeight % 8 == 0 ) ? true : false;
+}
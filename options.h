@@ -0,0 +1,102 @@
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+#define DEFAULT_IMAGE_DELAY 100
+#define DEFAULT_HYSTERESIS 12
+
+/* What the output file is wrapped in */
+enum {
+    /* Frames written back to back with nothing else */
+    Container_Raw = 0,
+
+    /* struct ANM0_Header followed by the frames */
+    Container_ANM,
+
+    /* Animated GIF, only available when writing to a file */
+    Container_GIF
+};
+
+/* How frames are scaled to the --size given */
+enum {
+    /* Stretched to exactly that size */
+    Resize_Fit = 0,
+
+    /* Aspect ratio kept, scaled to cover all of it with whatever sticks out cropped evenly off both sides */
+    Resize_Fill,
+
+    /* Aspect ratio kept, scaled to fit inside it with black bars on either side */
+    Resize_Letterbox
+};
+
+/* How far frames are turned clockwise when they are packed */
+enum {
+    Rotate_None = 0,
+    Rotate_90,
+    Rotate_180,
+    Rotate_270
+};
+
+/*
+ * Everything that decides how images are converted and written.
+ * Filled in from the command line by CmdLine_GetOptions, or by hand when used as a library.
+ */
+struct Options {
+    /* One of the Format_* values in output.h */
+    int OutputFormat;
+
+    /* One of the Container_* values above */
+    int Container;
+
+    /* Dither with (DitherAlgorithm) if set, otherwise threshold at (ThresholdValue) */
+    bool DitherFlag;
+    FREE_IMAGE_DITHER DitherAlgorithm;
+    int ThresholdValue;
+
+    /* Carry pixels over from the previous frame until their grey level moves more than (Hysteresis),
+     * which needs the frames converted one at a time and in order.
+     */
+    bool TemporalFlag;
+    int Hysteresis;
+
+    bool InvertFlag;
+    bool SelfCheckFlag;
+
+    /* Scale every frame to (ResizeWidth)x(ResizeHeight) with one of the Resize_* policies,
+     * 0 leaves frames at their own size.
+     */
+    int ResizeWidth;
+    int ResizeHeight;
+    int ResizeMode;
+
+    /* Turn frames by one of the Rotate_* values, then mirror them left to right if (MirrorFlag) is set.
+     * For panels mounted the other way up or on their side, the output has the size of the turned frames.
+     */
+    int Rotation;
+    bool MirrorFlag;
+
+    /* Split the turned frames into a grid of (PanelColumns)x(PanelRows) panels, packed one after the other
+     * with the top left panel first and numbered along each row. RAW/ANM output writes a file per panel,
+     * unless (InterleaveFlag) is set or the output goes to memory, then every frame holds all of its panels in turn.
+     */
+    int PanelColumns;
+    int PanelRows;
+    bool InterleaveFlag;
+
+    /* ANM output only */
+    bool CompressFlag;
+    bool WriteHeader;
+
+    /* ANM output with a header, or GIF output */
+    bool DedupFlag;
+
+    /* Delay in milliseconds between frames, unless the frame has its own */
+    uint32_t Delay;
+};
+
+void Options_SetDefaults( struct Options* Options );
+int Options_GetContainer( const char* Filename );
+void Options_GetOutputSize( const struct Options* Options, int Width, int Height, int* OutputWidth, int* OutputHeight );
+int Options_GetPanelCount( const struct Options* Options );
+bool Options_GetPanelSize( const struct Options* Options, int OutputWidth, int OutputHeight, int* PanelWidth, int* PanelHeight );
+
+#endif
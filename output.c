@@ -13,23 +13,40 @@
 #include <ctype.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <FreeImage.h>
 #include "output.h"
-#include "cmdline.h"
+#include "options.h"
+#include "stats.h"
+#include "writer.h"
 
-static void AddFrameTimeTag( FIBITMAP* Input, uint32_t AnimationDelay );
+static bool OpenGIFOutput( struct Output* Output );
+static bool FlushGIFFrame( struct Output* Output );
+static void CloseGIFOutput( struct Output* Output );
+static bool AddGIFFrame( struct Output* Output, FIBITMAP* Input, uint32_t AnimationDelay );
 
-static bool OpenGIFOutput( void );
-static void CloseGIFOutput( void );
-static bool AddGIFFrame( FIBITMAP* Input, uint32_t AnimationDelay );
+static bool OpenRawOutput( struct Output* Output );
+static void CloseRawOutput( struct Output* Output );
+static bool AddRawFrame( struct Output* Output, uint8_t* Data );
 
-static bool OpenRawOutput( void );
-static void CloseRawOutput( void );
-static bool AddRawFrame( uint8_t* Data );
+static bool OpenANMOutput( struct Output* Output );
+static bool AddANMFrame( struct Output* Output, uint8_t* Data );
+static void CloseANMOutput( struct Output* Output );
 
-static bool OpenANMOutput( void );
-static bool AddANMFrame( uint8_t* Data );
-static void CloseANMOutput( void );
+static size_t EncodeRLE( const uint8_t* Data, size_t Size, size_t PageSize, uint8_t* Output, size_t Limit );
+static size_t EncodeDelta( const uint8_t* Data, const uint8_t* Previous, size_t Size, size_t PageSize, uint8_t* Output, size_t Limit );
+static bool AddCompressedFrame( struct Output* Output, uint8_t* Data );
+static bool AddDirtyFrame( struct Output* Output, const uint8_t* Framebuffer );
+static bool AddTableFrame( struct Output* Output, uint8_t* Data, uint32_t Delay );
+static bool WriteDirtyIndex( struct Output* Output );
+
+static bool OpenPanelOutputs( struct Output* Output );
+static bool WritePanelFrames( struct Output* Output, uint8_t* Data, uint32_t Delay );
+static void FreePanelOutputs( struct Output* Output );
+
+static bool MapOutput( struct Output* Output, size_t HeaderSize );
+static void UnmapOutput( struct Output* Output );
+static void StartAsyncWrites( struct Output* Output );
 
 /*
 static const char* DitherAlgorithms[ ] = {
@@ -43,23 +60,119 @@ static const char* DitherAlgorithms[ ] = {
 };
 */
 
-static FIMULTIBITMAP* OutputGIF = NULL;
-static FILE* OutputFile = NULL;
+/*
+ * Sets up (Output) to write to (Filename) using (Options), which must stay around until
+ * the output is freed. A NULL (Filename) writes RAW/ANM output to memory instead.
+ */
+void Output_Init( struct Output* Output, const struct Options* Options, const char* Filename ) {
+    NullCheck( Output, return );
+
+    memset( Output, 0, sizeof( struct Output ) );
+
+    Output->Options = Options;
+    Output->Filename = Filename;
+    Output->Overwrite = Overwrite_Ask;
+}
+
+/*
+ * Closes (Output) if it is still open and frees everything it holds, including memory output.
+ */
+void Output_Free( struct Output* Output ) {
+    NullCheck( Output, return );
+
+    Output_Close( Output );
+    FreePanelOutputs( Output );
+
+    if ( Output->Memory != NULL ) {
+        free( Output->Memory );
 
-static int OutputWidth = 0;
-static int OutputHeight = 0;
-static int OutputFormat = 0;
-static int FramesWritten = 0;
+        Output->Memory = NULL;
+        Output->MemorySize = 0;
+    }
+}
 
-static bool UserCancel = false;
+bool Output_DidUserCancel( const struct Output* Output ) {
+    return Output->UserCancel;
+}
 
-bool DidUserCancel( void ) {
-    return UserCancel;
+/*
+ * Sets the size of the frames that will be written, before --rotate turns them.
+ */
+void Output_SetSize( struct Output* Output, int Width, int Height ) {
+    Options_GetOutputSize( Output->Options, Width, Height, &Output->Width, &Output->Height );
 }
 
-void SetOutputParameters( int Width, int Height ) {
-    OutputWidth = Width;
-    OutputHeight = Height;
+/*
+ * Tells the RAW/ANM writers how many frames to expect, 0 if that is not known.
+ * Must be called before Output_Open.
+ */
+void Output_SetFrameCount( struct Output* Output, int Count ) {
+    Output->ExpectedFrameCount = Count;
+}
+
+/*
+ * Returns true if frames are split between a file per panel rather than written to (Output) itself.
+ * Memory output only has the one buffer, so it keeps every panel of a frame together like --interleave.
+ */
+static bool WritesPanelFiles( const struct Output* Output ) {
+    const struct Options* Options = Output->Options;
+
+    if ( Output->IsPanel == true || Output->Filename == NULL || Options->Container == Container_GIF || Options->InterleaveFlag == true ) {
+        return false;
+    }
+
+    return ( Options_GetPanelCount( Options ) > 1 ) ? true : false;
+}
+
+/*
+ * Returns true if the output can be preallocated when the frame count is known,
+ * which needs every frame to be the same size in a file.
+ */
+bool Output_CanPreallocate( const struct Output* Output ) {
+    const struct Options* Options = Output->Options;
+
+    /* Deduplicated frames don't end up at a position that can be worked out up front,
+     * and panels of a frame that go to different files aren't next to each other.
+     */
+    if ( WritesPanelFiles( Output ) == true || Output->Filename == NULL || Options->Container == Container_GIF || Options->OutputFormat == Format_1306_Dirty || Options->DedupFlag == true ) {
+        return false;
+    }
+
+    return ( Options->Container == Container_ANM && Options->CompressFlag == true ) ? false : true;
+}
+
+/*
+ * Returns where frame (Index) goes in the mapped output file,
+ * or NULL if the output is not mapped.
+ * Safe to call from any thread once the output is open.
+ */
+uint8_t* Output_GetFrameBuffer( const struct Output* Output, int Index ) {
+    size_t DisplaySize = ( Output->Width * Output->Height ) / 8;
+
+    if ( Output->Map == NULL || Index < 0 || Index >= Output->ExpectedFrameCount ) {
+        return NULL;
+    }
+
+    return &Output->Map[ Output->MapHeaderSize + ( ( size_t ) Index * DisplaySize ) ];
+}
+
+/*
+ * Returns the output written to memory and its size in (Size),
+ * or NULL if (Output) was not written to memory or is still open.
+ * The buffer belongs to (Output) and goes away with Output_Free.
+ */
+const uint8_t* Output_GetMemory( const struct Output* Output, size_t* Size ) {
+    NullCheck( Output, return NULL );
+
+    if ( Output->Filename != NULL || Output->File != NULL ) {
+        return NULL;
+    }
+
+    if ( Size != NULL ) {
+        *Size = Output->MemorySize;
+    }
+
+    return ( const uint8_t* ) Output->Memory;
 }
 
 /*
@@ -81,136 +194,271 @@ uint8_t* AllocateFramebuffer( int Width, int Height ) {
  * Prompts the user if we should overwrite (Filename).
  * Returns 1 if the user selected Y, otherwise 0.
  */
-static bool AskToOverwrite( const char* Filename ) {
+static bool AskToOverwrite( struct Output* Output, const char* Filename ) {
     int Result = 0;
 
+    if ( Output->Overwrite == Overwrite_Always ) {
+        return true;
+    }
+
+    /* Can't ask when stdin is busy with input frames */
+    if ( Output->Overwrite == Overwrite_Never ) {
+        fprintf( stderr, "File \"%s\" already exists, not overwriting it while reading frames from stdin.\n", Filename );
+
+        Output->UserCancel = true;
+        return false;
+    }
+
     printf( "File \"%s\" already exists. Overwrite? (Y/N) ", Filename );
         Result = tolower( getchar( ) );
-        UserCancel = ( Result == 'y' ) ? false : true;
+        Output->UserCancel = ( Result == 'y' ) ? false : true;
     printf( "\n" );
 
     return ( Result == 'y' ) ? true : false;
 }
 
-bool OpenGIFOutput( void ) {
-    const char* Filename = NULL;
+/*
+ * GIF frames are encoded and written as they come in, like RAW/ANM output they can go to memory.
+ */
+bool OpenGIFOutput( struct Output* Output ) {
+    if ( OpenRawOutput( Output ) == true ) {
+        StartAsyncWrites( Output );
 
-    if ( ( Filename = CmdLine_GetOutputFilename( ) ) != NULL ) {
-        /* If the file exists and the user does not want to overwrite it, bail */
-        if ( access( Filename, F_OK ) == 0 && AskToOverwrite( Filename ) == 0 )
-            return false;
+        if ( GIF_Create( &Output->GIF, Output->File, Output->Width, Output->Height, Output->Options->Rotation, Output->Options->MirrorFlag ) == true ) {
+            return true;
+        }
 
-        OutputGIF = FreeImage_OpenMultiBitmap( FIF_GIF, Filename, TRUE, FALSE, FALSE, 0 );
+        CloseRawOutput( Output );
     }
 
-    return OutputGIF != NULL ? true : false;
+    return false;
 }
 
-void CloseGIFOutput( void ) {
-    if ( OutputGIF != NULL ) {
-        FreeImage_CloseMultiBitmap( OutputGIF, 0 );
-        OutputGIF = NULL;
+void CloseGIFOutput( struct Output* Output ) {
+    if ( Output->File != NULL ) {
+        FlushGIFFrame( Output );
+        GIF_Finish( &Output->GIF );
     }
+
+    GIF_Free( &Output->GIF );
+    CloseRawOutput( Output );
 }
 
-bool OpenRawOutput( void ) {
+bool OpenRawOutput( struct Output* Output ) {
     const char* Filename = NULL;
 
-    if ( ( Filename = CmdLine_GetOutputFilename( ) ) != NULL ) {
+    if ( ( Filename = Output->Filename ) != NULL ) {
         /* If the file exists and the user does not want to overwrite it, bail */
-        if ( access( Filename, F_OK ) == 0 && AskToOverwrite( Filename ) == 0 )
+        if ( access( Filename, F_OK ) == 0 && AskToOverwrite( Output, Filename ) == 0 )
             return false;
-    }
 
-    OutputFormat = CmdLine_GetOutputFormat( );
-    OutputFile = fopen( Filename, "wb+" );
+        Output->File = fopen( Filename, "wb+" );
+    } else {
+        /* Memory output grows as it is written, anything from an earlier run is dropped */
+        if ( Output->Memory != NULL ) {
+            free( Output->Memory );
+
+            Output->Memory = NULL;
+            Output->MemorySize = 0;
+        }
+
+        Output->File = open_memstream( &Output->Memory, &Output->MemorySize );
+    }
 
-    return OutputFile != NULL ? true : false;
+    return Output->File != NULL ? true : false;
 }
 
-void CloseRawOutput( void ) {
-    if ( OutputFile != NULL ) {
-        fflush( OutputFile );
-        fclose( OutputFile );
+/*
+ * Hands writing the output file over to a thread of its own, so frames only wait for the disk
+ * when it falls behind by more than the writer buffers. Mapped and memory output gain nothing from it.
+ * Must be called before anything holds on to Output->File.
+ */
+static void StartAsyncWrites( struct Output* Output ) {
+    FILE* Stream = NULL;
 
-        OutputFile = NULL;
+    if ( Output->Filename != NULL && Output->Map == NULL && ( Stream = Writer_Open( Output->File ) ) != NULL ) {
+        Output->File = Stream;
     }
 }
 
-static void AddFrameTimeTag( FIBITMAP* Input, uint32_t AnimationDelay ) {
-    FITAG* Tag = NULL;
+/*
+ * Grows the freshly opened output file to hold (HeaderSize) bytes and all of the expected frames
+ * and maps it. Returns false if that can't be done, frames are then written with fwrite.
+ */
+static bool MapOutput( struct Output* Output, size_t HeaderSize ) {
+    size_t Size = HeaderSize + ( ( size_t ) Output->ExpectedFrameCount * ( ( Output->Width * Output->Height ) / 8 ) );
+    void* Map = NULL;
+    int fd = -1;
 
-    if ( ( Tag = FreeImage_CreateTag( ) ) != NULL ) {
-        FreeImage_SetTagKey( Tag, "FrameTime" );
-        FreeImage_SetTagType( Tag, FIDT_LONG );
-        FreeImage_SetTagCount( Tag, 1 );
-        FreeImage_SetTagLength( Tag, 4 );
-        FreeImage_SetTagValue( Tag, &AnimationDelay );
-        FreeImage_SetMetadata( FIMD_ANIMATION, Input, FreeImage_GetTagKey( Tag ), Tag );
-        FreeImage_DeleteTag( Tag );
+    if ( Output->ExpectedFrameCount < 1 || Output_CanPreallocate( Output ) == false ) {
+        return false;
     }
-}
 
-bool IsOutputAGIF( void ) {
-    const char* OutputFile = NULL;
-    int Length = 0;
+    fd = fileno( Output->File );
 
-    if ( ( OutputFile = CmdLine_GetOutputFilename( ) ) != NULL ) {
-        Length = strlen( OutputFile );
+    /* Pipes and character devices can't be resized */
+    if ( ftruncate( fd, ( off_t ) Size ) != 0 ) {
+        return false;
+    }
 
-        if ( strcasecmp( &OutputFile[ Length - 4 ], ".gif" ) == 0 )
-            return true;
+    if ( ( Map = mmap( NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) ) == MAP_FAILED ) {
+        CheckExpr( ftruncate( fd, 0 ) != 0, return false );
+        return false;
     }
 
-    return false;
+    Output->Map = ( uint8_t* ) Map;
+    Output->MapSize = Size;
+    Output->MapHeaderSize = HeaderSize;
+
+    return true;
 }
 
-bool IsOutputANM( void ) {
-    const char* Filename = NULL;
-    int Length = 0;
+/*
+ * Unmaps the output and trims off the space reserved for frames that were never written.
+ */
+static void UnmapOutput( struct Output* Output ) {
+    size_t Size = Output->MapHeaderSize + ( ( size_t ) Output->FramesStored * ( ( Output->Width * Output->Height ) / 8 ) );
 
-    if ( ( Filename = CmdLine_GetOutputFilename( ) ) != NULL ) {
-        Length = strlen( Filename );
+    if ( Output->Map != NULL ) {
+        munmap( Output->Map, Output->MapSize );
 
-        if ( strcasecmp( &Filename[ Length - 4 ], ".anm" ) == 0 ) {
-            return true;
+        if ( Size < Output->MapSize ) {
+            CheckExpr( ftruncate( fileno( Output->File ), ( off_t ) Size ) != 0, );
         }
+
+        Output->Map = NULL;
+        Output->MapSize = 0;
+        Output->MapHeaderSize = 0;
     }
+}
 
-    return false;
+void CloseRawOutput( struct Output* Output ) {
+    UnmapOutput( Output );
+
+    if ( Output->File != NULL ) {
+        fflush( Output->File );
+
+        /* Writes can still be on their way to the disk until the file is closed */
+        if ( fclose( Output->File ) != 0 && Output->Filename != NULL ) {
+            fprintf( stderr, "Error: Failed to write output file \"%s\".\n", Output->Filename );
+        }
+
+        Output->File = NULL;
+    }
 }
 
-bool AddRawFrame( uint8_t* Data ) {
-    size_t DataSize = ( OutputWidth * OutputHeight ) / 8;
+bool AddRawFrame( struct Output* Output, uint8_t* Data ) {
+    size_t DataSize = ( Output->Width * Output->Height ) / 8;
+    uint8_t* Destination = NULL;
 
-    NullCheck( OutputFile, return false );
+    NullCheck( Output->File, return false );
     NullCheck( Data, return false );
 
-    if ( fwrite( Data, 1, DataSize, OutputFile ) == DataSize ) {
-        FramesWritten++;
+    if ( Output->Map != NULL ) {
+        CheckExpr( ( Destination = Output_GetFrameBuffer( Output, Output->FramesStored ) ) == NULL, return false );
+
+        /* Frames are normally packed in place, they only have to move down when one was skipped */
+        if ( Data != Destination ) {
+            memcpy( Destination, Data, DataSize );
+        }
+
+        Output->FramesStored++;
+        return true;
+    }
+
+    if ( fwrite( Data, 1, DataSize, Output->File ) == DataSize ) {
+        Output->FramesStored++;
+        return true;
+    }
+
+    return false;
+}
+
+/* GIF frame delays are 16 bit hundredths of a second */
+#define MaxGIFDelay ( 0xFFFF * 10 )
+
+static bool AppendGIFFrame( struct Output* Output, FIBITMAP* Input, uint32_t AnimationDelay ) {
+    if ( GIF_AddFrame( &Output->GIF, Input, AnimationDelay ) == true ) {
+        Output->FramesStored++;
         return true;
     }
 
     return false;
 }
 
-bool AddGIFFrame( FIBITMAP* Input, uint32_t AnimationDelay ) {
-    NullCheck( OutputGIF, return false );
+/*
+ * Returns true if the 1bpp images (a) and (b) have the same pixels.
+ */
+static bool SameBitmap( FIBITMAP* a, FIBITMAP* b ) {
+    unsigned Height = FreeImage_GetHeight( a );
+    unsigned y = 0;
+
+    if ( FreeImage_GetWidth( a ) != FreeImage_GetWidth( b ) || Height != FreeImage_GetHeight( b ) || FreeImage_GetBPP( a ) != FreeImage_GetBPP( b ) ) {
+        return false;
+    }
+
+    for ( y = 0; y < Height; y++ ) {
+        if ( memcmp( FreeImage_GetScanLine( a, y ), FreeImage_GetScanLine( b, y ), FreeImage_GetLine( a ) ) != 0 ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Writes out the frame --dedup was holding back, if there is one.
+ */
+static bool FlushGIFFrame( struct Output* Output ) {
+    bool Result = true;
+
+    if ( Output->PendingFrame != NULL ) {
+        Result = AppendGIFFrame( Output, Output->PendingFrame, Output->PendingDelay );
+
+        FreeImage_Unload( Output->PendingFrame );
+        Output->PendingFrame = NULL;
+    }
+
+    return Result;
+}
+
+bool AddGIFFrame( struct Output* Output, FIBITMAP* Input, uint32_t AnimationDelay ) {
+    NullCheck( Output->File, return false );
     NullCheck( Input, return false );
 
-    AddFrameTimeTag( Input, AnimationDelay );
-    FreeImage_AppendPage( OutputGIF, Input );
+    if ( Output->Options->DedupFlag == false ) {
+        return AppendGIFFrame( Output, Input, AnimationDelay );
+    }
+
+    /* A repeat of the last frame just shows it for longer */
+    if ( Output->PendingFrame != NULL && Output->PendingDelay + AnimationDelay <= MaxGIFDelay && SameBitmap( Output->PendingFrame, Input ) == true ) {
+        Output->PendingDelay+= AnimationDelay;
+        return true;
+    }
+
+    if ( FlushGIFFrame( Output ) == false ) {
+        return false;
+    }
+
+    NullCheck( ( Output->PendingFrame = FreeImage_Clone( Input ) ), return false );
+    Output->PendingDelay = AnimationDelay;
 
     return true;
 }
 
-bool OpenANMOutput( void ) {
+bool OpenANMOutput( struct Output* Output ) {
     struct ANM0_Header Header;
 
-    if ( OpenRawOutput( ) == true ) {
+    if ( OpenRawOutput( Output ) == true ) {
+        /* A new mapping is all zeroes, which is the empty header */
+        if ( MapOutput( Output, sizeof( struct ANM0_Header ) ) == true ) {
+            return true;
+        }
+
+        StartAsyncWrites( Output );
         memset( &Header, 0, sizeof( struct ANM0_Header ) );
         
-        if ( fwrite( &Header, 1, sizeof( struct ANM0_Header ), OutputFile ) == sizeof( struct ANM0_Header ) ) {
+        if ( fwrite( &Header, 1, sizeof( struct ANM0_Header ), Output->File ) == sizeof( struct ANM0_Header ) ) {
             return true;
         }
     }
@@ -218,8 +466,335 @@ bool OpenANMOutput( void ) {
     return false;
 }
 
-bool AddANMFrame( uint8_t* Data ) {
-    return AddRawFrame( Data );
+bool AddANMFrame( struct Output* Output, uint8_t* Data ) {
+    if ( Output->Options->CompressFlag == true ) {
+        return AddCompressedFrame( Output, Data );
+    }
+
+    return AddRawFrame( Output, Data );
+}
+
+/*
+ * Returns the size of the chunks RLE runs and delta spans may not cross.
+ */
+static size_t GetPageSize( const struct Output* Output ) {
+    if ( Output->Options->OutputFormat == Format_1306_Horizontal ) {
+        return Output->Width;
+    }
+
+    return ( Output->Width * Output->Height ) / 8;
+}
+
+/*
+ * RLE encodes (Data) into (Output) as described for FrameEncoding_RLE.
+ * Returns the encoded size, or 0 if it would not be smaller than (Limit).
+ */
+static size_t EncodeRLE( const uint8_t* Data, size_t Size, size_t PageSize, uint8_t* Output, size_t Limit ) {
+    size_t PageEnd = 0;
+    size_t Start = 0;
+    size_t Run = 0;
+    size_t Out = 0;
+    size_t i = 0;
+
+    while ( i < Size ) {
+        PageEnd = ( ( i / PageSize ) + 1 ) * PageSize;
+        PageEnd = ( PageEnd > Size ) ? Size : PageEnd;
+
+        for ( Run = 1; i + Run < PageEnd && Run < 128 && Data[ i + Run ] == Data[ i ]; Run++ ) {
+        }
+
+        if ( Run >= 3 ) {
+            if ( Out + 2 >= Limit ) {
+                return 0;
+            }
+
+            Output[ Out++ ] = ( uint8_t ) ( 0x80 | ( Run - 1 ) );
+            Output[ Out++ ] = Data[ i ];
+            i+= Run;
+        } else {
+            /* Literals continue until the next run of 3 or more */
+            for ( Start = i; i < PageEnd && i - Start < 128; i++ ) {
+                if ( i + 2 < PageEnd && Data[ i ] == Data[ i + 1 ] && Data[ i ] == Data[ i + 2 ] ) {
+                    break;
+                }
+            }
+
+            if ( Out + 1 + ( i - Start ) >= Limit ) {
+                return 0;
+            }
+
+            Output[ Out++ ] = ( uint8_t ) ( ( i - Start ) - 1 );
+            memcpy( &Output[ Out ], &Data[ Start ], i - Start );
+            Out+= ( i - Start );
+        }
+    }
+
+    return Out;
+}
+
+/*
+ * Encodes the changes from (Previous) to (Data) as described for FrameEncoding_Delta.
+ * Returns the encoded size, or 0 if it would not be smaller than (Limit).
+ */
+static size_t EncodeDelta( const uint8_t* Data, const uint8_t* Previous, size_t Size, size_t PageSize, uint8_t* Output, size_t Limit ) {
+    struct ANM_DeltaSpan Span;
+    size_t SpanStart = 0;
+    size_t SpanEnd = 0;
+    size_t PageEnd = 0;
+    size_t Gap = 0;
+    size_t Out = 0;
+    size_t x = 0;
+    size_t i = 0;
+
+    /* Span offsets are 16 bit */
+    if ( Size > 0x10000 ) {
+        return 0;
+    }
+
+    while ( x < Size ) {
+        if ( Data[ x ] == Previous[ x ] ) {
+            x++;
+            continue;
+        }
+
+        PageEnd = ( ( x / PageSize ) + 1 ) * PageSize;
+        PageEnd = ( PageEnd > Size ) ? Size : PageEnd;
+
+        /* Unchanged gaps shorter than a span header are cheaper to include than to skip */
+        SpanStart = x;
+        SpanEnd = x + 1;
+
+        for ( Gap = 0, x++; x < PageEnd && Gap < sizeof( struct ANM_DeltaSpan ) && x - SpanStart < 0xFFFF; x++ ) {
+            if ( Data[ x ] != Previous[ x ] ) {
+                SpanEnd = x + 1;
+                Gap = 0;
+            } else {
+                Gap++;
+            }
+        }
+
+        if ( Out + sizeof( struct ANM_DeltaSpan ) + ( SpanEnd - SpanStart ) >= Limit ) {
+            return 0;
+        }
+
+        Span.Offset = ( uint16_t ) SpanStart;
+        Span.Count = ( uint16_t ) ( SpanEnd - SpanStart );
+
+        memcpy( &Output[ Out ], &Span, sizeof( struct ANM_DeltaSpan ) );
+        Out+= sizeof( struct ANM_DeltaSpan );
+
+        for ( i = SpanStart; i < SpanEnd; i++ ) {
+            Output[ Out++ ] = Data[ i ] ^ Previous[ i ];
+        }
+
+        x = SpanEnd;
+    }
+
+    return Out;
+}
+
+/*
+ * Writes (Data) with whichever of the frame encodings comes out smallest.
+ */
+static bool AddCompressedFrame( struct Output* Output, uint8_t* Data ) {
+    size_t DataSize = ( Output->Width * Output->Height ) / 8;
+    struct ANM_FrameHeader FrameHeader;
+    const uint8_t* Best = Data;
+    size_t BestSize = DataSize;
+    size_t Size = 0;
+
+    NullCheck( Output->File, return false );
+    NullCheck( Data, return false );
+
+    if ( Output->PreviousFrame == NULL ) {
+        Output->PreviousFrame = ( uint8_t* ) malloc( DataSize );
+        Output->EncodeBuffer = ( uint8_t* ) malloc( DataSize * 2 );
+
+        NullCheck( Output->PreviousFrame, return false );
+        NullCheck( Output->EncodeBuffer, return false );
+    }
+
+    FrameHeader.Encoding = FrameEncoding_Raw;
+
+    if ( ( Size = EncodeRLE( Data, DataSize, GetPageSize( Output ), Output->EncodeBuffer, BestSize ) ) > 0 ) {
+        FrameHeader.Encoding = FrameEncoding_RLE;
+        Best = Output->EncodeBuffer;
+        BestSize = Size;
+    }
+
+    if ( Output->FramesStored > 0 ) {
+        /* An unchanged frame encodes to nothing, which is the smallest there is */
+        Size = EncodeDelta( Data, Output->PreviousFrame, DataSize, GetPageSize( Output ), &Output->EncodeBuffer[ DataSize ], BestSize );
+
+        if ( Size > 0 || memcmp( Data, Output->PreviousFrame, DataSize ) == 0 ) {
+            FrameHeader.Encoding = FrameEncoding_Delta;
+            Best = &Output->EncodeBuffer[ DataSize ];
+            BestSize = Size;
+        }
+    }
+
+    FrameHeader.Length[ 0 ] = ( uint8_t ) ( BestSize & 0xFF );
+    FrameHeader.Length[ 1 ] = ( uint8_t ) ( ( BestSize >> 8 ) & 0xFF );
+    FrameHeader.Length[ 2 ] = ( uint8_t ) ( ( BestSize >> 16 ) & 0xFF );
+
+    if ( fwrite( &FrameHeader, 1, sizeof( struct ANM_FrameHeader ), Output->File ) != sizeof( struct ANM_FrameHeader ) ) {
+        return false;
+    }
+
+    if ( fwrite( Best, 1, BestSize, Output->File ) != BestSize ) {
+        return false;
+    }
+
+    memcpy( Output->PreviousFrame, Data, DataSize );
+    Output->FramesStored++;
+
+    return true;
+}
+
+/*
+ * Remembers where the frame about to be written starts.
+ */
+static bool AddFrameOffset( struct Output* Output ) {
+    uint32_t* Offsets = NULL;
+    long Offset = 0;
+
+    if ( Output->FramesStored >= Output->FrameOffsetsSize ) {
+        Offsets = ( uint32_t* ) realloc( Output->FrameOffsets, sizeof( uint32_t ) * ( Output->FrameOffsetsSize + 256 ) );
+        NullCheck( Offsets, return false );
+
+        Output->FrameOffsets = Offsets;
+        Output->FrameOffsetsSize+= 256;
+    }
+
+    CheckExpr( ( Offset = ftell( Output->File ) ) < 0, return false );
+    Output->FrameOffsets[ Output->FramesStored ] = ( uint32_t ) Offset;
+
+    return true;
+}
+
+/*
+ * Writes the parts of (Framebuffer) that changed since the last frame
+ * as described for Format_1306_Dirty.
+ */
+static bool AddDirtyFrame( struct Output* Output, const uint8_t* Framebuffer ) {
+    struct ANM_DirtyFrame FrameHeader;
+    const struct ANM_DirtyRect* Rects = NULL;
+    int RectCount = 0;
+    size_t Width = 0;
+    int Page = 0;
+    int i = 0;
+
+    NullCheck( Output->File, return false );
+    NullCheck( Framebuffer, return false );
+
+    if ( Output->Dirty.Previous == NULL && Dirty_Create( &Output->Dirty, Output->Width, Output->Height ) == false ) {
+        return false;
+    }
+
+    RectCount = Dirty_Update( &Output->Dirty, Framebuffer );
+    Rects = Output->Dirty.Rects;
+
+    if ( Output->Options->Container == Container_ANM && AddFrameOffset( Output ) == false ) {
+        return false;
+    }
+
+    FrameHeader.RectCount = ( uint16_t ) RectCount;
+
+    if ( fwrite( &FrameHeader, 1, sizeof( struct ANM_DirtyFrame ), Output->File ) != sizeof( struct ANM_DirtyFrame ) ) {
+        return false;
+    }
+
+    for ( i = 0; i < RectCount; i++ ) {
+        if ( fwrite( &Rects[ i ], 1, sizeof( struct ANM_DirtyRect ), Output->File ) != sizeof( struct ANM_DirtyRect ) ) {
+            return false;
+        }
+
+        Width = ( Rects[ i ].EndColumn - Rects[ i ].StartColumn ) + 1;
+
+        for ( Page = Rects[ i ].StartPage; Page <= Rects[ i ].EndPage; Page++ ) {
+            if ( fwrite( &Framebuffer[ ( Page * Output->Width ) + Rects[ i ].StartColumn ], 1, Width, Output->File ) != Width ) {
+                return false;
+            }
+        }
+    }
+
+    Output->FramesStored++;
+    return true;
+}
+
+/*
+ * Stores (Data) unless --dedup finds the same frame already in the file, and adds it
+ * to the frame table either way in case the output turns out to need one.
+ */
+static bool AddTableFrame( struct Output* Output, uint8_t* Data, uint32_t Delay ) {
+    const struct Options* Options = Output->Options;
+    size_t DataSize = ( Output->Width * Output->Height ) / 8;
+    bool AnyOrder = ( Options->CompressFlag == false && Options->OutputFormat != Format_1306_Dirty ) ? true : false;
+    bool Stored = false;
+    int Frame = -1;
+
+    NullCheck( Data, return false );
+
+    if ( Output->Dedup.FrameSize == 0 && Dedup_Create( &Output->Dedup, DataSize, AnyOrder ) == false ) {
+        return false;
+    }
+
+    if ( Options->DedupFlag == true ) {
+        Frame = Dedup_Find( &Output->Dedup, Data );
+    }
+
+    if ( Frame < 0 ) {
+        Frame = Output->FramesStored;
+        Stored = ( Options->OutputFormat == Format_1306_Dirty ) ? AddDirtyFrame( Output, Data ) : AddANMFrame( Output, Data );
+
+        if ( Stored == false || ( Options->DedupFlag == true && Dedup_AddFrame( &Output->Dedup, Data ) == false ) ) {
+            return false;
+        }
+    }
+
+    return Dedup_AddEntry( &Output->Dedup, Frame, Delay );
+}
+
+/*
+ * The frame table is only written when it says something the ANM0 header can't:
+ * stored frames shown more than once, or frames not shown for the default delay.
+ */
+static bool NeedsFrameTable( const struct Output* Output, uint16_t DefaultDelay ) {
+    int i = 0;
+
+    if ( Output->Options->DedupFlag == true ) {
+        return true;
+    }
+
+    for ( i = 0; i < Output->Dedup.EntryCount; i++ ) {
+        if ( Output->Dedup.Entries[ i ].Delay != DefaultDelay ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool WriteFrameTable( struct Output* Output ) {
+    size_t Count = ( size_t ) Output->Dedup.EntryCount;
+
+    if ( Output->Dedup.Entries == NULL || Count == 0 ) {
+        return true;
+    }
+
+    CheckExpr( fseek( Output->File, 0, SEEK_END ) != 0, return false );
+    return fwrite( Output->Dedup.Entries, sizeof( struct ANM1_FrameEntry ), Count, Output->File ) == Count;
+}
+
+static bool WriteDirtyIndex( struct Output* Output ) {
+    size_t Count = ( size_t ) Output->FramesStored;
+
+    if ( Output->FrameOffsets == NULL || Count == 0 ) {
+        return true;
+    }
+
+    CheckExpr( fseek( Output->File, 0, SEEK_END ) != 0, return false );
+    return fwrite( Output->FrameOffsets, sizeof( uint32_t ), Count, Output->File ) == Count;
 }
 
 #define MakeWord( a, b, c, d ) ( \
@@ -229,59 +804,284 @@ bool AddANMFrame( uint8_t* Data ) {
     ( a ) \
 )
 
-void CloseANMOutput( void ) {
+void CloseANMOutput( struct Output* Output ) {
+    const struct Options* Options = Output->Options;
     struct ANM0_Header Header;
+    bool PatchMemory = false;
+    bool Mapped = false;
+    bool Table = false;
 
-    if ( OutputFile != NULL && CmdLine_GetWriteHeaderFlag( ) == true ) {
-        fseek( OutputFile, 0, SEEK_SET );
-            fread( &Header, sizeof( struct ANM0_Header ), 1, OutputFile );
-        fseek( OutputFile, 0, SEEK_SET );
+    if ( Output->File != NULL && Options->WriteHeader == true ) {
+        Header.DelayBetweenFrames = ( uint16_t ) Options->Delay;
+        Table = NeedsFrameTable( Output, Header.DelayBetweenFrames );
 
-        Header.ANMId = MakeWord( 'A', 'N', 'M', '0' );
-        Header.AddressMode = ( uint8_t ) OutputFormat;
-        Header.CompressionType = 0;
-        Header.FrameCount = ( uint16_t ) FramesWritten;
-        Header.DelayBetweenFrames = ( uint16_t ) CmdLine_GetOutputDelay( );
-        Header.Width = ( uint16_t ) OutputWidth;
-        Header.Height = ( uint16_t ) OutputHeight;
-        Header.Reserved = 0;
+        /* Every field is filled in, so there is no need to read back the placeholder */
+        Header.ANMId = ( Table == true ) ? MakeWord( 'A', 'N', 'M', '1' ) : MakeWord( 'A', 'N', 'M', '0' );
+        Header.AddressMode = ( uint8_t ) Options->OutputFormat;
+        Header.CompressionType = ( Options->CompressFlag == true && Options->OutputFormat != Format_1306_Dirty ) ? Compression_Adaptive : Compression_None;
+        Header.FrameCount = ( uint16_t ) ( ( Table == true ) ? Output->Dedup.EntryCount : Output->FramesWritten );
+        Header.Width = ( uint16_t ) Output->Width;
+        Header.Height = ( uint16_t ) Output->Height;
+        Header.StoredFrameCount = ( uint16_t ) ( ( Table == true ) ? Output->FramesStored : 0 );
 
-        fwrite( &Header, 1, sizeof( struct ANM0_Header ), OutputFile );
-        CloseRawOutput( );
+        if ( ( Mapped = ( Output->Map != NULL ) ) == true ) {
+            /* Header is updated in place, and the file trimmed to the frames written before anything goes after them */
+            memcpy( Output->Map, &Header, sizeof( struct ANM0_Header ) );
+            UnmapOutput( Output );
+        }
+
+        if ( Options->OutputFormat == Format_1306_Dirty ) {
+            WriteDirtyIndex( Output );
+        }
+
+        if ( Table == true ) {
+            WriteFrameTable( Output );
+        }
+
+        if ( Mapped == true ) {
+            /* Already written into the map */
+        } else if ( Output->Filename == NULL ) {
+            /* Seeking back in a memory stream cuts it off there, so patch the buffer once it is closed */
+            PatchMemory = true;
+        } else {
+            fseek( Output->File, 0, SEEK_SET );
+                fwrite( &Header, 1, sizeof( struct ANM0_Header ), Output->File );
+        }
+    }
+
+    CloseRawOutput( Output );
+
+    if ( PatchMemory == true && Output->Memory != NULL && Output->MemorySize >= sizeof( struct ANM0_Header ) ) {
+        memcpy( Output->Memory, &Header, sizeof( struct ANM0_Header ) );
     }
 }
 
-bool OpenOutputFile( void ) {
-    if ( IsOutputAGIF( ) == true ) {
-        return OpenGIFOutput( );
-    } else if ( IsOutputANM( ) == true ) {
-        return OpenANMOutput( );
+/*
+ * Frees the buffers the RAW/ANM writers allocated while writing.
+ */
+static void FreeWriteBuffers( struct Output* Output ) {
+    if ( Output->PreviousFrame != NULL ) {
+        free( Output->PreviousFrame );
+        Output->PreviousFrame = NULL;
+    }
+
+    if ( Output->EncodeBuffer != NULL ) {
+        free( Output->EncodeBuffer );
+        Output->EncodeBuffer = NULL;
+    }
+
+    if ( Output->FrameOffsets != NULL ) {
+        free( Output->FrameOffsets );
+        Output->FrameOffsets = NULL;
+        Output->FrameOffsetsSize = 0;
+    }
+
+    if ( Output->PendingFrame != NULL ) {
+        FreeImage_Unload( Output->PendingFrame );
+        Output->PendingFrame = NULL;
+    }
+
+    Dirty_Free( &Output->Dirty );
+    Dedup_Free( &Output->Dedup );
+}
+
+bool Output_Open( struct Output* Output ) {
+    NullCheck( Output, return false );
+    NullCheck( Output->Options, return false );
+
+    Output->FramesWritten = 0;
+    Output->FramesStored = 0;
+    Output->UserCancel = false;
+
+    if ( WritesPanelFiles( Output ) == true ) {
+        return OpenPanelOutputs( Output );
+    }
+
+    if ( Output->Options->Container == Container_GIF ) {
+        return OpenGIFOutput( Output );
+    } else if ( Output->Options->Container == Container_ANM ) {
+        return OpenANMOutput( Output );
     } else {
     }
 
-    return OpenRawOutput( );
+    if ( OpenRawOutput( Output ) == true ) {
+        /* Falls back to fwrite if the file can't be mapped */
+        if ( MapOutput( Output, 0 ) == false ) {
+            StartAsyncWrites( Output );
+        }
+
+        return true;
+    }
+
+    return false;
 }
 
-void CloseOutputFile( void ) {
-    if ( IsOutputAGIF( ) == true ) {
-        CloseGIFOutput( );
-    } else if ( IsOutputANM( ) == true ) {
-        CloseANMOutput( );
+void Output_Close( struct Output* Output ) {
+    uint64_t Start = Stats_Start( );
+    int i = 0;
+
+    NullCheck( Output, return );
+
+    if ( Output->Options == NULL ) {
+        return;
+    }
+
+    /* Each panel times its own close */
+    if ( Output->Panels != NULL ) {
+        for ( i = 0; i < Output->PanelCount; i++ ) {
+            Output_Close( &Output->Panels[ i ] );
+        }
+
+        return;
+    }
+
+    if ( Output->Options->Container == Container_GIF ) {
+        CloseGIFOutput( Output );
+    } else if ( Output->Options->Container == Container_ANM ) {
+        CloseANMOutput( Output );
     } else {
-        CloseRawOutput( );
+        CloseRawOutput( Output );
     }
+
+    FreeWriteBuffers( Output );
+
+    Stats_Stop( Stage_Close, Start );
 }
 
-bool WriteOutputFile( void* Data ) {
-    if ( IsOutputAGIF( ) == true ) {
-        return AddGIFFrame( ( FIBITMAP* ) Data, CmdLine_GetOutputDelay( ) );
-    } else if ( IsOutputANM( ) == true ) {
+/*
+ * Writes one frame: a 1bpp FIBITMAP for GIF output, otherwise a packed framebuffer.
+ * It is shown for (Delay) milliseconds in GIF and ANM output.
+ */
+bool Output_WriteFrame( struct Output* Output, void* Data, uint32_t Delay ) {
+    uint64_t Start = 0;
+    bool Result = false;
+
+    if ( Output->Panels != NULL ) {
+        return WritePanelFrames( Output, ( uint8_t* ) Data, Delay );
+    }
+
+    Start = Stats_Start( );
+
+    if ( Output->Options->Container == Container_GIF ) {
+        Result = AddGIFFrame( Output, ( FIBITMAP* ) Data, Delay );
+    } else if ( Output->Options->Container == Container_ANM && Output->Options->WriteHeader == true ) {
+        Result = AddTableFrame( Output, ( uint8_t* ) Data, Delay );
+    } else if ( Output->Options->OutputFormat == Format_1306_Dirty ) {
+        Result = AddDirtyFrame( Output, ( const uint8_t* ) Data );
+    } else if ( Output->Options->Container == Container_ANM ) {
         /* TODO:
          * Later revisions may add an individual frame header?
          */
-        return AddANMFrame( ( uint8_t* ) Data );
+        Result = AddANMFrame( Output, ( uint8_t* ) Data );
     } else {
+        Result = AddRawFrame( Output, ( uint8_t* ) Data );
+    }
+
+    if ( Result == true ) {
+        Output->FramesWritten++;
+    }
+
+    Stats_Stop( Stage_Write, Start );
+    return Result;
+}
+
+/*
+ * Opens an output for each panel, named after the output file with the panel number
+ * in front of the extension: sign.anm becomes sign.0.anm, sign.1.anm and so on.
+ * The size of the whole turned frame must already be set.
+ */
+static bool OpenPanelOutputs( struct Output* Output ) {
+    const char* Extension = strrchr( Output->Filename, '.' );
+    const char* Slash = strrchr( Output->Filename, '/' );
+    size_t NameSize = strlen( Output->Filename ) + 16;
+    int PanelWidth = 0;
+    int PanelHeight = 0;
+    int Count = 0;
+    int i = 0;
+
+    FreePanelOutputs( Output );
+
+    CheckExpr( Options_GetPanelSize( Output->Options, Output->Width, Output->Height, &PanelWidth, &PanelHeight ) == false, return false );
+
+    /* A dot in a directory name isn't an extension */
+    if ( Extension == NULL || ( Slash != NULL && Extension < Slash ) ) {
+        Extension = &Output->Filename[ strlen( Output->Filename ) ];
+    }
+
+    Count = Options_GetPanelCount( Output->Options );
+
+    NullCheck( ( Output->Panels = ( struct Output* ) calloc( Count, sizeof( struct Output ) ) ), return false );
+    NullCheck( ( Output->PanelFilenames = ( char** ) calloc( Count, sizeof( char* ) ) ), return false );
+
+    for ( i = 0; i < Count; i++ ) {
+        NullCheck( ( Output->PanelFilenames[ i ] = ( char* ) malloc( NameSize ) ), return false );
+        snprintf( Output->PanelFilenames[ i ], NameSize, "%.*s.%d%s", ( int ) ( Extension - Output->Filename ), Output->Filename, i, Extension );
+
+        Output_Init( &Output->Panels[ i ], Output->Options, Output->PanelFilenames[ i ] );
+        Output->PanelCount++;
+
+        Output->Panels[ i ].Overwrite = Output->Overwrite;
+        Output->Panels[ i ].IsPanel = true;
+        Output->Panels[ i ].Width = PanelWidth;
+        Output->Panels[ i ].Height = PanelHeight;
+
+        if ( Output_Open( &Output->Panels[ i ] ) == false ) {
+            Output->UserCancel = Output->Panels[ i ].UserCancel;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Writes each panel of the packed frame (Data) to its own output,
+ * they follow one another in (Data) the way Pack_Panels leaves them.
+ */
+static bool WritePanelFrames( struct Output* Output, uint8_t* Data, uint32_t Delay ) {
+    size_t PanelSize = ( ( size_t ) Output->Panels[ 0 ].Width * Output->Panels[ 0 ].Height ) / 8;
+    bool Result = true;
+    int i = 0;
+
+    for ( i = 0; i < Output->PanelCount; i++ ) {
+        if ( Output_WriteFrame( &Output->Panels[ i ], &Data[ i * PanelSize ], Delay ) == false ) {
+            Result = false;
+        }
     }
 
-    return AddRawFrame( ( uint8_t* ) Data );
+    if ( Result == true ) {
+        Output->FramesWritten++;
+    }
+
+    return Result;
 }
+
+/*
+ * Closes and frees the panel outputs, if there are any.
+ */
+static void FreePanelOutputs( struct Output* Output ) {
+    int i = 0;
+
+    if ( Output->Panels != NULL ) {
+        for ( i = 0; i < Output->PanelCount; i++ ) {
+            Output_Free( &Output->Panels[ i ] );
+        }
+
+        free( Output->Panels );
+    }
+
+    if ( Output->PanelFilenames != NULL ) {
+        for ( i = 0; i < Output->PanelCount; i++ ) {
+            if ( Output->PanelFilenames[ i ] != NULL ) {
+                free( Output->PanelFilenames[ i ] );
+            }
+        }
+
+        free( Output->PanelFilenames );
+    }
+
+    Output->Panels = NULL;
+    Output->PanelFilenames = NULL;
+    Output->PanelCount = 0;
+}
+
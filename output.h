@@ -1,6 +1,10 @@
 #ifndef _OUTPUT_H_
 #define _OUTPUT_H_
 
+#include "dirty.h"
+#include "dedup.h"
+#include "gif.h"
+
 #define VerboseMessage( Text, ... ) { \
     printf( "%s line %d: %s.\n", __FUNCTION__, __LINE__, Text ); \
 }
@@ -22,7 +26,8 @@
 enum {
     Format_1306_Horizontal = 0,
     Format_1306_Vertical,
-    Format_Linear
+    Format_Linear,
+    Format_1306_Dirty
 };
 
 struct ANM0_Header {
@@ -36,10 +41,12 @@ struct ANM0_Header {
     /* How the image is layed out in memory */
     uint8_t AddressMode;
 
-    /* Unused (for now) */
+    /* One of the Compression_* values below */
     uint8_t CompressionType;
 
-    /* Number of frames in this file, 1 if a single image */
+    /* Number of frames in this file, 1 if a single image.
+     * ANM1: the number of entries in the frame table.
+     */
     uint16_t FrameCount;
 
     /* Delay in milliseconds to wait before showing the next frame */
@@ -48,17 +55,176 @@ struct ANM0_Header {
     uint16_t Width;
     uint16_t Height;
 
-    uint16_t Reserved;
+    /* ANM1: the number of frames stored in the file, 0 in ANM0 */
+    uint16_t StoredFrameCount;
+};
+
+/* ANM1, written with --dedup or when frames are not all shown for DelayBetweenFrames:
+ * Frames that are the same as one already in the file are only stored once. The stored frames
+ * are followed by a table of FrameCount struct ANM1_FrameEntry that says which of them to show
+ * and for how long, in order, which makes up the last FrameCount * 4 bytes of the file.
+ * Without --dedup every frame is stored and the table only carries the delays.
+ * For Format_1306_Dirty it comes after the frame index, which has StoredFrameCount offsets.
+ * Uncompressed frames can be shown in any order, compressed and dirty ones build on the
+ * frame stored before them so the table only ever repeats the frame shown last.
+ */
+struct ANM1_FrameEntry {
+    /* Stored frame to show */
+    uint16_t Frame;
+
+    /* Milliseconds to show it for */
+    uint16_t Delay;
+};
+
+enum {
+    /* Frames are stored one after the other as raw framebuffers */
+    Compression_None = 0,
+
+    /* Every frame starts with a struct ANM_FrameHeader saying how it was encoded */
+    Compression_Adaptive
+};
+
+enum {
+    /* Raw framebuffer */
+    FrameEncoding_Raw = 0,
+
+    /* PackBits style RLE: a control byte c followed by either
+     * c + 1 literal bytes (c < 0x80) or one byte repeated ( c & 0x7F ) + 1 times.
+     */
+    FrameEncoding_RLE,
+
+    /* A list of struct ANM_DeltaSpan, each followed by Count bytes to XOR
+     * into the previous frame starting at Offset. No spans means the frame did not change.
+     */
+    FrameEncoding_Delta
+};
+
+/* In SSD1306 horizontal mode RLE runs and delta spans never cross a page,
+ * so a frame can be decoded and sent to the display one page at a time.
+ */
+struct ANM_FrameHeader {
+    /* One of the FrameEncoding_* values */
+    uint8_t Encoding;
+
+    /* Size in bytes of the encoded data following this header, 24 bit little endian */
+    uint8_t Length[ 3 ];
+};
+
+struct ANM_DeltaSpan {
+    /* Byte offset into the framebuffer */
+    uint16_t Offset;
+
+    /* Number of bytes that follow */
+    uint16_t Count;
+};
+
+/* Format_1306_Dirty:
+ * Each frame only carries the parts of the SSD1306 horizontal mode framebuffer that changed
+ * since the previous frame, as rectangles ready for the column (0x21) and page (0x22) address
+ * commands. A frame is a struct ANM_DirtyFrame followed by RectCount rectangles, each of them
+ * a struct ANM_DirtyRect followed by its pixel data in horizontal addressing order.
+ * The first frame is always a single full screen rectangle.
+ *
+ * Since frames differ in size, ANM files in this format end with an index of FrameCount
+ * uint32_t file offsets, one per frame, starting FrameCount * 4 bytes before the end of the file.
+ */
+struct ANM_DirtyFrame {
+    uint16_t RectCount;
+};
+
+struct ANM_DirtyRect {
+    /* Inclusive page range */
+    uint8_t StartPage;
+    uint8_t EndPage;
+
+    /* Inclusive column range */
+    uint16_t StartColumn;
+    uint16_t EndColumn;
+};
+
+/* What to do when the output file already exists */
+enum {
+    Overwrite_Ask = 0,
+    Overwrite_Never,
+    Overwrite_Always
+};
+
+/*
+ * Everything needed to write one output file, or one output buffer in memory.
+ * Nothing in here is shared, so any number of outputs can be written at the same time
+ * as long as each one is only used from one thread at a time.
+ */
+struct Output {
+    const struct Options* Options;
+
+    /* NULL writes the output to memory, see Output_GetMemory */
+    const char* Filename;
+    int Overwrite;
+    bool UserCancel;
+
+    FILE* File;
+    struct GIFEncoder GIF;
+
+    /* Size of the frames in the output, after --rotate */
+    int Width;
+    int Height;
+
+    /* Frames passed to Output_WriteFrame, and the number of them that ended up in the file */
+    int FramesWritten;
+    int FramesStored;
+
+    /* When the number of frames is known up front RAW/ANM output is preallocated and mapped,
+     * frames are then packed straight into their place in the file.
+     */
+    int ExpectedFrameCount;
+    uint8_t* Map;
+    size_t MapSize;
+    size_t MapHeaderSize;
+
+    /* Compressed ANM output needs the last frame and somewhere to try each encoding */
+    uint8_t* PreviousFrame;
+    uint8_t* EncodeBuffer;
+
+    /* Format_1306_Dirty output: what changed, and the file offset of every frame for the index */
+    struct DirtyTracker Dirty;
+    uint32_t* FrameOffsets;
+    int FrameOffsetsSize;
+
+    /* ANM1 output, also keeps the delay of every ANM frame in case they differ */
+    struct FrameDedup Dedup;
+
+    /* GIF output with --dedup: the last frame is held back until one that differs from it
+     * arrives, so repeats only add to its delay.
+     */
+    FIBITMAP* PendingFrame;
+    uint32_t PendingDelay;
+
+    /* Memory output, valid once the output is closed */
+    char* Memory;
+    size_t MemorySize;
+
+    /* RAW/ANM output split into a file per panel, see Options->PanelColumns: each panel of a frame
+     * goes to an output of its own, which compresses, deduplicates and tracks dirty rectangles by itself.
+     * IsPanel is set on those, they are written to as they are.
+     */
+    struct Output* Panels;
+    char** PanelFilenames;
+    int PanelCount;
+    bool IsPanel;
 };
 
-bool DidUserCancel( void );
+void Output_Init( struct Output* Output, const struct Options* Options, const char* Filename );
+void Output_Free( struct Output* Output );
 
-bool IsOutputAGIF( void );
-bool IsOutputANM( void );
+bool Output_DidUserCancel( const struct Output* Output );
 
-void SetOutputParameters( int Width, int Height );
-bool OpenOutputFile( void );
-void CloseOutputFile( void );
-bool WriteOutputFile( void* Data );
+void Output_SetSize( struct Output* Output, int Width, int Height );
+void Output_SetFrameCount( struct Output* Output, int Count );
+bool Output_CanPreallocate( const struct Output* Output );
+uint8_t* Output_GetFrameBuffer( const struct Output* Output, int Index );
+bool Output_Open( struct Output* Output );
+void Output_Close( struct Output* Output );
+bool Output_WriteFrame( struct Output* Output, void* Data, uint32_t Delay );
+const uint8_t* Output_GetMemory( const struct Output* Output, size_t* Size );
 
 #endif
@@ -0,0 +1,356 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "options.h"
+#include "output.h"
+#include "pack.h"
+#include "transpose.h"
+
+/* Number of columns PackVertical transposes before scattering them into place */
+#define VerticalStripWidth 256
+
+/*
+ * SSD1306 horizontal addressing mode:
+ * Each page is 8 rows tall and stored as one byte per column, pages follow one another.
+ */
+static void PackHorizontal( const uint8_t* Bits, int Pitch, int Width, int Height, uint8_t Xor, uint8_t* Output ) {
+    int Page = 0;
+
+    for ( Page = 0; Page < Height / 8; Page++ ) {
+        Transpose_Page( &Bits[ Page * 8 * Pitch ], Pitch, Width / 8, Xor, &Output[ Page * Width ] );
+    }
+}
+
+/*
+ * SSD1306 vertical addressing mode:
+ * Same page bytes as horizontal mode but stored column by column.
+ */
+static void PackVertical( const uint8_t* Bits, int Pitch, int Width, int Height, uint8_t Xor, uint8_t* Output ) {
+    uint8_t Columns[ VerticalStripWidth ];
+    int PageCount = Height / 8;
+    int StripWidth = 0;
+    int Page = 0;
+    int x = 0;
+    int i = 0;
+
+    for ( Page = 0; Page < PageCount; Page++ ) {
+        for ( x = 0; x < Width; x+= StripWidth ) {
+            StripWidth = ( Width - x ) < VerticalStripWidth ? ( Width - x ) : VerticalStripWidth;
+            Transpose_Page( &Bits[ ( Page * 8 * Pitch ) + ( x / 8 ) ], Pitch, StripWidth / 8, Xor, Columns );
+
+            for ( i = 0; i < StripWidth; i++ ) {
+                Output[ ( ( x + i ) * PageCount ) + Page ] = Columns[ i ];
+            }
+        }
+    }
+}
+
+/*
+ * Linear mode is the same layout as a 1bpp scanline so each row is a straight copy.
+ */
+static void PackLinear( const uint8_t* Bits, int Pitch, int Width, int Height, uint8_t Xor, uint8_t* Output ) {
+    int LineSize = Width / 8;
+    int y = 0;
+    int x = 0;
+
+    for ( y = 0; y < Height; y++ ) {
+        if ( Xor == 0 ) {
+            memcpy( &Output[ y * LineSize ], &Bits[ y * Pitch ], LineSize );
+        } else {
+            for ( x = 0; x < LineSize; x++ ) {
+                Output[ ( y * LineSize ) + x ] = Bits[ ( y * Pitch ) + x ] ^ Xor;
+            }
+        }
+    }
+}
+
+static uint8_t ReverseBits( uint8_t Byte ) {
+    Byte = ( uint8_t ) ( ( Byte & 0xF0 ) >> 4 | ( Byte & 0x0F ) << 4 );
+    Byte = ( uint8_t ) ( ( Byte & 0xCC ) >> 2 | ( Byte & 0x33 ) << 2 );
+    Byte = ( uint8_t ) ( ( Byte & 0xAA ) >> 1 | ( Byte & 0x55 ) << 1 );
+
+    return Byte;
+}
+
+/*
+ * Mirrored versions of the above, the columns of every page or scanline are written right to left.
+ */
+static void PackHorizontalMirrored( const uint8_t* Bits, int Pitch, int Width, int Height, uint8_t Xor, uint8_t* Output ) {
+    uint8_t* Columns = NULL;
+    uint8_t Column = 0;
+    int Page = 0;
+    int x = 0;
+
+    for ( Page = 0; Page < Height / 8; Page++ ) {
+        Columns = &Output[ Page * Width ];
+        Transpose_Page( &Bits[ Page * 8 * Pitch ], Pitch, Width / 8, Xor, Columns );
+
+        for ( x = 0; x < Width / 2; x++ ) {
+            Column = Columns[ x ];
+            Columns[ x ] = Columns[ Width - 1 - x ];
+            Columns[ Width - 1 - x ] = Column;
+        }
+    }
+}
+
+static void PackVerticalMirrored( const uint8_t* Bits, int Pitch, int Width, int Height, uint8_t Xor, uint8_t* Output ) {
+    uint8_t Columns[ VerticalStripWidth ];
+    int PageCount = Height / 8;
+    int StripWidth = 0;
+    int Page = 0;
+    int x = 0;
+    int i = 0;
+
+    for ( Page = 0; Page < PageCount; Page++ ) {
+        for ( x = 0; x < Width; x+= StripWidth ) {
+            StripWidth = ( Width - x ) < VerticalStripWidth ? ( Width - x ) : VerticalStripWidth;
+            Transpose_Page( &Bits[ ( Page * 8 * Pitch ) + ( x / 8 ) ], Pitch, StripWidth / 8, Xor, Columns );
+
+            for ( i = 0; i < StripWidth; i++ ) {
+                Output[ ( ( Width - 1 - ( x + i ) ) * PageCount ) + Page ] = Columns[ i ];
+            }
+        }
+    }
+}
+
+static void PackLinearMirrored( const uint8_t* Bits, int Pitch, int Width, int Height, uint8_t Xor, uint8_t* Output ) {
+    int LineSize = Width / 8;
+    int y = 0;
+    int x = 0;
+
+    for ( y = 0; y < Height; y++ ) {
+        for ( x = 0; x < LineSize; x++ ) {
+            Output[ ( y * LineSize ) + x ] = ReverseBits( Bits[ ( y * Pitch ) + ( LineSize - 1 - x ) ] ) ^ Xor;
+        }
+    }
+}
+
+/*
+ * Frames turned on their side:
+ * Output column x is scanline x of the frame (Pitch takes care of which end that starts from),
+ * and output row y is column y of the frame, or column ( Width - 1 - y ) if (Reverse) is set.
+ * Width and Height are the size of the frame, the output is Height pixels wide.
+ *
+ * An SSD1306 page byte holds 8 pixels of one output column, which are 8 pixels next to each other
+ * in a scanline of the frame. So both page formats are a byte gather, bit reversed unless the
+ * columns run backwards too.
+ */
+static void PackHorizontalSideways( const uint8_t* Bits, int Pitch, int Width, int Height, bool Reverse, uint8_t Xor, uint8_t* Output ) {
+    const uint8_t* Line = NULL;
+    int LineSize = Width / 8;
+    int Page = 0;
+    int x = 0;
+
+    for ( x = 0; x < Height; x++ ) {
+        Line = &Bits[ x * Pitch ];
+
+        for ( Page = 0; Page < LineSize; Page++ ) {
+            Output[ ( Page * Height ) + x ] = ( ( Reverse == true ) ? Line[ LineSize - 1 - Page ] : ReverseBits( Line[ Page ] ) ) ^ Xor;
+        }
+    }
+}
+
+static void PackVerticalSideways( const uint8_t* Bits, int Pitch, int Width, int Height, bool Reverse, uint8_t Xor, uint8_t* Output ) {
+    const uint8_t* Line = NULL;
+    int LineSize = Width / 8;
+    int Page = 0;
+    int x = 0;
+
+    for ( x = 0; x < Height; x++, Output+= LineSize ) {
+        Line = &Bits[ x * Pitch ];
+
+        for ( Page = 0; Page < LineSize; Page++ ) {
+            Output[ Page ] = ( ( Reverse == true ) ? Line[ LineSize - 1 - Page ] : ReverseBits( Line[ Page ] ) ) ^ Xor;
+        }
+    }
+}
+
+/*
+ * Linear output needs the frame transposed, 8 scanlines at a time with the same transposes the
+ * page formats use. Feeding them in bottom up puts the first of them in the MSB.
+ */
+static void PackLinearSideways( const uint8_t* Bits, int Pitch, int Width, int Height, bool Reverse, uint8_t Xor, uint8_t* Output ) {
+    uint8_t Columns[ VerticalStripWidth ];
+    int LineSize = Height / 8;
+    int StripWidth = 0;
+    int Block = 0;
+    int x = 0;
+    int y = 0;
+    int i = 0;
+
+    for ( Block = 0; Block < LineSize; Block++ ) {
+        for ( x = 0; x < Width; x+= StripWidth ) {
+            StripWidth = ( Width - x ) < VerticalStripWidth ? ( Width - x ) : VerticalStripWidth;
+            Transpose_Page( &Bits[ ( ( ( Block * 8 ) + 7 ) * Pitch ) + ( x / 8 ) ], -Pitch, StripWidth / 8, Xor, Columns );
+
+            for ( i = 0; i < StripWidth; i++ ) {
+                y = ( Reverse == true ) ? Width - 1 - ( x + i ) : x + i;
+                Output[ ( y * LineSize ) + Block ] = Columns[ i ];
+            }
+        }
+    }
+}
+
+/*
+ * Packs a top-down, MSB first 1bpp bitmap into (Output) using the given output format.
+ * Pitch is the distance in bytes between scanlines and may be negative, Width and Height
+ * must be divisible by 8. The frame is turned by (Rotation) and then mirrored if (Mirror)
+ * is set, as it is packed. If Invert is set every output bit is flipped.
+ */
+void Pack_Frame( const uint8_t* Bits, int Pitch, int Width, int Height, int Format, int Rotation, bool Mirror, bool Invert, uint8_t* Output ) {
+    uint8_t Xor = ( Invert == true ) ? 0xFF : 0x00;
+    bool Reverse = false;
+
+    NullCheck( Bits, return );
+    NullCheck( Output, return );
+
+    /* Anything that reads the scanlines bottom up just starts at the other end */
+    if ( Rotation == Rotate_180 || ( Rotation == Rotate_90 && Mirror == false ) || ( Rotation == Rotate_270 && Mirror == true ) ) {
+        Bits = &Bits[ ( Height - 1 ) * Pitch ];
+        Pitch = -Pitch;
+    }
+
+    if ( Rotation == Rotate_90 || Rotation == Rotate_270 ) {
+        Reverse = ( Rotation == Rotate_270 ) ? true : false;
+
+        switch ( Format ) {
+            case Format_1306_Horizontal:
+            case Format_1306_Dirty: {
+                PackHorizontalSideways( Bits, Pitch, Width, Height, Reverse, Xor, Output );
+                break;
+            }
+            case Format_1306_Vertical: {
+                PackVerticalSideways( Bits, Pitch, Width, Height, Reverse, Xor, Output );
+                break;
+            }
+            case Format_Linear: {
+                PackLinearSideways( Bits, Pitch, Width, Height, Reverse, Xor, Output );
+                break;
+            }
+            default: break;
+        };
+
+        return;
+    }
+
+    /* Turning it upside down mirrors it as well */
+    if ( ( Rotation == Rotate_180 ) != Mirror ) {
+        switch ( Format ) {
+            case Format_1306_Horizontal:
+            case Format_1306_Dirty: {
+                PackHorizontalMirrored( Bits, Pitch, Width, Height, Xor, Output );
+                break;
+            }
+            case Format_1306_Vertical: {
+                PackVerticalMirrored( Bits, Pitch, Width, Height, Xor, Output );
+                break;
+            }
+            case Format_Linear: {
+                PackLinearMirrored( Bits, Pitch, Width, Height, Xor, Output );
+                break;
+            }
+            default: break;
+        };
+
+        return;
+    }
+
+    switch ( Format ) {
+        case Format_1306_Horizontal:
+        case Format_1306_Dirty: {
+            PackHorizontal( Bits, Pitch, Width, Height, Xor, Output );
+            break;
+        }
+        case Format_1306_Vertical: {
+            PackVertical( Bits, Pitch, Width, Height, Xor, Output );
+            break;
+        }
+        case Format_Linear: {
+            PackLinear( Bits, Pitch, Width, Height, Xor, Output );
+            break;
+        }
+        default: break;
+    };
+}
+
+/*
+ * Packs a frame like Pack_Frame, split into (Columns)x(Rows) panels of the turned frame.
+ * Each panel is packed as a whole frame for a display of its own size, the top left one first
+ * and then along each row. The panels must have sides divisible by 8, see Options_GetPanelSize.
+ */
+void Pack_Panels( const uint8_t* Bits, int Pitch, int Width, int Height, int Format, int Rotation, bool Mirror, bool Invert, int Columns, int Rows, uint8_t* Output ) {
+    bool Sideways = ( Rotation == Rotate_90 || Rotation == Rotate_270 ) ? true : false;
+    int OutputWidth = ( Sideways == true ) ? Height : Width;
+    int OutputHeight = ( Sideways == true ) ? Width : Height;
+    int PanelWidth = 0;
+    int PanelHeight = 0;
+    size_t PanelSize = 0;
+    int Column = 0;
+    int Row = 0;
+    int Left = 0;
+    int Top = 0;
+    int x = 0;
+    int y = 0;
+
+    if ( Columns <= 1 && Rows <= 1 ) {
+        Pack_Frame( Bits, Pitch, Width, Height, Format, Rotation, Mirror, Invert, Output );
+        return;
+    }
+
+    PanelWidth = OutputWidth / Columns;
+    PanelHeight = OutputHeight / Rows;
+    PanelSize = ( ( size_t ) PanelWidth * PanelHeight ) / 8;
+
+    for ( Row = 0; Row < Rows; Row++ ) {
+        for ( Column = 0; Column < Columns; Column++ ) {
+            /* Where the panel is before the mirror, then the area of the source frame the turn takes it from */
+            Left = ( Mirror == true ) ? OutputWidth - ( ( Column + 1 ) * PanelWidth ) : Column * PanelWidth;
+            Top = Row * PanelHeight;
+
+            switch ( Rotation ) {
+                case Rotate_90: {
+                    x = Top;
+                    y = OutputWidth - Left - PanelWidth;
+                    break;
+                }
+                case Rotate_180: {
+                    x = OutputWidth - Left - PanelWidth;
+                    y = OutputHeight - Top - PanelHeight;
+                    break;
+                }
+                case Rotate_270: {
+                    x = OutputHeight - Top - PanelHeight;
+                    y = Left;
+                    break;
+                }
+                default: {
+                    x = Left;
+                    y = Top;
+                    break;
+                }
+            };
+
+            Pack_Frame(
+                &Bits[ ( y * Pitch ) + ( x / 8 ) ],
+                Pitch,
+                ( Sideways == true ) ? PanelHeight : PanelWidth,
+                ( Sideways == true ) ? PanelWidth : PanelHeight,
+                Format,
+                Rotation,
+                Mirror,
+                Invert,
+                &Output[ ( ( size_t ) ( Row * Columns ) + Column ) * PanelSize ]
+            );
+        }
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef _PACK_H_
+#define _PACK_H_
+
+void Pack_Frame( const uint8_t* Bits, int Pitch, int Width, int Height, int Format, int Rotation, bool Mirror, bool Invert, uint8_t* Output );
+void Pack_Panels( const uint8_t* Bits, int Pitch, int Width, int Height, int Format, int Rotation, bool Mirror, bool Invert, int Columns, int Rows, uint8_t* Output );
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "pages.h"
+
+/* Page list entries are allocated this many at a time */
+#define GrowBy 256
+
+/*
+ * Opens (Filename) as a multi-page bitmap if it is in a format that can have more than one page,
+ * returns NULL otherwise. Animated GIF pages come out as full frames the way they are shown.
+ */
+static FIMULTIBITMAP* OpenMultiPage( const char* Filename ) {
+    FREE_IMAGE_FORMAT Format = FreeImage_GetFIFFromFilename( Filename );
+
+    switch ( Format ) {
+        case FIF_GIF: return FreeImage_OpenMultiBitmap( FIF_GIF, Filename, FALSE, TRUE, FALSE, GIF_PLAYBACK );
+        case FIF_TIFF:
+        case FIF_ICO: return FreeImage_OpenMultiBitmap( Format, Filename, FALSE, TRUE, FALSE, 0 );
+        default: break;
+    };
+
+    return NULL;
+}
+
+/*
+ * Only looks at the structure of the file, no pages are decoded.
+ * Anything that can't be opened counts as a single page, loading it reports the error.
+ */
+static int CountPages( const char* Filename ) {
+    FIMULTIBITMAP* Multi = NULL;
+    int Count = 1;
+
+    if ( ( Multi = OpenMultiPage( Filename ) ) != NULL ) {
+        Count = FreeImage_GetPageCount( Multi );
+        FreeImage_CloseMultiBitmap( Multi, 0 );
+    }
+
+    return ( Count > 1 ) ? Count : 1;
+}
+
+/*
+ * Lists the frames in (Filenames), which must stay around until the list is closed.
+ */
+bool Pages_Open( struct PageList* List, const char** Filenames, int FileCount ) {
+    struct InputPage* Pages = NULL;
+    int PageCount = 0;
+    int Size = 0;
+    int i = 0;
+    int p = 0;
+
+    NullCheck( List, return false );
+    NullCheck( Filenames, return false );
+
+    memset( List, 0, sizeof( struct PageList ) );
+
+    List->Filenames = Filenames;
+    List->OpenFile = -1;
+
+    for ( i = 0; i < FileCount; i++ ) {
+        PageCount = CountPages( Filenames[ i ] );
+
+        if ( List->Count + PageCount > Size ) {
+            Pages = ( struct InputPage* ) realloc( List->Pages, sizeof( struct InputPage ) * ( List->Count + PageCount + GrowBy ) );
+            NullCheck( Pages, return false );
+
+            List->Pages = Pages;
+            Size = List->Count + PageCount + GrowBy;
+        }
+
+        for ( p = 0; p < PageCount; p++ ) {
+            List->Pages[ List->Count ].File = i;
+            List->Pages[ List->Count ].Page = ( PageCount > 1 ) ? p : -1;
+            List->Count++;
+        }
+
+        if ( PageCount > 1 ) {
+            List->MultiPage = true;
+        }
+    }
+
+    return true;
+}
+
+void Pages_Close( struct PageList* List ) {
+    if ( List != NULL ) {
+        if ( List->Open != NULL ) {
+            FreeImage_CloseMultiBitmap( List->Open, 0 );
+        }
+
+        if ( List->Pages != NULL ) {
+            free( List->Pages );
+        }
+
+        memset( List, 0, sizeof( struct PageList ) );
+    }
+}
+
+/*
+ * Returns true if frame (Index) has to be read with Pages_ReadPage,
+ * otherwise it is a whole file that can be loaded on its own.
+ */
+bool Pages_IsMultiPage( const struct PageList* List, int Index ) {
+    return ( Index >= 0 && Index < List->Count && List->Pages[ Index ].Page >= 0 ) ? true : false;
+}
+
+/*
+ * Returns a name for frame (Index) to use in messages, which may be put together in (Buffer).
+ */
+const char* Pages_GetName( const struct PageList* List, int Index, char* Buffer, size_t BufferSize ) {
+    const struct InputPage* Page = &List->Pages[ Index ];
+
+    if ( Page->Page < 0 ) {
+        return List->Filenames[ Page->File ];
+    }
+
+    snprintf( Buffer, BufferSize, "%s page %d", List->Filenames[ Page->File ], Page->Page );
+    return Buffer;
+}
+
+/*
+ * Decodes page frame (Index) into a bitmap of its own, the caller unloads it.
+ * Must be called in frame order, from one thread at a time.
+ */
+FIBITMAP* Pages_ReadPage( struct PageList* List, int Index, int* OutImageWidth, int* OutImageHeight ) {
+    const struct InputPage* Page = NULL;
+    FIBITMAP* Locked = NULL;
+    FIBITMAP* Result = NULL;
+
+    NullCheck( List, return NULL );
+    NullCheck( OutImageWidth, return NULL );
+    NullCheck( OutImageHeight, return NULL );
+    CheckExpr( Pages_IsMultiPage( List, Index ) == false, return NULL );
+
+    Page = &List->Pages[ Index ];
+
+    if ( List->OpenFile != Page->File ) {
+        if ( List->Open != NULL ) {
+            FreeImage_CloseMultiBitmap( List->Open, 0 );
+        }
+
+        List->Open = OpenMultiPage( List->Filenames[ Page->File ] );
+        List->OpenFile = Page->File;
+    }
+
+    if ( List->Open != NULL && ( Locked = FreeImage_LockPage( List->Open, Page->Page ) ) != NULL ) {
+        /* Locked pages belong to the file, a copy can be converted on any thread while the next page is read */
+        Result = FreeImage_Clone( Locked );
+        FreeImage_UnlockPage( List->Open, Locked, FALSE );
+    }
+
+    /* Done with the file after its last page */
+    if ( List->Open != NULL && ( Index + 1 >= List->Count || List->Pages[ Index + 1 ].File != Page->File ) ) {
+        FreeImage_CloseMultiBitmap( List->Open, 0 );
+        List->Open = NULL;
+    }
+
+    if ( Result != NULL ) {
+        *OutImageWidth = FreeImage_GetWidth( Result );
+        *OutImageHeight = FreeImage_GetHeight( Result );
+    }
+
+    return Result;
+}
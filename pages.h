@@ -0,0 +1,39 @@
+#ifndef _PAGES_H_
+#define _PAGES_H_
+
+/*
+ * Where one frame of the input comes from.
+ */
+struct InputPage {
+    /* Index into the input file names */
+    int File;
+
+    /* Page of a multi-page file, -1 for single page images */
+    int Page;
+};
+
+/*
+ * Every frame in a list of input images: one per single page image, and one per page
+ * of animated GIFs and multi-page TIFFs and icons.
+ * Pages have to be read in order, only the file they come from is kept open.
+ */
+struct PageList {
+    const char** Filenames;
+
+    struct InputPage* Pages;
+    int Count;
+
+    /* Set if any of the inputs has more than one page */
+    bool MultiPage;
+
+    FIMULTIBITMAP* Open;
+    int OpenFile;
+};
+
+bool Pages_Open( struct PageList* List, const char** Filenames, int FileCount );
+void Pages_Close( struct PageList* List );
+bool Pages_IsMultiPage( const struct PageList* List, int Index );
+const char* Pages_GetName( const struct PageList* List, int Index, char* Buffer, size_t BufferSize );
+FIBITMAP* Pages_ReadPage( struct PageList* List, int Index, int* OutImageWidth, int* OutImageHeight );
+
+#endif
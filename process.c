@@ -0,0 +1,661 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <FreeImage.h>
+#include "options.h"
+#include "output.h"
+#include "jobs.h"
+#include "dither.h"
+#include "resize.h"
+#include "convert.h"
+#include "stream.h"
+#include "pages.h"
+#include "stats.h"
+#include "cache.h"
+#include "process.h"
+
+/*
+ * Opens the given input file (Filename) as an FIBITMAP handle.
+ * OutImageWidth and OutImageHeight MUST point to valid integers to receive
+ * the image width and height.
+ * Unless it is scaled to --size the width and height have to be divisible by 8, see ConvertFrame.
+ */
+FIBITMAP* OpenInputImage( const char* Filename, int* OutImageWidth, int* OutImageHeight ) {
+    FREE_IMAGE_FORMAT InputFormat = FIF_UNKNOWN;
+    FIBITMAP* Input = NULL;
+
+    NullCheck( Filename, return NULL );
+    NullCheck( OutImageWidth, return NULL );
+    NullCheck( OutImageHeight, return NULL );
+
+    InputFormat = FreeImage_GetFIFFromFilename( Filename );
+
+    if ( InputFormat != FIF_UNKNOWN ) {
+        Input = FreeImage_Load( InputFormat, Filename, 0 );
+        
+        if ( Input != NULL ) {
+            *OutImageWidth = FreeImage_GetWidth( Input );
+            *OutImageHeight = FreeImage_GetHeight( Input );
+        }
+    }
+
+    return Input;
+}
+
+struct ProcessState {
+    struct PageList Pages;
+    struct Frame* Frames;
+    int OutputWidth;
+    int OutputHeight;
+    int FramesWritten;
+    bool Errors;
+
+    struct Options Options;
+    struct Output Output;
+
+    /* Only used with --raw */
+    struct RawStream Stream;
+    bool Streaming;
+
+    /* Set if the output was opened before the first frame was converted */
+    bool OutputOpen;
+
+    /* Delays from the --timing file, frames past the end of it use their own */
+    uint32_t* Timing;
+    int TimingCount;
+
+    /* Only used with --cache, Cached says which slots hold a frame that came from it */
+    struct FrameCache Cache;
+    bool Caching;
+    bool* Cached;
+    int FramesCached;
+};
+
+/* Longest delay a frame table entry can hold */
+#define MaxTimingDelay 0xFFFF
+
+/*
+ * Reads the --timing file (Filename) into State->Timing: the delay of each frame in turn
+ * in milliseconds, one per line. Blank lines and lines starting with # are skipped.
+ */
+static bool LoadTiming( struct ProcessState* State, const char* Filename ) {
+    uint32_t* Timing = NULL;
+    unsigned long Delay = 0;
+    size_t LineSize = 0;
+    char* Line = NULL;
+    char* Text = NULL;
+    char* End = NULL;
+    int LineNumber = 0;
+    int TimingSize = 0;
+    bool Result = true;
+    FILE* fp = NULL;
+
+    if ( ( fp = fopen( Filename, "r" ) ) == NULL ) {
+        fprintf( stderr, "Failed to open timing file %s: %s\n", Filename, strerror( errno ) );
+        return false;
+    }
+
+    while ( Result == true && getline( &Line, &LineSize, fp ) != -1 ) {
+        LineNumber++;
+
+        for ( Text = Line; isspace( ( unsigned char ) *Text ); Text++ ) {
+        }
+
+        if ( *Text == 0 || *Text == '#' ) {
+            continue;
+        }
+
+        errno = 0;
+        Delay = strtoul( Text, &End, 10 );
+
+        for ( ; isspace( ( unsigned char ) *End ); End++ ) {
+        }
+
+        if ( isdigit( ( unsigned char ) *Text ) == 0 || *End != 0 || errno == ERANGE || Delay > MaxTimingDelay ) {
+            fprintf( stderr, "%s:%d: Invalid delay, expected 0-%d milliseconds\n", Filename, LineNumber, MaxTimingDelay );
+
+            Result = false;
+            break;
+        }
+
+        if ( State->TimingCount >= TimingSize ) {
+            Timing = ( uint32_t* ) realloc( State->Timing, sizeof( uint32_t ) * ( TimingSize + 256 ) );
+            NullCheck( Timing, Result = false; break );
+
+            State->Timing = Timing;
+            TimingSize+= 256;
+        }
+
+        State->Timing[ State->TimingCount++ ] = ( uint32_t ) Delay;
+    }
+
+    if ( Line != NULL ) {
+        free( Line );
+    }
+
+    fclose( fp );
+    return Result;
+}
+
+/*
+ * Reads the frame time stored with (Input) into (FrameTime), GIF frames have one.
+ * Returns false if there isn't one.
+ */
+static bool GetFrameTime( FIBITMAP* Input, uint32_t* FrameTime ) {
+    FITAG* Tag = NULL;
+
+    *FrameTime = 0;
+
+    if ( FreeImage_GetMetadata( FIMD_ANIMATION, Input, "FrameTime", &Tag ) == TRUE && Tag != NULL ) {
+        if ( FreeImage_GetTagType( Tag ) == FIDT_LONG && FreeImage_GetTagCount( Tag ) == 1 ) {
+            *FrameTime = *( ( const uint32_t* ) FreeImage_GetTagValue( Tag ) );
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Returns how long to show frame (Index) for: the --timing file has the final say,
+ * then the frame time stored with the input (GIF frames), then --delay.
+ */
+static uint32_t GetFrameDelay( const struct ProcessState* State, int Index, bool HasFrameTime, uint32_t FrameTime ) {
+    if ( Index < State->TimingCount ) {
+        return State->Timing[ Index ];
+    }
+
+    return ( HasFrameTime == true ) ? FrameTime : State->Options.Delay;
+}
+
+/*
+ * Hashes single page image (Filename) into (Key) and looks it up in the --cache.
+ * On a hit the packed frame is put in (Slot) ready to be written, and true is returned.
+ * (Hashed) is set if the image could be read, so that it can be stored once converted.
+ */
+static bool LoadCachedFrame( struct ProcessState* State, int Index, int Slot, const char* Filename, struct CacheKey* Key, bool* Hashed ) {
+    struct Frame* Frame = &State->Frames[ Slot ];
+    struct CacheEntry Entry;
+    uint64_t Start = 0;
+    bool Result = false;
+
+    Start = Stats_Start( );
+
+    if ( ( *Hashed = Cache_HashFile( Filename, Key ) ) == true ) {
+        Result = Cache_Load( &State->Cache, Key, &Entry, &Frame->Framebuffer, &Frame->FramebufferSize );
+    }
+
+    Stats_Stop( Stage_Cache, Start );
+
+    if ( Result == true ) {
+        Frame->Width = Entry.Width;
+        Frame->Height = Entry.Height;
+        Frame->Delay = GetFrameDelay( State, Index, Entry.HasFrameTime, Entry.FrameTime );
+
+        /* Copied into its place in a mapped output when it is written */
+        Frame->Output = Frame->Framebuffer;
+        State->Cached[ Slot ] = true;
+    }
+
+    return Result;
+}
+
+/*
+ * Reads the next frame of a raw input stream into (Slot).
+ * Called in input order, one frame at a time.
+ */
+static bool ReadFrame( void* Context, int Index, int Slot ) {
+    struct ProcessState* State = ( struct ProcessState* ) Context;
+    struct Frame* Frame = &State->Frames[ Slot ];
+    uint64_t Start = 0;
+    bool Result = false;
+
+    ( void ) Index;
+
+    /* Every frame in a stream is the same size, so each slot keeps its input bitmap */
+    if ( Frame->Input == NULL && ( Frame->Input = Stream_AllocateBitmap( State->Stream.Format, State->Stream.Width, State->Stream.Height ) ) == NULL ) {
+        fprintf( stderr, "Failed to allocate an input frame.\n" );
+        return false;
+    }
+
+    Start = Stats_Start( );
+        Result = Stream_ReadFrame( &State->Stream, Frame->Input );
+    Stats_Stop( Stage_Read, Start );
+
+    return Result;
+}
+
+/*
+ * Reads frame (Index) into (Slot) if it is a page of a multi-page input.
+ * Called in input order, so the next page is decoded while the workers convert the last ones.
+ */
+static bool ReadPage( void* Context, int Index, int Slot ) {
+    struct ProcessState* State = ( struct ProcessState* ) Context;
+    struct Frame* Frame = &State->Frames[ Slot ];
+    uint64_t Start = 0;
+
+    if ( Pages_IsMultiPage( &State->Pages, Index ) == true ) {
+        Start = Stats_Start( );
+            Frame->Page = Pages_ReadPage( &State->Pages, Index, &Frame->Width, &Frame->Height );
+        Stats_Stop( Stage_Decode, Start );
+    }
+
+    /* A page that fails to read is reported when it is written */
+    return true;
+}
+
+/*
+ * Worker side of the pipeline:
+ * Loads input image (Index) and converts it into the frame in (Slot).
+ * This may run on any thread so it must not touch the output file.
+ */
+static void ConvertFrame( void* Context, int Index, int Slot ) {
+    struct ProcessState* State = ( struct ProcessState* ) Context;
+    struct Frame* Frame = &State->Frames[ Slot ];
+    const char* Filename = NULL;
+    FIBITMAP* InputBitmap = NULL;
+    FIBITMAP* Scaled = NULL;
+    struct CacheEntry Entry;
+    int OutputWidth = 0;
+    int OutputHeight = 0;
+    int PanelWidth = 0;
+    int PanelHeight = 0;
+    struct CacheKey Key;
+    bool Hashed = false;
+    uint64_t Start = 0;
+
+    Frame->Status = Frame_Ok;
+    Frame->Bitmap = NULL;
+
+    if ( State->Caching == true ) {
+        State->Cached[ Slot ] = false;
+    }
+
+    /* Unchanged images come straight out of the cache, pages of animations are always converted */
+    if ( State->Streaming == false && Pages_IsMultiPage( &State->Pages, Index ) == false ) {
+        Filename = State->Pages.Filenames[ State->Pages.Pages[ Index ].File ];
+
+        if ( State->Caching == true && LoadCachedFrame( State, Index, Slot, Filename, &Key, &Hashed ) == true ) {
+            return;
+        }
+    }
+
+    Start = Stats_Start( );
+
+    if ( State->Streaming == true ) {
+        InputBitmap = Frame->Input;
+
+        Frame->Width = State->Stream.Width;
+        Frame->Height = State->Stream.Height;
+    } else if ( Filename == NULL ) {
+        InputBitmap = Frame->Page;
+        Frame->Page = NULL;
+    } else {
+        InputBitmap = OpenInputImage( Filename, &Frame->Width, &Frame->Height );
+    }
+
+    Stats_Stop( Stage_Decode, Start );
+
+    if ( InputBitmap == NULL ) {
+        Frame->Status = Frame_OpenFailed;
+        return;
+    }
+
+    /* The frame time is metadata of the input, which the scaled copy doesn't have */
+    Entry.HasFrameTime = GetFrameTime( InputBitmap, &Entry.FrameTime );
+    Frame->Delay = GetFrameDelay( State, Index, Entry.HasFrameTime, Entry.FrameTime );
+
+    /* Colour input goes down to a byte per pixel before anything else looks at it */
+    if ( ( Scaled = Convert_Greyscale( &State->Options, InputBitmap, Frame ) ) != NULL ) {
+        Start = Stats_Start( );
+            Scaled = Convert_Resize( &State->Options, Scaled, Frame );
+        Stats_Stop( Stage_Resize, Start );
+    }
+
+    /* Panels are checked on the frame as it is turned for the output */
+    Options_GetOutputSize( &State->Options, Frame->Width, Frame->Height, &OutputWidth, &OutputHeight );
+
+    if ( Scaled == NULL || Frame->Width % 8 != 0 || Frame->Height % 8 != 0 || Options_GetPanelSize( &State->Options, OutputWidth, OutputHeight, &PanelWidth, &PanelHeight ) == false ) {
+        if ( Scaled == NULL && State->Options.ResizeWidth <= 0 ) {
+            fprintf( stderr, "Error: Failed to convert input image to greyscale.\n" );
+        } else if ( Scaled == NULL ) {
+            fprintf( stderr, "Error: Failed to scale input image to %dx%d.\n", State->Options.ResizeWidth, State->Options.ResizeHeight );
+        } else if ( Frame->Width % 8 != 0 || Frame->Height % 8 != 0 ) {
+            fprintf( stderr, "Error: Input image width and height must be divisible by 8.\n" );
+        } else {
+            fprintf( stderr, "Error: A %dx%d frame can't be split into %dx%d panels with sides divisible by 8.\n", OutputWidth, OutputHeight, State->Options.PanelColumns, State->Options.PanelRows );
+        }
+
+        if ( InputBitmap != Frame->Input ) {
+            FreeImage_Unload( InputBitmap );
+        }
+
+        Frame->Status = Frame_OpenFailed;
+        return;
+    }
+
+    /* State->OutputWidth/Height don't change once the output is open */
+    if ( State->OutputOpen == true && Frame->Width == State->OutputWidth && Frame->Height == State->OutputHeight ) {
+        Frame->Output = Output_GetFrameBuffer( &State->Output, Index );
+    } else {
+        Frame->Output = NULL;
+    }
+
+    Convert_Frame( &State->Options, Scaled, Frame );
+
+    if ( InputBitmap != Frame->Input ) {
+        FreeImage_Unload( InputBitmap );
+    }
+
+    /* Kept as packed, compressing and dedup happen when it is written */
+    if ( Hashed == true && Frame->Status == Frame_Ok && Frame->Output != NULL ) {
+        Entry.Width = Frame->Width;
+        Entry.Height = Frame->Height;
+
+        /* A frame that can't be stored is just converted again next time */
+        Start = Stats_Start( );
+            Cache_Store( &State->Cache, &Key, &Entry, Frame->Output );
+        Stats_Stop( Stage_Cache, Start );
+    }
+}
+
+/*
+ * Writer side of the pipeline, called in input order:
+ * The first image decides the output size and opens the output file.
+ * Returns false if processing should stop.
+ */
+static bool WriteFrame( void* Context, int Index, int Slot ) {
+    struct ProcessState* State = ( struct ProcessState* ) Context;
+    struct Frame* Frame = &State->Frames[ Slot ];
+    const char* Filename = NULL;
+    char FrameName[ 512 ];
+
+    if ( State->Streaming == true ) {
+        snprintf( FrameName, sizeof( FrameName ), "frame %d", Index );
+        Filename = FrameName;
+    } else {
+        Filename = Pages_GetName( &State->Pages, Index, FrameName, sizeof( FrameName ) );
+    }
+
+    /* Make sure we successfully open the input image, if we don't then just bail immediately */
+    if ( Frame->Status == Frame_OpenFailed ) {
+        fprintf( stderr, "Failed to open image %s\n", Filename );
+
+        State->Errors = true;
+        return false;
+    }
+
+    /* Small setup bits at the start */
+    if ( Index == 0 && State->OutputOpen == false ) {
+        Output_SetSize( &State->Output, Frame->Width, Frame->Height );
+
+        State->OutputWidth = Frame->Width;
+        State->OutputHeight = Frame->Height;
+
+        /* Ditto */
+        if ( Output_Open( &State->Output ) == false ) {
+            if ( Output_DidUserCancel( &State->Output ) == false ) {
+                fprintf( stderr, "Failed to open output file: %s\n", strerror( errno ) );
+                State->Errors = true;
+            }
+
+            Convert_ReleaseFrame( Frame );
+            return false;
+        }
+    }
+
+    /* If the current image is not the same size as the first image then write a warning
+     * and move onto the next image.
+     */
+    if ( Frame->Width != State->OutputWidth || Frame->Height != State->OutputHeight ) {
+        fprintf( stderr, "Image %s has a size of %dx%d when we expected %dx%d. Skipping.\n", 
+            Filename,
+            Frame->Width,
+            Frame->Height,
+            State->OutputWidth,
+            State->OutputHeight
+        );
+
+        State->Errors = true;
+        Convert_ReleaseFrame( Frame );
+        return true;
+    }
+
+    switch ( Frame->Status ) {
+        case Frame_ConvertFailed: {
+            fprintf( stderr, "Failed to convert image %s. Skipping.\n", Filename );
+
+            State->Errors = true;
+            return true;
+        }
+        case Frame_NoMemory: {
+            fprintf( stderr, "Failed to allocate an output framebuffer.\n" );
+
+            State->Errors = true;
+            return false;
+        }
+        case Frame_CheckFailed: {
+            fprintf( stderr, "Conversion of image %s did not match the reference output.\n", Filename );
+
+            State->Errors = true;
+            break;
+        }
+        default: break;
+    };
+
+    if ( State->Options.Container != Container_GIF ) {
+        Output_WriteFrame( &State->Output, Frame->Output, Frame->Delay );
+    } else {
+        /* Straight through for GIFs */
+        Output_WriteFrame( &State->Output, ( void* ) Frame->Bitmap, Frame->Delay );
+    }
+
+    Convert_ReleaseFrame( Frame );
+    State->FramesWritten++;
+
+    if ( State->Caching == true && State->Cached[ Slot ] == true ) {
+        State->FramesCached++;
+    }
+
+    return true;
+}
+
+/*
+ * Reads the size of the first input image from its header into (Width) and (Height).
+ * Returns false if it can't be known before the image is loaded.
+ */
+static bool GetFirstImageSize( const struct ProcessState* State, int* Width, int* Height ) {
+    const char* Filename = NULL;
+    FREE_IMAGE_FORMAT InputFormat = FIF_UNKNOWN;
+    FIBITMAP* Header = NULL;
+
+    /* The first page of an animation may be smaller than the frames it is shown as */
+    if ( Pages_IsMultiPage( &State->Pages, 0 ) == true ) {
+        return false;
+    }
+
+    Filename = State->Pages.Filenames[ State->Pages.Pages[ 0 ].File ];
+
+    if ( ( InputFormat = FreeImage_GetFIFFromFilename( Filename ) ) == FIF_UNKNOWN ) {
+        return false;
+    }
+
+    /* Only the header is needed, failures are reported when the image is loaded for real */
+    if ( ( Header = FreeImage_Load( InputFormat, Filename, FIF_LOAD_NOPIXELS ) ) == NULL ) {
+        return false;
+    }
+
+    *Width = FreeImage_GetWidth( Header );
+    *Height = FreeImage_GetHeight( Header );
+
+    FreeImage_Unload( Header );
+    return true;
+}
+
+/*
+ * Opens the output before any frames are converted, using --size or the size of the first input image,
+ * so that frames can be packed straight into a preallocated output file.
+ * Returns false if processing should stop, State->OutputOpen says if the output was opened.
+ */
+static bool OpenOutputEarly( struct ProcessState* State ) {
+    int Width = State->Options.ResizeWidth;
+    int Height = State->Options.ResizeHeight;
+
+    if ( State->Streaming == true || State->Pages.Count < 1 || Output_CanPreallocate( &State->Output ) == false ) {
+        return true;
+    }
+
+    /* Every frame comes out at --size, whatever the inputs are */
+    if ( Width <= 0 && GetFirstImageSize( State, &Width, &Height ) == false ) {
+        return true;
+    }
+
+    if ( Width <= 0 || Height <= 0 || Width % 8 != 0 || Height % 8 != 0 ) {
+        return true;
+    }
+
+    Output_SetSize( &State->Output, Width, Height );
+    Output_SetFrameCount( &State->Output, State->Pages.Count );
+
+    State->OutputWidth = Width;
+    State->OutputHeight = Height;
+
+    if ( Output_Open( &State->Output ) == false ) {
+        if ( Output_DidUserCancel( &State->Output ) == false ) {
+            fprintf( stderr, "Failed to open output file: %s\n", strerror( errno ) );
+            State->Errors = true;
+        }
+
+        return false;
+    }
+
+    State->OutputOpen = true;
+    return true;
+}
+
+/*
+ * Sets up the --cache for (Job), unless it has none or its frames can't come from one:
+ * with --temporal every frame depends on the ones before it, and --selfcheck has to convert them.
+ * Returns false if the cache directory can't be used.
+ */
+static bool OpenCache( struct ProcessState* State, const struct ProcessJob* Job, int SlotCount ) {
+    if ( Job->CacheDirectory == NULL || Job->RawFormat != RawFormat_None || State->Options.Container == Container_GIF ) {
+        return true;
+    }
+
+    if ( State->Options.TemporalFlag == true || State->Options.SelfCheckFlag == true ) {
+        return true;
+    }
+
+    if ( Cache_Open( &State->Cache, Job->CacheDirectory, &State->Options ) == false ) {
+        fprintf( stderr, "Failed to open cache directory %s: %s\n", Job->CacheDirectory, strerror( errno ) );
+        return false;
+    }
+
+    NullCheck( ( State->Cached = ( bool* ) calloc( SlotCount, sizeof( bool ) ) ), return false );
+
+    State->Caching = true;
+    return true;
+}
+
+/*
+ * Runs (Job) using (Threads) threads to load and convert its images,
+ * the results are left in Job->FramesWritten and Job->Errors.
+ * Nothing in here is shared between calls, so jobs can run side by side.
+ */
+void Process_Run( struct ProcessJob* Job, int Threads ) {
+    struct ProcessState State;
+    int SlotCount = 0;
+    int i = 0;
+
+    NullCheck( Job, return );
+    NullCheck( Job->InputFilenames, return );
+    NullCheck( Job->OutputFilename, return );
+
+    memset( &State, 0, sizeof( struct ProcessState ) );
+
+    State.Options = Job->Options;
+
+    Output_Init( &State.Output, &State.Options, Job->OutputFilename );
+    State.Output.Overwrite = Job->Overwrite;
+
+    /* Temporal dithering needs every frame to start from the one before it,
+     * which only works with a single slot converting them in order.
+     */
+    if ( State.Options.TemporalFlag == true ) {
+        Threads = 1;
+    }
+
+    SlotCount = Jobs_GetSlotCount( Threads );
+
+    if ( ( State.Frames = ( struct Frame* ) calloc( SlotCount, sizeof( struct Frame ) ) ) == NULL ) {
+        fprintf( stderr, "Failed to allocate frame slots.\n" );
+
+        Job->Errors = true;
+        return;
+    }
+
+    if ( Job->TimingFilename != NULL && LoadTiming( &State, Job->TimingFilename ) == false ) {
+        State.Errors = true;
+    } else if ( OpenCache( &State, Job, SlotCount ) == false ) {
+        State.Errors = true;
+    } else if ( Job->RawFormat != RawFormat_None ) {
+        /* Raw frames are read one after the other and fed straight into the pipeline,
+         * so only as many of them as there are frame slots are ever held in memory.
+         */
+        if ( Stream_Open( &State.Stream, Job->InputFilenames, Job->InputCount, Job->RawFormat, Job->RawWidth, Job->RawHeight ) == true ) {
+            State.Streaming = true;
+
+            Jobs_RunOrdered( Threads, -1, ReadFrame, ConvertFrame, WriteFrame, &State );
+            Stream_Close( &State.Stream );
+
+            if ( State.Stream.Failed == true ) {
+                State.Errors = true;
+            }
+        } else {
+            State.Errors = true;
+        }
+    } else if ( Pages_Open( &State.Pages, Job->InputFilenames, Job->InputCount ) == true ) {
+        /* Single page images are loaded by the workers, pages of animations have to be read in order */
+        if ( OpenOutputEarly( &State ) == true ) {
+            Jobs_RunOrdered( Threads, State.Pages.Count, ( State.Pages.MultiPage == true ) ? ReadPage : NULL, ConvertFrame, WriteFrame, &State );
+        }
+
+        Job->FrameCount = State.Pages.Count;
+    } else {
+        State.Errors = true;
+    }
+
+    for ( i = 0; i < SlotCount; i++ ) {
+        Convert_FreeFrame( &State.Frames[ i ] );
+    }
+
+    Pages_Close( &State.Pages );
+
+    free( State.Frames );
+    Output_Free( &State.Output );
+
+    if ( State.Timing != NULL ) {
+        free( State.Timing );
+    }
+
+    if ( State.Cached != NULL ) {
+        free( State.Cached );
+    }
+
+    Job->FramesWritten = State.FramesWritten;
+    Job->FramesCached = State.FramesCached;
+    Job->Errors = State.Errors;
+}
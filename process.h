@@ -0,0 +1,40 @@
+#ifndef _PROCESS_H_
+#define _PROCESS_H_
+
+/*
+ * One conversion: a list of input images, or raw input streams, into one output file.
+ */
+struct ProcessJob {
+    struct Options Options;
+
+    const char* OutputFilename;
+    const char** InputFilenames;
+    int InputCount;
+
+    /* RawFormat_None for image files, otherwise the inputs are streams of raw frames this size */
+    int RawFormat;
+    int RawWidth;
+    int RawHeight;
+
+    /* NULL, or a file with the delay of each frame, see --timing */
+    const char* TimingFilename;
+
+    /* NULL, or the directory packed frames are kept in, see --cache */
+    const char* CacheDirectory;
+
+    /* One of the Overwrite_* values in output.h */
+    int Overwrite;
+
+    /* Filled in by Process_Run, FrameCount is more than InputCount when some images have several pages */
+    int FrameCount;
+    int FramesWritten;
+    bool Errors;
+
+    /* Frames written straight from the cache, without converting their images */
+    int FramesCached;
+};
+
+FIBITMAP* OpenInputImage( const char* Filename, int* OutImageWidth, int* OutImageHeight );
+void Process_Run( struct ProcessJob* Job, int Threads );
+
+#endif
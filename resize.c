@@ -0,0 +1,261 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <FreeImage.h>
+#include "options.h"
+#include "output.h"
+#include "resize.h"
+
+/*
+ * Area average scaling:
+ * Every destination pixel is the mean of the source area it covers, counting source pixels
+ * that are only partly covered by how much of them is. That is a plain box filter for whole
+ * number ratios, and it works the same way for enlarging.
+ *
+ * Both directions are separable, so a frame is scaled horizontally one source row at a time
+ * and then the scaled rows are combined vertically. Weights are 12 bit fixed point,
+ * horizontally scaled rows keep 8 fractional bits until the vertical pass rounds them off.
+ */
+
+/* Weights of one destination pixel add up to this */
+#define WeightBits 12
+#define WeightOne ( 1 << WeightBits )
+
+/* Fractional bits kept between the passes */
+#define RowBits 8
+
+static void FreeAxis( struct ResizeAxis* Axis ) {
+    if ( Axis->Start != NULL ) {
+        free( Axis->Start );
+    }
+
+    if ( Axis->Weights != NULL ) {
+        free( Axis->Weights );
+    }
+
+    memset( Axis, 0, sizeof( struct ResizeAxis ) );
+}
+
+/*
+ * Builds the filter for scaling (Size) source pixels to (Scaled) destination pixels.
+ * Source pixel j covers [ j * Scaled, ( j + 1 ) * Scaled ) and destination pixel i covers
+ * [ i * Size, ( i + 1 ) * Size ), so the overlaps are exact integers.
+ */
+static bool CreateAxis( struct ResizeAxis* Axis, int Size, int Scaled ) {
+    int64_t Begin = 0;
+    int64_t End = 0;
+    int64_t Low = 0;
+    int64_t High = 0;
+    int64_t Covered = 0;
+    int Given = 0;
+    int Weight = 0;
+    int First = 0;
+    int Last = 0;
+    int Start = 0;
+    int i = 0;
+    int j = 0;
+
+    /* Enough taps for the most source pixels any destination pixel can touch */
+    Axis->Taps = ( ( Size + Scaled - 1 ) / Scaled ) + 1;
+    Axis->Taps = ( Axis->Taps > Size ) ? Size : Axis->Taps;
+
+    Axis->Start = ( int* ) malloc( sizeof( int ) * Scaled );
+    Axis->Weights = ( uint16_t* ) calloc( ( size_t ) Scaled * Axis->Taps, sizeof( uint16_t ) );
+
+    if ( Axis->Start == NULL || Axis->Weights == NULL ) {
+        FreeAxis( Axis );
+        return false;
+    }
+
+    for ( i = 0; i < Scaled; i++ ) {
+        Begin = ( int64_t ) i * Size;
+        End = Begin + Size;
+
+        First = ( int ) ( Begin / Scaled );
+        Last = ( int ) ( ( End - 1 ) / Scaled );
+
+        /* Taps past the last source pixel would read outside the row, start earlier with zero weights instead */
+        Start = ( First > Size - Axis->Taps ) ? Size - Axis->Taps : First;
+        Axis->Start[ i ] = Start;
+
+        /* Rounding the running total keeps the sum of the weights exact */
+        for ( Covered = 0, Given = 0, j = First; j <= Last; j++ ) {
+            Low = ( ( int64_t ) j * Scaled > Begin ) ? ( int64_t ) j * Scaled : Begin;
+            High = ( ( int64_t ) ( j + 1 ) * Scaled < End ) ? ( int64_t ) ( j + 1 ) * Scaled : End;
+
+            Covered+= High - Low;
+            Weight = ( int ) ( ( ( Covered * WeightOne ) + ( Size / 2 ) ) / Size ) - Given;
+            Given+= Weight;
+
+            Axis->Weights[ ( ( size_t ) i * Axis->Taps ) + ( j - Start ) ] = ( uint16_t ) Weight;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Returns (a) * (b) / (c) rounded to the nearest integer, kept within [ 1, (Limit) ].
+ */
+static int Proportion( int a, int b, int c, int Limit ) {
+    int64_t Result = ( ( ( int64_t ) a * b ) + ( c / 2 ) ) / c;
+
+    return ( int ) ( ( Result < 1 ) ? 1 : ( Result > Limit ) ? Limit : Result );
+}
+
+/*
+ * Works out how a (SourceWidth)x(SourceHeight) frame is scaled to (Width)x(Height) with (Mode)
+ * and builds the tables for it.
+ */
+bool Resize_CreatePlan( struct ResizePlan* Plan, int SourceWidth, int SourceHeight, int Width, int Height, int Mode ) {
+    bool Wider = false;
+
+    NullCheck( Plan, return false );
+    CheckExpr( SourceWidth <= 0 || SourceHeight <= 0 || Width <= 0 || Height <= 0, return false );
+
+    Resize_FreePlan( Plan );
+
+    Plan->SourceWidth = SourceWidth;
+    Plan->SourceHeight = SourceHeight;
+    Plan->Width = Width;
+    Plan->Height = Height;
+    Plan->Mode = Mode;
+
+    Plan->CropWidth = SourceWidth;
+    Plan->CropHeight = SourceHeight;
+    Plan->ScaledWidth = Width;
+    Plan->ScaledHeight = Height;
+
+    /* Compares the aspect ratios without dividing */
+    Wider = ( ( int64_t ) SourceWidth * Height > ( int64_t ) SourceHeight * Width ) ? true : false;
+
+    switch ( Mode ) {
+        case Resize_Fill: {
+            if ( Wider == true ) {
+                Plan->CropWidth = Proportion( SourceHeight, Width, Height, SourceWidth );
+                Plan->CropX = ( SourceWidth - Plan->CropWidth ) / 2;
+            } else {
+                Plan->CropHeight = Proportion( SourceWidth, Height, Width, SourceHeight );
+                Plan->CropY = ( SourceHeight - Plan->CropHeight ) / 2;
+            }
+
+            break;
+        }
+        case Resize_Letterbox: {
+            if ( Wider == true ) {
+                Plan->ScaledHeight = Proportion( SourceHeight, Width, SourceWidth, Height );
+                Plan->Y = ( Height - Plan->ScaledHeight ) / 2;
+            } else {
+                Plan->ScaledWidth = Proportion( SourceWidth, Height, SourceHeight, Width );
+                Plan->X = ( Width - Plan->ScaledWidth ) / 2;
+            }
+
+            break;
+        }
+        default: break;
+    };
+
+    if ( CreateAxis( &Plan->Horizontal, Plan->CropWidth, Plan->ScaledWidth ) == false || CreateAxis( &Plan->Vertical, Plan->CropHeight, Plan->ScaledHeight ) == false ) {
+        Resize_FreePlan( Plan );
+        return false;
+    }
+
+    Plan->Rows = ( uint16_t* ) malloc( sizeof( uint16_t ) * Plan->CropHeight * Plan->ScaledWidth );
+    Plan->Sums = ( uint32_t* ) malloc( sizeof( uint32_t ) * Plan->ScaledWidth );
+
+    if ( Plan->Rows == NULL || Plan->Sums == NULL ) {
+        Resize_FreePlan( Plan );
+        return false;
+    }
+
+    return true;
+}
+
+void Resize_FreePlan( struct ResizePlan* Plan ) {
+    if ( Plan != NULL ) {
+        FreeAxis( &Plan->Horizontal );
+        FreeAxis( &Plan->Vertical );
+
+        if ( Plan->Rows != NULL ) {
+            free( Plan->Rows );
+        }
+
+        if ( Plan->Sums != NULL ) {
+            free( Plan->Sums );
+        }
+
+        memset( Plan, 0, sizeof( struct ResizePlan ) );
+    }
+}
+
+/*
+ * Scales the greyscale frame at (Source) into (Output) as planned, anything around the scaled image is set to (Fill).
+ * Both start at their top row, either pitch may be negative to walk FreeImage scanlines top-down.
+ */
+void Resize_Frame( struct ResizePlan* Plan, const uint8_t* Source, int SourcePitch, uint8_t* Output, int OutputPitch, uint8_t Fill ) {
+    const struct ResizeAxis* Horizontal = &Plan->Horizontal;
+    const struct ResizeAxis* Vertical = &Plan->Vertical;
+    const uint16_t* Weights = NULL;
+    const uint16_t* Row = NULL;
+    const uint8_t* Line = NULL;
+    uint16_t* Scaled = NULL;
+    uint32_t* Sums = Plan->Sums;
+    uint8_t* Target = NULL;
+    uint32_t Sum = 0;
+    int Width = Plan->ScaledWidth;
+    int x = 0;
+    int y = 0;
+    int t = 0;
+
+    for ( y = 0; y < Plan->CropHeight; y++ ) {
+        Line = Source + ( ( ptrdiff_t ) ( Plan->CropY + y ) * SourcePitch ) + Plan->CropX;
+        Scaled = &Plan->Rows[ ( size_t ) y * Width ];
+        Weights = Horizontal->Weights;
+
+        for ( x = 0; x < Width; x++, Weights+= Horizontal->Taps ) {
+            for ( Sum = 0, t = 0; t < Horizontal->Taps; t++ ) {
+                Sum+= ( uint32_t ) Line[ Horizontal->Start[ x ] + t ] * Weights[ t ];
+            }
+
+            Scaled[ x ] = ( uint16_t ) ( ( Sum + ( 1 << ( WeightBits - RowBits - 1 ) ) ) >> ( WeightBits - RowBits ) );
+        }
+    }
+
+    for ( y = 0; y < Plan->Height; y++ ) {
+        Target = Output + ( ( ptrdiff_t ) y * OutputPitch );
+
+        if ( y < Plan->Y || y >= Plan->Y + Plan->ScaledHeight ) {
+            memset( Target, Fill, Plan->Width );
+            continue;
+        }
+
+        Weights = &Vertical->Weights[ ( size_t ) ( y - Plan->Y ) * Vertical->Taps ];
+        memset( Sums, 0, sizeof( uint32_t ) * Width );
+
+        /* A whole row at a time for each tap, which the compiler can vectorise */
+        for ( t = 0; t < Vertical->Taps; t++ ) {
+            Row = &Plan->Rows[ ( size_t ) ( Vertical->Start[ y - Plan->Y ] + t ) * Width ];
+
+            for ( x = 0; x < Width; x++ ) {
+                Sums[ x ]+= ( uint32_t ) Row[ x ] * Weights[ t ];
+            }
+        }
+
+        memset( Target, Fill, Plan->X );
+        memset( Target + Plan->X + Width, Fill, Plan->Width - ( Plan->X + Width ) );
+
+        for ( x = 0; x < Width; x++ ) {
+            Target[ Plan->X + x ] = ( uint8_t ) ( ( Sums[ x ] + ( 1 << ( WeightBits + RowBits - 1 ) ) ) >> ( WeightBits + RowBits ) );
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef _RESIZE_H_
+#define _RESIZE_H_
+
+/*
+ * Area average filter for one direction: destination pixel i is the weighted sum of
+ * source pixels Start[ i ] to Start[ i ] + Taps - 1, with weights that add up to 4096.
+ */
+struct ResizeAxis {
+    int* Start;
+    uint16_t* Weights;
+    int Taps;
+};
+
+/*
+ * Tables for scaling greyscale frames of one size to another with one of the Resize_* policies.
+ * Built once for a given source size and reused for every frame of that size.
+ */
+struct ResizePlan {
+    /* Sizes the tables were built for */
+    int SourceWidth;
+    int SourceHeight;
+    int Width;
+    int Height;
+    int Mode;
+
+    /* Part of the source that is scaled, all of it unless the policy crops */
+    int CropX;
+    int CropY;
+    int CropWidth;
+    int CropHeight;
+
+    /* Where the scaled image goes in the target, anything outside it is filled in */
+    int X;
+    int Y;
+    int ScaledWidth;
+    int ScaledHeight;
+
+    struct ResizeAxis Horizontal;
+    struct ResizeAxis Vertical;
+
+    /* Every cropped source row scaled horizontally with 8 fractional bits, and one output row of sums */
+    uint16_t* Rows;
+    uint32_t* Sums;
+};
+
+bool Resize_CreatePlan( struct ResizePlan* Plan, int SourceWidth, int SourceHeight, int Width, int Height, int Mode );
+void Resize_FreePlan( struct ResizePlan* Plan );
+void Resize_Frame( struct ResizePlan* Plan, const uint8_t* Source, int SourcePitch, uint8_t* Output, int OutputPitch, uint8_t Fill );
+
+#endif
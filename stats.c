@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "stats.h"
+
+/*
+ * Per stage timings for --stats.
+ * Every Stats_Start/Stats_Stop pair adds one sample to its stage, samples from
+ * worker threads are appended under a lock. When stats are disabled both return
+ * straight away without reading the clock.
+ */
+struct StageSamples {
+    uint64_t* Samples;
+    size_t Count;
+    size_t Size;
+};
+
+/* Summary of one stage, in nanoseconds */
+struct StageSummary {
+    size_t Count;
+    uint64_t Min;
+    uint64_t Max;
+    uint64_t Total;
+    uint64_t P99;
+};
+
+static const char* StageNames[ Stage_Count ] = {
+    "read",
+    "cache",
+    "decode",
+    "grey",
+    "resize",
+    "invert",
+    "convert",
+    "pack",
+    "write",
+    "close"
+};
+
+static struct StageSamples Stages[ Stage_Count ];
+static pthread_mutex_t StatsLock = PTHREAD_MUTEX_INITIALIZER;
+static bool StatsEnabled = false;
+
+static uint64_t StartTime = 0;
+static uint64_t EndTime = 0;
+static int Frames = 0;
+static uint64_t Bytes = 0;
+
+static uint64_t GetTimeNS( void ) {
+    struct timespec Now;
+
+    clock_gettime( CLOCK_MONOTONIC, &Now );
+    return ( ( uint64_t ) Now.tv_sec * 1000000000ULL ) + ( uint64_t ) Now.tv_nsec;
+}
+
+void Stats_Init( bool Enable ) {
+    memset( Stages, 0, sizeof( Stages ) );
+
+    StatsEnabled = Enable;
+    StartTime = ( Enable == true ) ? GetTimeNS( ) : 0;
+}
+
+void Stats_Free( void ) {
+    int i = 0;
+
+    for ( i = 0; i < Stage_Count; i++ ) {
+        if ( Stages[ i ].Samples != NULL ) {
+            free( Stages[ i ].Samples );
+        }
+    }
+
+    memset( Stages, 0, sizeof( Stages ) );
+}
+
+/*
+ * Returns the time a stage started, to be passed to Stats_Stop.
+ */
+uint64_t Stats_Start( void ) {
+    return ( StatsEnabled == true ) ? GetTimeNS( ) : 0;
+}
+
+/*
+ * Records the time since (Start) as one sample of (Stage).
+ */
+void Stats_Stop( int Stage, uint64_t Start ) {
+    struct StageSamples* Samples = NULL;
+    uint64_t* Grown = NULL;
+    uint64_t Elapsed = 0;
+
+    if ( StatsEnabled == false || Stage < 0 || Stage >= Stage_Count ) {
+        return;
+    }
+
+    Elapsed = GetTimeNS( ) - Start;
+    Samples = &Stages[ Stage ];
+
+    pthread_mutex_lock( &StatsLock );
+        if ( Samples->Count >= Samples->Size ) {
+            if ( ( Grown = ( uint64_t* ) realloc( Samples->Samples, sizeof( uint64_t ) * ( Samples->Size + 1024 ) ) ) != NULL ) {
+                Samples->Samples = Grown;
+                Samples->Size+= 1024;
+            }
+        }
+
+        if ( Samples->Count < Samples->Size ) {
+            Samples->Samples[ Samples->Count++ ] = Elapsed;
+        }
+    pthread_mutex_unlock( &StatsLock );
+}
+
+/*
+ * Stops the overall clock, frames per second are worked out from (FramesWritten).
+ */
+void Stats_Finish( int FramesWritten, uint64_t BytesWritten ) {
+    EndTime = ( StatsEnabled == true ) ? GetTimeNS( ) : 0;
+    Frames = FramesWritten;
+    Bytes = BytesWritten;
+}
+
+static int CompareSamples( const void* a, const void* b ) {
+    uint64_t A = *( const uint64_t* ) a;
+    uint64_t B = *( const uint64_t* ) b;
+
+    return ( A > B ) - ( A < B );
+}
+
+/*
+ * Sorts the samples of (Stage) and summarizes them into (Summary).
+ */
+static void SummarizeStage( int Stage, struct StageSummary* Summary ) {
+    struct StageSamples* Samples = &Stages[ Stage ];
+    size_t i = 0;
+
+    memset( Summary, 0, sizeof( struct StageSummary ) );
+
+    if ( Samples->Count == 0 ) {
+        return;
+    }
+
+    qsort( Samples->Samples, Samples->Count, sizeof( uint64_t ), CompareSamples );
+
+    for ( i = 0; i < Samples->Count; i++ ) {
+        Summary->Total+= Samples->Samples[ i ];
+    }
+
+    Summary->Count = Samples->Count;
+    Summary->Min = Samples->Samples[ 0 ];
+    Summary->Max = Samples->Samples[ Samples->Count - 1 ];
+    Summary->P99 = Samples->Samples[ ( ( Samples->Count * 99 ) + 99 ) / 100 - 1 ];
+}
+
+static double GetSeconds( void ) {
+    return ( double ) ( EndTime - StartTime ) / 1e9;
+}
+
+static double GetFramesPerSecond( void ) {
+    return ( EndTime > StartTime ) ? ( double ) Frames / GetSeconds( ) : 0.0;
+}
+
+void Stats_Print( FILE* Output ) {
+    struct StageSummary Summary;
+    int i = 0;
+
+    if ( StatsEnabled == false || Output == NULL ) {
+        return;
+    }
+
+    fprintf( Output, "%-8s %8s %10s %10s %10s %10s %12s\n", "Stage", "Count", "Min ms", "Avg ms", "p99 ms", "Max ms", "Total ms" );
+
+    for ( i = 0; i < Stage_Count; i++ ) {
+        SummarizeStage( i, &Summary );
+
+        if ( Summary.Count > 0 ) {
+            fprintf( Output, "%-8s %8zu %10.3f %10.3f %10.3f %10.3f %12.3f\n",
+                StageNames[ i ],
+                Summary.Count,
+                ( double ) Summary.Min / 1e6,
+                ( double ) Summary.Total / 1e6 / ( double ) Summary.Count,
+                ( double ) Summary.P99 / 1e6,
+                ( double ) Summary.Max / 1e6,
+                ( double ) Summary.Total / 1e6
+            );
+        }
+    }
+
+    fprintf( Output, "%d frames in %.3f seconds, %.1f frames/sec, %llu bytes written.\n",
+        Frames,
+        GetSeconds( ),
+        GetFramesPerSecond( ),
+        ( unsigned long long ) Bytes
+    );
+}
+
+/*
+ * Writes the same numbers as Stats_Print to (Filename) as JSON, times in nanoseconds.
+ */
+bool Stats_WriteJSON( const char* Filename ) {
+    struct StageSummary Summary;
+    FILE* Output = NULL;
+    bool First = true;
+    int i = 0;
+
+    if ( StatsEnabled == false ) {
+        return true;
+    }
+
+    NullCheck( Filename, return false );
+
+    if ( ( Output = fopen( Filename, "w" ) ) == NULL ) {
+        fprintf( stderr, "Failed to open stats file %s: %s\n", Filename, strerror( errno ) );
+        return false;
+    }
+
+    fprintf( Output, "{\n" );
+    fprintf( Output, "  \"frames\": %d,\n", Frames );
+    fprintf( Output, "  \"elapsed_ns\": %llu,\n", ( unsigned long long ) ( EndTime - StartTime ) );
+    fprintf( Output, "  \"frames_per_second\": %.3f,\n", GetFramesPerSecond( ) );
+    fprintf( Output, "  \"bytes_written\": %llu,\n", ( unsigned long long ) Bytes );
+    fprintf( Output, "  \"stages\": {" );
+
+    for ( i = 0; i < Stage_Count; i++ ) {
+        SummarizeStage( i, &Summary );
+
+        if ( Summary.Count > 0 ) {
+            fprintf( Output, "%s\n    \"%s\": { \"count\": %zu, \"min_ns\": %llu, \"avg_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, \"total_ns\": %llu }",
+                ( First == true ) ? "" : ",",
+                StageNames[ i ],
+                Summary.Count,
+                ( unsigned long long ) Summary.Min,
+                ( unsigned long long ) ( Summary.Total / Summary.Count ),
+                ( unsigned long long ) Summary.P99,
+                ( unsigned long long ) Summary.Max,
+                ( unsigned long long ) Summary.Total
+            );
+
+            First = false;
+        }
+    }
+
+    fprintf( Output, "\n  }\n}\n" );
+
+    return ( fclose( Output ) == 0 ) ? true : false;
+}
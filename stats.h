@@ -0,0 +1,27 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/* Pipeline stages timed by --stats */
+enum {
+    Stage_Read = 0,
+    Stage_Cache,
+    Stage_Decode,
+    Stage_Grey,
+    Stage_Resize,
+    Stage_Invert,
+    Stage_Convert,
+    Stage_Pack,
+    Stage_Write,
+    Stage_Close,
+    Stage_Count
+};
+
+void Stats_Init( bool Enable );
+void Stats_Free( void );
+uint64_t Stats_Start( void );
+void Stats_Stop( int Stage, uint64_t Start );
+void Stats_Finish( int FramesWritten, uint64_t BytesWritten );
+void Stats_Print( FILE* Output );
+bool Stats_WriteJSON( const char* Filename );
+
+#endif
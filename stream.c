@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "stream.h"
+
+/* Pipes hand over data in small pieces, read them in bigger ones */
+#define StreamBufferSize ( 256 * 1024 )
+
+static const char StdinName[ ] = "-";
+
+size_t Stream_GetFrameSize( int Format, int Width, int Height ) {
+    switch ( Format ) {
+        case RawFormat_Gray8: return ( size_t ) Width * Height;
+        case RawFormat_RGB24: return ( size_t ) Width * Height * 3;
+        default: break;
+    };
+
+    return 0;
+}
+
+/*
+ * Moves on to the next input that can be opened, closing the current one.
+ * Inputs that can't be opened are reported and skipped, setting (Failed) so the run still fails.
+ * Returns false when there are none left.
+ */
+static bool OpenNextFile( struct RawStream* Stream ) {
+    const char* Filename = NULL;
+
+    if ( Stream->File != NULL && Stream->File != stdin ) {
+        fclose( Stream->File );
+    }
+
+    Stream->File = NULL;
+
+    while ( Stream->File == NULL ) {
+        if ( Stream->FileIndex >= Stream->FileCount ) {
+            return false;
+        }
+
+        Filename = ( Stream->Filenames != NULL ) ? Stream->Filenames[ Stream->FileIndex ] : StdinName;
+        Stream->FileIndex++;
+
+        if ( strcmp( Filename, StdinName ) == 0 ) {
+            Stream->File = stdin;
+
+            /* Buffering can only be changed before the first read, and "-" may be listed more than once */
+            if ( Stream->StdinBuffered == false ) {
+                setvbuf( stdin, NULL, _IOFBF, StreamBufferSize );
+                Stream->StdinBuffered = true;
+            }
+        } else if ( ( Stream->File = fopen( Filename, "rb" ) ) == NULL ) {
+            fprintf( stderr, "Failed to open input stream %s: %s\n", Filename, strerror( errno ) );
+            Stream->Failed = true;
+        } else {
+            setvbuf( Stream->File, NULL, _IOFBF, StreamBufferSize );
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Sets up (Stream) to read (Format) frames of (Width)x(Height) from each of (Filenames) in turn,
+ * or from stdin if there are none.
+ */
+bool Stream_Open( struct RawStream* Stream, const char** Filenames, int FileCount, int Format, int Width, int Height ) {
+    NullCheck( Stream, return false );
+
+    memset( Stream, 0, sizeof( struct RawStream ) );
+
+    Stream->Filenames = ( FileCount > 0 ) ? Filenames : NULL;
+    Stream->FileCount = ( FileCount > 0 ) ? FileCount : 1;
+    Stream->Format = Format;
+    Stream->Width = Width;
+    Stream->Height = Height;
+    Stream->FrameSize = Stream_GetFrameSize( Format, Width, Height );
+
+    CheckExpr( Stream->FrameSize == 0, return false );
+
+    return OpenNextFile( Stream );
+}
+
+void Stream_Close( struct RawStream* Stream ) {
+    if ( Stream != NULL && Stream->File != NULL ) {
+        if ( Stream->File != stdin ) {
+            fclose( Stream->File );
+        }
+
+        Stream->File = NULL;
+    }
+}
+
+/*
+ * Allocates a bitmap raw frames of (Format) can be read or copied into.
+ * The same bitmap is meant to be reused for every frame.
+ */
+FIBITMAP* Stream_AllocateBitmap( int Format, int Width, int Height ) {
+    FIBITMAP* Bitmap = NULL;
+    RGBQUAD* Palette = NULL;
+    int i = 0;
+
+    if ( Format == RawFormat_Gray8 ) {
+        NullCheck( ( Bitmap = FreeImage_Allocate( Width, Height, 8, 0, 0, 0 ) ), return NULL );
+        NullCheck( ( Palette = FreeImage_GetPalette( Bitmap ) ), FreeImage_Unload( Bitmap ); return NULL );
+
+        for ( i = 0; i < 256; i++ ) {
+            Palette[ i ].rgbRed = i;
+            Palette[ i ].rgbGreen = i;
+            Palette[ i ].rgbBlue = i;
+        }
+
+        return Bitmap;
+    }
+
+    return FreeImage_Allocate( Width, Height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK );
+}
+
+/*
+ * Swaps a line of R, G, B pixels to FreeImage's byte order in place.
+ */
+static void SwapRedBlue( uint8_t* Line, size_t Size ) {
+#if FI_RGBA_RED != 0
+    uint8_t Temp = 0;
+    size_t i = 0;
+
+    for ( i = 0; i < Size; i+= 3 ) {
+        Temp = Line[ i ];
+        Line[ i ] = Line[ i + 2 ];
+        Line[ i + 2 ] = Temp;
+    }
+#else
+    ( void ) Line;
+    ( void ) Size;
+#endif
+}
+
+/*
+ * Copies one top-down frame of (Format) pixels, (Stride) bytes per row,
+ * into (Output), a bitmap from Stream_AllocateBitmap.
+ */
+void Stream_CopyFrame( int Format, const uint8_t* Pixels, size_t Stride, FIBITMAP* Output ) {
+    int Height = FreeImage_GetHeight( Output );
+    size_t LineSize = 0;
+    uint8_t* Line = NULL;
+    int y = 0;
+
+    LineSize = Stream_GetFrameSize( Format, FreeImage_GetWidth( Output ), 1 );
+
+    for ( y = 0; y < Height; y++, Pixels+= Stride ) {
+        Line = FreeImage_GetScanLine( Output, Height - 1 - y );
+        memcpy( Line, Pixels, LineSize );
+
+        if ( Format == RawFormat_RGB24 ) {
+            SwapRedBlue( Line, LineSize );
+        }
+    }
+}
+
+/*
+ * Reads the next whole frame into (Output), a bitmap from Stream_AllocateBitmap.
+ * Raw frames are top down so rows are stored bottom up, RGB24 frames are swapped to FreeImage's byte order.
+ * Returns false at the end of the last input.
+ */
+bool Stream_ReadFrame( struct RawStream* Stream, FIBITMAP* Output ) {
+    size_t LineSize = 0;
+    size_t BytesRead = 0;
+    size_t Count = 0;
+    uint8_t* Line = NULL;
+    int y = 0;
+
+    NullCheck( Stream, return false );
+    NullCheck( Output, return false );
+
+    LineSize = Stream->FrameSize / Stream->Height;
+
+    while ( Stream->File != NULL ) {
+        for ( BytesRead = 0, y = 0; y < Stream->Height; y++, BytesRead+= Count ) {
+            Line = FreeImage_GetScanLine( Output, Stream->Height - 1 - y );
+
+            if ( ( Count = fread( Line, 1, LineSize, Stream->File ) ) != LineSize ) {
+                BytesRead+= Count;
+                break;
+            }
+
+            if ( Stream->Format == RawFormat_RGB24 ) {
+                SwapRedBlue( Line, LineSize );
+            }
+        }
+
+        if ( BytesRead == Stream->FrameSize ) {
+            return true;
+        }
+
+        if ( BytesRead > 0 ) {
+            fprintf( stderr, "Input stream ended in the middle of a frame, ignoring the last %zu bytes.\n", BytesRead );
+        }
+
+        if ( ferror( Stream->File ) ) {
+            fprintf( stderr, "Failed to read input stream: %s\n", strerror( errno ) );
+            Stream->Failed = true;
+
+            /* stdin stays open for the next time "-" comes up */
+            clearerr( Stream->File );
+        }
+
+        OpenNextFile( Stream );
+    }
+
+    return false;
+}
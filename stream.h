@@ -0,0 +1,44 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+enum {
+    RawFormat_None = 0,
+
+    /* One byte per pixel, 0 is black */
+    RawFormat_Gray8,
+
+    /* Three bytes per pixel in R, G, B order */
+    RawFormat_RGB24
+};
+
+/*
+ * Raw frames of a fixed size read back to back from stdin, FIFOs or files.
+ */
+struct RawStream {
+    FILE* File;
+
+    /* Inputs are read one after another, "-" is stdin */
+    const char** Filenames;
+    int FileCount;
+    int FileIndex;
+
+    /* Set once any of them couldn't be opened or read */
+    bool Failed;
+
+    /* stdin has been given its buffer */
+    bool StdinBuffered;
+
+    int Format;
+    int Width;
+    int Height;
+    size_t FrameSize;
+};
+
+size_t Stream_GetFrameSize( int Format, int Width, int Height );
+bool Stream_Open( struct RawStream* Stream, const char** Filenames, int FileCount, int Format, int Width, int Height );
+void Stream_Close( struct RawStream* Stream );
+FIBITMAP* Stream_AllocateBitmap( int Format, int Width, int Height );
+void Stream_CopyFrame( int Format, const uint8_t* Pixels, size_t Stride, FIBITMAP* Output );
+bool Stream_ReadFrame( struct RawStream* Stream, FIBITMAP* Output );
+
+#endif
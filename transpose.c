@@ -0,0 +1,330 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "transpose.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define TRANSPOSE_X86
+#include <immintrin.h>
+#elif defined( __aarch64__ ) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+#define TRANSPOSE_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * All of the engines below work on one page (8 scanlines) at a time.
+ * The 8 bytes of each 8x8 block are gathered into a 64 bit word with the bottom
+ * scanline in the lowest byte, after which flipping the word about its anti-diagonal
+ * leaves one byte per pixel column, in column order, with the top row in bit 0.
+ * That is exactly how the SSD1306 stores a page.
+ */
+#define AntiDiagonalK1 0xAA00AA00AA00AA00ULL
+#define AntiDiagonalK2 0xCCCC0000CCCC0000ULL
+#define AntiDiagonalK4 0xF0F0F0F00F0F0F0FULL
+
+typedef void ( *TransposeFn ) ( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns );
+
+static void TransposePageScalar( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns );
+
+static TransposeFn TransposeEngine = NULL;
+static const char* TransposeEngineName = "none";
+
+static uint64_t FlipAntiDiagonal( uint64_t x ) {
+    uint64_t t = 0;
+
+    t = x ^ ( x << 36 );
+    x ^= AntiDiagonalK4 & ( t ^ ( x >> 36 ) );
+    t = AntiDiagonalK2 & ( x ^ ( x << 18 ) );
+    x ^= t ^ ( t >> 18 );
+    t = AntiDiagonalK1 & ( x ^ ( x << 9 ) );
+    x ^= t ^ ( t >> 9 );
+
+    return x;
+}
+
+/*
+ * Portable fallback, one 8x8 block at a time.
+ */
+static void TransposePageScalar( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns ) {
+    uint64_t Block = 0;
+    int x = 0;
+    int i = 0;
+
+    for ( x = 0; x < Blocks; x++ ) {
+        Block = 0;
+
+        for ( i = 0; i < 8; i++ ) {
+            Block |= ( ( uint64_t ) Bits[ ( i * Pitch ) + x ] ) << ( ( 7 - i ) * 8 );
+        }
+
+        Block = FlipAntiDiagonal( Block );
+
+        for ( i = 0; i < 8; i++ ) {
+            Columns[ ( x * 8 ) + i ] = ( uint8_t ) ( Block >> ( i * 8 ) ) ^ Xor;
+        }
+    }
+}
+
+#if defined( TRANSPOSE_X86 )
+
+/*
+ * Byte transposes 8 rows of 16 bytes with unpacks so that every 64 bit lane
+ * holds one 8x8 block, then flips two blocks per register.
+ * 16 blocks (128 pixels) per iteration.
+ */
+__attribute__(( target( "sse2" ) ))
+static __m128i FlipAntiDiagonalSSE2( __m128i x ) {
+    const __m128i K1 = _mm_set1_epi64x( ( long long ) AntiDiagonalK1 );
+    const __m128i K2 = _mm_set1_epi64x( ( long long ) AntiDiagonalK2 );
+    const __m128i K4 = _mm_set1_epi64x( ( long long ) AntiDiagonalK4 );
+    __m128i t;
+
+    t = _mm_xor_si128( x, _mm_slli_epi64( x, 36 ) );
+    x = _mm_xor_si128( x, _mm_and_si128( K4, _mm_xor_si128( t, _mm_srli_epi64( x, 36 ) ) ) );
+    t = _mm_and_si128( K2, _mm_xor_si128( x, _mm_slli_epi64( x, 18 ) ) );
+    x = _mm_xor_si128( x, _mm_xor_si128( t, _mm_srli_epi64( t, 18 ) ) );
+    t = _mm_and_si128( K1, _mm_xor_si128( x, _mm_slli_epi64( x, 9 ) ) );
+    x = _mm_xor_si128( x, _mm_xor_si128( t, _mm_srli_epi64( t, 9 ) ) );
+
+    return x;
+}
+
+__attribute__(( target( "sse2" ) ))
+static void TransposeHalfSSE2( const __m128i* A, __m128i XorMask, uint8_t* Columns ) {
+    __m128i B0 = _mm_unpacklo_epi16( A[ 0 ], A[ 1 ] );
+    __m128i B1 = _mm_unpackhi_epi16( A[ 0 ], A[ 1 ] );
+    __m128i C0 = _mm_unpacklo_epi16( A[ 2 ], A[ 3 ] );
+    __m128i C1 = _mm_unpackhi_epi16( A[ 2 ], A[ 3 ] );
+    __m128i V[ 4 ];
+    int i = 0;
+
+    V[ 0 ] = _mm_unpacklo_epi32( B0, C0 );
+    V[ 1 ] = _mm_unpackhi_epi32( B0, C0 );
+    V[ 2 ] = _mm_unpacklo_epi32( B1, C1 );
+    V[ 3 ] = _mm_unpackhi_epi32( B1, C1 );
+
+    for ( i = 0; i < 4; i++ ) {
+        _mm_storeu_si128( ( __m128i* ) &Columns[ i * 16 ], _mm_xor_si128( FlipAntiDiagonalSSE2( V[ i ] ), XorMask ) );
+    }
+}
+
+__attribute__(( target( "sse2" ) ))
+static void TransposePageSSE2( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns ) {
+    const __m128i XorMask = _mm_set1_epi8( ( char ) Xor );
+    __m128i Rows[ 8 ];
+    __m128i Lo[ 4 ];
+    __m128i Hi[ 4 ];
+    int x = 0;
+    int i = 0;
+
+    for ( x = 0; x + 16 <= Blocks; x+= 16 ) {
+        /* Bottom scanline first, see the comment at the top of the file */
+        for ( i = 0; i < 8; i++ ) {
+            Rows[ i ] = _mm_loadu_si128( ( const __m128i* ) &Bits[ ( ( 7 - i ) * Pitch ) + x ] );
+        }
+
+        for ( i = 0; i < 4; i++ ) {
+            Lo[ i ] = _mm_unpacklo_epi8( Rows[ i * 2 ], Rows[ ( i * 2 ) + 1 ] );
+            Hi[ i ] = _mm_unpackhi_epi8( Rows[ i * 2 ], Rows[ ( i * 2 ) + 1 ] );
+        }
+
+        TransposeHalfSSE2( Lo, XorMask, &Columns[ x * 8 ] );
+        TransposeHalfSSE2( Hi, XorMask, &Columns[ ( x + 8 ) * 8 ] );
+    }
+
+    TransposePageScalar( &Bits[ x ], Pitch, Blocks - x, Xor, &Columns[ x * 8 ] );
+}
+
+/*
+ * Same as the SSE2 engine on 256 bit registers, 32 blocks (256 pixels) per iteration.
+ * Unpacks work within each 128 bit lane so the two lanes are recombined before storing.
+ */
+__attribute__(( target( "avx2" ) ))
+static __m256i FlipAntiDiagonalAVX2( __m256i x ) {
+    const __m256i K1 = _mm256_set1_epi64x( ( long long ) AntiDiagonalK1 );
+    const __m256i K2 = _mm256_set1_epi64x( ( long long ) AntiDiagonalK2 );
+    const __m256i K4 = _mm256_set1_epi64x( ( long long ) AntiDiagonalK4 );
+    __m256i t;
+
+    t = _mm256_xor_si256( x, _mm256_slli_epi64( x, 36 ) );
+    x = _mm256_xor_si256( x, _mm256_and_si256( K4, _mm256_xor_si256( t, _mm256_srli_epi64( x, 36 ) ) ) );
+    t = _mm256_and_si256( K2, _mm256_xor_si256( x, _mm256_slli_epi64( x, 18 ) ) );
+    x = _mm256_xor_si256( x, _mm256_xor_si256( t, _mm256_srli_epi64( t, 18 ) ) );
+    t = _mm256_and_si256( K1, _mm256_xor_si256( x, _mm256_slli_epi64( x, 9 ) ) );
+    x = _mm256_xor_si256( x, _mm256_xor_si256( t, _mm256_srli_epi64( t, 9 ) ) );
+
+    return x;
+}
+
+__attribute__(( target( "avx2" ) ))
+static void TransposeHalfAVX2( const __m256i* A, __m256i XorMask, uint8_t* Columns ) {
+    __m256i B0 = _mm256_unpacklo_epi16( A[ 0 ], A[ 1 ] );
+    __m256i B1 = _mm256_unpackhi_epi16( A[ 0 ], A[ 1 ] );
+    __m256i C0 = _mm256_unpacklo_epi16( A[ 2 ], A[ 3 ] );
+    __m256i C1 = _mm256_unpackhi_epi16( A[ 2 ], A[ 3 ] );
+    __m256i V[ 4 ];
+    int i = 0;
+
+    V[ 0 ] = _mm256_xor_si256( FlipAntiDiagonalAVX2( _mm256_unpacklo_epi32( B0, C0 ) ), XorMask );
+    V[ 1 ] = _mm256_xor_si256( FlipAntiDiagonalAVX2( _mm256_unpackhi_epi32( B0, C0 ) ), XorMask );
+    V[ 2 ] = _mm256_xor_si256( FlipAntiDiagonalAVX2( _mm256_unpacklo_epi32( B1, C1 ) ), XorMask );
+    V[ 3 ] = _mm256_xor_si256( FlipAntiDiagonalAVX2( _mm256_unpackhi_epi32( B1, C1 ) ), XorMask );
+
+    /* Low lanes hold blocks 0-7 of this half, high lanes hold blocks 16-23 */
+    for ( i = 0; i < 4; i+= 2 ) {
+        _mm256_storeu_si256( ( __m256i* ) &Columns[ i * 16 ], _mm256_permute2x128_si256( V[ i ], V[ i + 1 ], 0x20 ) );
+        _mm256_storeu_si256( ( __m256i* ) &Columns[ ( i * 16 ) + 128 ], _mm256_permute2x128_si256( V[ i ], V[ i + 1 ], 0x31 ) );
+    }
+}
+
+__attribute__(( target( "avx2" ) ))
+static void TransposePageAVX2( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns ) {
+    const __m256i XorMask = _mm256_set1_epi8( ( char ) Xor );
+    __m256i Rows[ 8 ];
+    __m256i Lo[ 4 ];
+    __m256i Hi[ 4 ];
+    int x = 0;
+    int i = 0;
+
+    for ( x = 0; x + 32 <= Blocks; x+= 32 ) {
+        for ( i = 0; i < 8; i++ ) {
+            Rows[ i ] = _mm256_loadu_si256( ( const __m256i* ) &Bits[ ( ( 7 - i ) * Pitch ) + x ] );
+        }
+
+        for ( i = 0; i < 4; i++ ) {
+            Lo[ i ] = _mm256_unpacklo_epi8( Rows[ i * 2 ], Rows[ ( i * 2 ) + 1 ] );
+            Hi[ i ] = _mm256_unpackhi_epi8( Rows[ i * 2 ], Rows[ ( i * 2 ) + 1 ] );
+        }
+
+        TransposeHalfAVX2( Lo, XorMask, &Columns[ x * 8 ] );
+        TransposeHalfAVX2( Hi, XorMask, &Columns[ ( x + 8 ) * 8 ] );
+    }
+
+    TransposePageSSE2( &Bits[ x ], Pitch, Blocks - x, Xor, &Columns[ x * 8 ] );
+}
+
+#elif defined( TRANSPOSE_NEON )
+
+/*
+ * AArch64 version of the SSE2 engine, zips take the place of unpacks.
+ * 16 blocks (128 pixels) per iteration.
+ */
+static uint64x2_t FlipAntiDiagonalNEON( uint64x2_t x ) {
+    const uint64x2_t K1 = vdupq_n_u64( AntiDiagonalK1 );
+    const uint64x2_t K2 = vdupq_n_u64( AntiDiagonalK2 );
+    const uint64x2_t K4 = vdupq_n_u64( AntiDiagonalK4 );
+    uint64x2_t t;
+
+    t = veorq_u64( x, vshlq_n_u64( x, 36 ) );
+    x = veorq_u64( x, vandq_u64( K4, veorq_u64( t, vshrq_n_u64( x, 36 ) ) ) );
+    t = vandq_u64( K2, veorq_u64( x, vshlq_n_u64( x, 18 ) ) );
+    x = veorq_u64( x, veorq_u64( t, vshrq_n_u64( t, 18 ) ) );
+    t = vandq_u64( K1, veorq_u64( x, vshlq_n_u64( x, 9 ) ) );
+    x = veorq_u64( x, veorq_u64( t, vshrq_n_u64( t, 9 ) ) );
+
+    return x;
+}
+
+static void TransposeHalfNEON( const uint8x16_t* A, uint8x16_t XorMask, uint8_t* Columns ) {
+    uint16x8_t B0 = vzip1q_u16( vreinterpretq_u16_u8( A[ 0 ] ), vreinterpretq_u16_u8( A[ 1 ] ) );
+    uint16x8_t B1 = vzip2q_u16( vreinterpretq_u16_u8( A[ 0 ] ), vreinterpretq_u16_u8( A[ 1 ] ) );
+    uint16x8_t C0 = vzip1q_u16( vreinterpretq_u16_u8( A[ 2 ] ), vreinterpretq_u16_u8( A[ 3 ] ) );
+    uint16x8_t C1 = vzip2q_u16( vreinterpretq_u16_u8( A[ 2 ] ), vreinterpretq_u16_u8( A[ 3 ] ) );
+    uint32x4_t V[ 4 ];
+    int i = 0;
+
+    V[ 0 ] = vzip1q_u32( vreinterpretq_u32_u16( B0 ), vreinterpretq_u32_u16( C0 ) );
+    V[ 1 ] = vzip2q_u32( vreinterpretq_u32_u16( B0 ), vreinterpretq_u32_u16( C0 ) );
+    V[ 2 ] = vzip1q_u32( vreinterpretq_u32_u16( B1 ), vreinterpretq_u32_u16( C1 ) );
+    V[ 3 ] = vzip2q_u32( vreinterpretq_u32_u16( B1 ), vreinterpretq_u32_u16( C1 ) );
+
+    for ( i = 0; i < 4; i++ ) {
+        vst1q_u8( &Columns[ i * 16 ], veorq_u8( vreinterpretq_u8_u64( FlipAntiDiagonalNEON( vreinterpretq_u64_u32( V[ i ] ) ) ), XorMask ) );
+    }
+}
+
+static void TransposePageNEON( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns ) {
+    const uint8x16_t XorMask = vdupq_n_u8( Xor );
+    uint8x16_t Rows[ 8 ];
+    uint8x16_t Lo[ 4 ];
+    uint8x16_t Hi[ 4 ];
+    int x = 0;
+    int i = 0;
+
+    for ( x = 0; x + 16 <= Blocks; x+= 16 ) {
+        for ( i = 0; i < 8; i++ ) {
+            Rows[ i ] = vld1q_u8( &Bits[ ( ( 7 - i ) * Pitch ) + x ] );
+        }
+
+        for ( i = 0; i < 4; i++ ) {
+            Lo[ i ] = vzip1q_u8( Rows[ i * 2 ], Rows[ ( i * 2 ) + 1 ] );
+            Hi[ i ] = vzip2q_u8( Rows[ i * 2 ], Rows[ ( i * 2 ) + 1 ] );
+        }
+
+        TransposeHalfNEON( Lo, XorMask, &Columns[ x * 8 ] );
+        TransposeHalfNEON( Hi, XorMask, &Columns[ ( x + 8 ) * 8 ] );
+    }
+
+    TransposePageScalar( &Bits[ x ], Pitch, Blocks - x, Xor, &Columns[ x * 8 ] );
+}
+
+#endif
+
+/*
+ * Picks the widest engine the CPU supports.
+ * Setting ANIM1B_TRANSPOSE=scalar in the environment forces the portable version.
+ */
+void Transpose_Init( void ) {
+    const char* Override = getenv( "ANIM1B_TRANSPOSE" );
+
+    TransposeEngine = TransposePageScalar;
+    TransposeEngineName = "scalar";
+
+    if ( Override != NULL && strcmp( Override, "scalar" ) == 0 ) {
+        return;
+    }
+
+#if defined( TRANSPOSE_X86 )
+    __builtin_cpu_init( );
+
+    if ( __builtin_cpu_supports( "sse2" ) ) {
+        TransposeEngine = TransposePageSSE2;
+        TransposeEngineName = "sse2";
+    }
+
+    if ( __builtin_cpu_supports( "avx2" ) && ( Override == NULL || strcmp( Override, "sse2" ) != 0 ) ) {
+        TransposeEngine = TransposePageAVX2;
+        TransposeEngineName = "avx2";
+    }
+#elif defined( TRANSPOSE_NEON )
+    /* Advanced SIMD is mandatory on AArch64 */
+    TransposeEngine = TransposePageNEON;
+    TransposeEngineName = "neon";
+#endif
+}
+
+const char* Transpose_GetEngineName( void ) {
+    return TransposeEngineName;
+}
+
+/*
+ * Transposes (Blocks) 8x8 blocks lying side by side across the 8 scanlines starting at (Bits).
+ * Columns receives one byte per pixel column (Blocks * 8 bytes) in SSD1306 page format,
+ * each one XORed with (Xor).
+ */
+void Transpose_Page( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns ) {
+    if ( TransposeEngine == NULL ) {
+        Transpose_Init( );
+    }
+
+    TransposeEngine( Bits, Pitch, Blocks, Xor, Columns );
+}
@@ -0,0 +1,8 @@
+#ifndef _TRANSPOSE_H_
+#define _TRANSPOSE_H_
+
+void Transpose_Init( void );
+const char* Transpose_GetEngineName( void );
+void Transpose_Page( const uint8_t* Bits, int Pitch, int Blocks, uint8_t Xor, uint8_t* Columns );
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * Copyright (c) 2017-2018 Tara Keeling
+ * 
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+/* fopencookie */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <FreeImage.h>
+#include "output.h"
+#include "writer.h"
+
+/*
+ * Asynchronous output writer:
+ * Everything written to the stream is copied into a ring of large buffers, full ones are
+ * written to the file by a thread of its own with one fwrite each. The writing thread only
+ * waits when every buffer is still queued, and when it seeks, which waits for the ring to drain.
+ */
+
+/* Number of buffers in the ring, and the size of each, which is what gets written in one go */
+#define BufferCount 4
+#define BufferSize ( 256 * 1024 )
+
+struct AsyncWriter {
+    /* The real file, only used by the I/O thread unless the ring is empty */
+    FILE* File;
+
+    pthread_t Thread;
+    pthread_mutex_t Lock;
+    pthread_cond_t Filled;
+    pthread_cond_t Emptied;
+
+    uint8_t* Buffers[ BufferCount ];
+    size_t Used[ BufferCount ];
+
+    /* Buffer being filled, next buffer to write and the number queued for writing */
+    int Head;
+    int Tail;
+    int Queued;
+
+    /* Where the next byte written to the stream ends up in the file */
+    off64_t Position;
+
+    bool Error;
+    bool Stop;
+};
+
+static void* WriterThread( void* Param ) {
+    struct AsyncWriter* Writer = ( struct AsyncWriter* ) Param;
+    size_t Size = 0;
+    int Index = 0;
+
+    pthread_mutex_lock( &Writer->Lock );
+
+    while ( true ) {
+        while ( Writer->Queued == 0 && Writer->Stop == false ) {
+            pthread_cond_wait( &Writer->Filled, &Writer->Lock );
+        }
+
+        if ( Writer->Queued == 0 ) {
+            break;
+        }
+
+        Index = Writer->Tail;
+        Size = Writer->Used[ Index ];
+
+        pthread_mutex_unlock( &Writer->Lock );
+            Size = ( fwrite( Writer->Buffers[ Index ], 1, Size, Writer->File ) == Size ) ? 0 : Size;
+        pthread_mutex_lock( &Writer->Lock );
+
+        if ( Size != 0 ) {
+            Writer->Error = true;
+        }
+
+        Writer->Used[ Index ] = 0;
+        Writer->Tail = ( Writer->Tail + 1 ) % BufferCount;
+        Writer->Queued--;
+
+        pthread_cond_broadcast( &Writer->Emptied );
+    }
+
+    pthread_mutex_unlock( &Writer->Lock );
+    return NULL;
+}
+
+/*
+ * Queues the buffer being filled for writing and moves on to the next one,
+ * waiting for it if the ring is full. Returns false if the I/O thread failed to write.
+ */
+static bool QueueBuffer( struct AsyncWriter* Writer ) {
+    bool Result = false;
+
+    pthread_mutex_lock( &Writer->Lock );
+        Writer->Queued++;
+        pthread_cond_signal( &Writer->Filled );
+
+        while ( Writer->Queued >= BufferCount ) {
+            pthread_cond_wait( &Writer->Emptied, &Writer->Lock );
+        }
+
+        Writer->Head = ( Writer->Head + 1 ) % BufferCount;
+        Result = ! Writer->Error;
+    pthread_mutex_unlock( &Writer->Lock );
+
+    return Result;
+}
+
+/*
+ * Waits until everything written so far is in the file.
+ * Returns false if any of it could not be written.
+ */
+static bool Drain( struct AsyncWriter* Writer ) {
+    bool Result = false;
+
+    if ( Writer->Used[ Writer->Head ] > 0 ) {
+        QueueBuffer( Writer );
+    }
+
+    pthread_mutex_lock( &Writer->Lock );
+        while ( Writer->Queued > 0 ) {
+            pthread_cond_wait( &Writer->Emptied, &Writer->Lock );
+        }
+
+        Result = ! Writer->Error;
+    pthread_mutex_unlock( &Writer->Lock );
+
+    return Result;
+}
+
+static ssize_t WriteStream( void* Cookie, const char* Data, size_t Size ) {
+    struct AsyncWriter* Writer = ( struct AsyncWriter* ) Cookie;
+    size_t Written = 0;
+    size_t Count = 0;
+    uint8_t* Buffer = NULL;
+
+    while ( Written < Size ) {
+        Buffer = Writer->Buffers[ Writer->Head ];
+        Count = BufferSize - Writer->Used[ Writer->Head ];
+        Count = ( Count > Size - Written ) ? Size - Written : Count;
+
+        memcpy( &Buffer[ Writer->Used[ Writer->Head ] ], &Data[ Written ], Count );
+        Writer->Used[ Writer->Head ]+= Count;
+        Written+= Count;
+
+        /* Errors from the I/O thread turn up when a buffer is handed over */
+        if ( Writer->Used[ Writer->Head ] == BufferSize && QueueBuffer( Writer ) == false ) {
+            return 0;
+        }
+    }
+
+    Writer->Position+= ( off64_t ) Written;
+    return ( ssize_t ) Written;
+}
+
+static int SeekStream( void* Cookie, off64_t* Offset, int Whence ) {
+    struct AsyncWriter* Writer = ( struct AsyncWriter* ) Cookie;
+
+    /* ftell, which doesn't need anything written yet */
+    if ( Whence == SEEK_CUR && *Offset == 0 ) {
+        *Offset = Writer->Position;
+        return 0;
+    }
+
+    if ( Drain( Writer ) == false || fseeko( Writer->File, ( off_t ) *Offset, Whence ) != 0 ) {
+        return -1;
+    }
+
+    Writer->Position = ( off64_t ) ftello( Writer->File );
+    *Offset = Writer->Position;
+
+    return 0;
+}
+
+static void FreeWriter( struct AsyncWriter* Writer ) {
+    int i = 0;
+
+    for ( i = 0; i < BufferCount; i++ ) {
+        if ( Writer->Buffers[ i ] != NULL ) {
+            free( Writer->Buffers[ i ] );
+        }
+    }
+
+    free( Writer );
+}
+
+static int CloseStream( void* Cookie ) {
+    struct AsyncWriter* Writer = ( struct AsyncWriter* ) Cookie;
+    bool Result = false;
+
+    Result = Drain( Writer );
+
+    pthread_mutex_lock( &Writer->Lock );
+        Writer->Stop = true;
+        pthread_cond_signal( &Writer->Filled );
+    pthread_mutex_unlock( &Writer->Lock );
+
+    pthread_join( Writer->Thread, NULL );
+
+    pthread_cond_destroy( &Writer->Emptied );
+    pthread_cond_destroy( &Writer->Filled );
+    pthread_mutex_destroy( &Writer->Lock );
+
+    if ( Writer->File != NULL && fclose( Writer->File ) != 0 ) {
+        Result = false;
+    }
+
+    FreeWriter( Writer );
+    return ( Result == true ) ? 0 : -1;
+}
+
+/*
+ * Returns a stream that writes to (File) on a thread of its own, or NULL if one can't be set up
+ * in which case (File) is left as it was. Once it has one the stream owns (File),
+ * closing the stream waits for everything to be written and then closes (File).
+ * Write errors are reported by a later write, or by fclose.
+ */
+FILE* Writer_Open( FILE* File ) {
+    cookie_io_functions_t Functions;
+    struct AsyncWriter* Writer = NULL;
+    FILE* Stream = NULL;
+    off_t Position = 0;
+    int i = 0;
+
+    NullCheck( File, return NULL );
+
+    /* Anything already written has to go first */
+    if ( fflush( File ) != 0 || ( Position = ftello( File ) ) < 0 ) {
+        return NULL;
+    }
+
+    NullCheck( ( Writer = ( struct AsyncWriter* ) calloc( 1, sizeof( struct AsyncWriter ) ) ), return NULL );
+
+    for ( i = 0; i < BufferCount; i++ ) {
+        NullCheck( ( Writer->Buffers[ i ] = ( uint8_t* ) malloc( BufferSize ) ), FreeWriter( Writer ); return NULL );
+    }
+
+    Writer->File = File;
+    Writer->Position = ( off64_t ) Position;
+
+    memset( &Functions, 0, sizeof( cookie_io_functions_t ) );
+
+    Functions.write = WriteStream;
+    Functions.seek = SeekStream;
+    Functions.close = CloseStream;
+
+    pthread_mutex_init( &Writer->Lock, NULL );
+    pthread_cond_init( &Writer->Filled, NULL );
+    pthread_cond_init( &Writer->Emptied, NULL );
+
+    if ( pthread_create( &Writer->Thread, NULL, WriterThread, Writer ) != 0 ) {
+        pthread_cond_destroy( &Writer->Emptied );
+        pthread_cond_destroy( &Writer->Filled );
+        pthread_mutex_destroy( &Writer->Lock );
+
+        FreeWriter( Writer );
+        return NULL;
+    }
+
+    if ( ( Stream = fopencookie( Writer, "wb", Functions ) ) == NULL ) {
+        /* Closing an empty writer just stops the thread, (File) has to stay open */
+        Writer->File = NULL;
+        CloseStream( Writer );
+        return NULL;
+    }
+
+    return Stream;
+}
@@ -0,0 +1,6 @@
+#ifndef _WRITER_H_
+#define _WRITER_H_
+
+FILE* Writer_Open( FILE* File );
+
+#endif